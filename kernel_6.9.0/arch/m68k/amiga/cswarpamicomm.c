@@ -0,0 +1,123 @@
+/*
+ *  linux/arch/m68k/amiga/cswarpamicomm.c -- csWarp 68k <-> ARM mailbox
+ *
+ *      Copyright (C) 2024 Andrzej Rogozynski
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of this archive for
+ *  more details.
+ */
+
+#include <linux/delay.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+
+#include <asm/cswarpamicomm.h>
+
+DEFINE_SPINLOCK(cswarp_dpram_lock);
+EXPORT_SYMBOL(cswarp_dpram_lock);
+
+/**
+ * @brief send IRQ to ARM, wait for
+ *        message processing and optional for reply.
+ * 	      (It is assumed that frame is already in dpRAM and
+ *        cswarp_dpram_lock is held)
+ * @param ctrlBase Warp-CTRL board base address
+ * @param waitForReply
+ * @return WAC_OK if successfull
+ */
+WarpAmiCommStatus cswarpSendMsgToArm(void __iomem *ctrlBase, bool waitForReply)
+{
+  volatile u32 __iomem *dp_reg_cr = cswarpDpRegCR(ctrlBase);
+  
+  // drop a reply that came after its sender gave up
+  *dp_reg_cr = DPREG_CR_CLR | DPREG_CR_MP_68K;
+  // send irq to ARM
+  *dp_reg_cr = DPREG_CR_SET | DPREG_CR_MP_ARM | DPREG_CR_IE_ARM;
+
+  // wait for ARM has processed the message
+  while((*dp_reg_cr & DPREG_CR_MR_ARM) == 0);
+  // clear flag
+  *dp_reg_cr = DPREG_CR_CLR | DPREG_CR_MR_ARM | DPREG_CR_IE_ARM;
+
+  if(waitForReply) {
+    // wait for ARM reply
+	while((*dp_reg_cr & DPREG_CR_MP_68K) == 0);
+	// clear flag
+	*dp_reg_cr = DPREG_CR_CLR | DPREG_CR_MP_68K;
+  }
+
+  return wacOK;
+}
+EXPORT_SYMBOL(cswarpSendMsgToArm);
+
+/**
+ * @brief as cswarpSendMsgToArm, but give up after timeoutUs. For
+ *        commands older firmware may not know: it takes the message,
+ *        but never replies.
+ * 	      (It is assumed that frame is already in dpRAM and
+ *        cswarp_dpram_lock is held)
+ * @param ctrlBase Warp-CTRL board base address
+ * @param waitForReply
+ * @param timeoutUs max. time for the ARM to take and answer the message
+ * @return WAC_OK if successfull, wacTIMEOUT if the ARM did not answer
+ */
+WarpAmiCommStatus cswarpSendMsgToArmTimeout(void __iomem *ctrlBase, bool waitForReply,
+                                            unsigned int timeoutUs)
+{
+  volatile u32 __iomem *dp_reg_cr = cswarpDpRegCR(ctrlBase);
+
+  *dp_reg_cr = DPREG_CR_CLR | DPREG_CR_MP_68K;
+  *dp_reg_cr = DPREG_CR_SET | DPREG_CR_MP_ARM | DPREG_CR_IE_ARM;
+
+  while((*dp_reg_cr & DPREG_CR_MR_ARM) == 0) {
+    if(timeoutUs-- == 0) {
+      // withdraw the message, the ARM never saw it
+      *dp_reg_cr = DPREG_CR_CLR | DPREG_CR_MP_ARM | DPREG_CR_IE_ARM;
+      return wacTIMEOUT;
+    }
+    udelay(1);
+  }
+  *dp_reg_cr = DPREG_CR_CLR | DPREG_CR_MR_ARM | DPREG_CR_IE_ARM;
+
+  if(waitForReply) {
+    while((*dp_reg_cr & DPREG_CR_MP_68K) == 0) {
+      // a late reply is dropped by the next send
+      if(timeoutUs-- == 0)
+        return wacTIMEOUT;
+      udelay(1);
+    }
+    *dp_reg_cr = DPREG_CR_CLR | DPREG_CR_MP_68K;
+  }
+
+  return wacOK;
+}
+EXPORT_SYMBOL(cswarpSendMsgToArmTimeout);
+
+/**
+ * @brief read the ARM diagnostic frame (voltages, temperatures, fan,
+ *        turbo level, regulator settings). Takes cswarp_dpram_lock.
+ * @param ctrlBase Warp-CTRL board base address
+ * @param diag filled with a copy of the reply
+ * @return true if the ARM replied with a diagnostic frame
+ */
+bool cswarpReadDiag(void __iomem *ctrlBase, DprRplDiagMsg *diag)
+{
+  volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(ctrlBase);
+  volatile DprRplFrame __iomem *rpl = cswarpRplFrame(ctrlBase);
+  ulong irqFlags;
+  bool ok;
+
+  spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+  cmd->header.cmd = dpcmdGetDiag;
+  cswarpSendMsgToArm(ctrlBase, true);
+  ok = rpl->header.rpl == dprplDiagFrame;
+  if(ok)
+    memcpy(diag, (void*)&rpl->diag, sizeof(*diag));
+  spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+  return ok;
+}
+EXPORT_SYMBOL(cswarpReadDiag);
@@ -0,0 +1,76 @@
+#ifndef CSWARPAMICOMM_H
+#define CSWARPAMICOMM_H
+
+#include <linux/build_bug.h>
+#include <linux/types.h>
+#include <linux/limits.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+
+#include <asm/cswarpdefs.h>
+#include <asm/cswarpamicommdata.h>
+
+/*
+ * There is a single command/reply frame in dpRAM, shared by all csWarp
+ * drivers (network, ATA, ...). cswarp_dpram_lock has to be held
+ * (spin_lock_irqsave) from writing the command until the reply is read.
+ */
+extern spinlock_t cswarp_dpram_lock;
+
+// the frame ends where the QSDMA registers start
+static_assert(sizeof(DprCmdFrame) <= WARP_OFFSET_QSDMA - WARP_OFFSET_DPRAM);
+static_assert(sizeof(DprRplFrame) <= WARP_OFFSET_QSDMA - WARP_OFFSET_DPRAM);
+
+WarpAmiCommStatus cswarpSendMsgToArm(void __iomem *ctrlBase, bool waitForReply);
+
+/*
+ * Probing a command older firmware may not know: it is taken, but never
+ * answered. Known commands are answered well within this time.
+ */
+#define CSWARP_PROBE_TIMEOUT_US 20000
+
+WarpAmiCommStatus cswarpSendMsgToArmTimeout(void __iomem *ctrlBase, bool waitForReply,
+                                            unsigned int timeoutUs);
+
+bool cswarpReadDiag(void __iomem *ctrlBase, DprRplDiagMsg *diag);
+
+/*
+ * The ARM reports measurements as IEEE754 floats. The kernel does not use
+ * the FPU, so convert the bits to an integer in thousandths.
+ */
+static inline int cswarpFloatToMilli(const float *f)
+{
+  u32 bits;
+  s64 val;
+  int exp;
+
+  memcpy(&bits, f, sizeof(bits));
+  exp = ((bits >> 23) & 0xff) - 127 - 23;
+  if(((bits >> 23) & 0xff) == 0)
+    return 0;
+  val = (s64)((bits & 0x7fffff) | 0x800000) * 1000;
+  if(exp >= 0)
+    val = exp > 8 ? S32_MAX : val << exp;
+  else
+    val = exp < -40 ? 0 : (val + (1LL << (-exp - 1))) >> -exp;
+  if(val > S32_MAX)
+    val = S32_MAX;
+  return (bits & 0x80000000) ? -(int)val : (int)val;
+}
+
+static inline volatile u32 __iomem *cswarpDpRegCR(void __iomem *ctrlBase)
+{
+	return (volatile u32*)((u32)ctrlBase | WARP_OFFSET_DPREG_CR);
+}
+
+static inline volatile DprCmdFrame __iomem *cswarpCmdFrame(void __iomem *ctrlBase)
+{
+	return (volatile DprCmdFrame*)((u32)ctrlBase | WARP_OFFSET_DPRAM);
+}
+
+static inline volatile DprRplFrame __iomem *cswarpRplFrame(void __iomem *ctrlBase)
+{
+	return (volatile DprRplFrame*)((u32)ctrlBase | WARP_OFFSET_DPRAM);
+}
+
+#endif // CSWARPAMICOMM_H
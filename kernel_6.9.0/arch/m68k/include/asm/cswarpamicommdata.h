@@ -29,17 +29,104 @@
 #define DPREG_CR_IF_ETHRX   (1UL << 9)  // ETH rx irq
 #define DPREG_CR_IF_ETHTX   (1UL << 10) // ETH tx irq
 #define DPREG_CR_IF_ETHST   (1UL << 11) // ETH state irq
+// ATA IRQ (68k)
+#define DPREG_CR_IE_ATA     (1UL << 12) // ATA INTRQ irq enable
+#define DPREG_CR_IF_ATA     (1UL << 13) // ATA INTRQ irq (latched by FPGA)
+#define DPREG_CR_IE_DISK    (1UL << 14) // tagged disk completion irq enable
+#define DPREG_CR_IF_DISK    (1UL << 15) // tagged disk completion irq
+#define DPREG_CR_IE_AUDIO   (1UL << 16) // audio period elapsed irq enable
+#define DPREG_CR_IF_AUDIO   (1UL << 17) // audio period elapsed irq
+#define DPREG_CR_IE_HID     (1UL << 18) // HID mouse report irq enable
+#define DPREG_CR_IF_HID     (1UL << 19) // HID mouse report irq
+#define DPREG_CR_IE_JPEG    (1UL << 20) // JPEG decode done irq enable
+#define DPREG_CR_IF_JPEG    (1UL << 21) // JPEG decode done irq
+#define DPREG_CR_IE_COMP    (1UL << 22) // compression batch done irq enable
+#define DPREG_CR_IF_COMP    (1UL << 23) // compression batch done irq
+#define DPREG_CR_IE_CRYPTO  (1UL << 24) // crypto batch done irq enable
+#define DPREG_CR_IF_CRYPTO  (1UL << 25) // crypto batch done irq
 
 // Volume masks
 #define AUDVOLMASK_MIX_AMIGA  0x01
 #define AUDVOLMASK_MIX_MP3    0x02
 #define AUDVOLMASK_MASTER     0x04
+#define AUDVOL_MAX            100     // volumes are in percent
+
+// Audio ring buffer streams (dpcmdAudioStreamOpen)
+#define AUD_STREAM_PCM        0       // S16 big endian PCM, mixed by the ARM
+#define AUD_STREAM_MP3        1       // MP3 decoded by the ARM
+#define AUD_STREAMS           2
+
+#define AUD_STATE_STOPPED     0
+#define AUD_STATE_RUNNING     1
+#define AUD_STATE_PAUSED      2
+#define AUD_STATE_DRAINED     3       // audcmdDrain: all data played
+
+// HID mouse report ring (dpcmdHIDMouseStart)
+#define HID_MOUSE_RING        32
 
 // Disk IO
 #define DISK_MAX_DPRAM_TRANSFER	7
 #define DISK_BLOCKSIZE 512
+// largest payload in a command/reply frame, anything bigger goes by DMA
+#define AMICOMM_MAX_DPRAM_TRANSFER (DISK_MAX_DPRAM_TRANSFER * DISK_BLOCKSIZE)
 #define DISK_NR_SD 0
 #define DISK_NR_USB 1
+// image files on the ARM filesystem, served as disks
+#define DISK_NR_IMAGE_FIRST 2
+#define DISK_NR_IMAGES 4
+// ARM RAM as disk (swap), sized by dpcmdDiskRamSetup
+#define DISK_NR_RAM 6
+// tagged disk commands (dpcmdDiskQueue)
+#define DISK_MAX_TAGS 32
+#define DISK_MAX_SG 32
+#define DISK_MAX_COMPLETIONS 32
+// DprCmdDiskQueue flags
+#define DISK_FLAG_FUA 0x01
+#define DISK_FLAG_DISCARD 0x02 // free the blocks, no data (sgCnt 0)
+// ARM block cache modes (dpcmdDiskCacheCtrl)
+#define DISK_CACHE_OFF 0
+#define DISK_CACHE_WRITETHROUGH 1
+#define DISK_CACHE_WRITEBACK 2
+
+// ARM filesystem access (warpfs)
+#define FS_DIRBATCH_BYTES AMICOMM_MAX_DPRAM_TRANSFER
+#define FS_MAX_SG 32
+#define FS_ATTR_RDONLY 0x01 // FAT attribute bits
+#define FS_ATTR_HIDDEN 0x02
+#define FS_ATTR_SYSTEM 0x04
+#define FS_ATTR_DIR    0x10
+
+// compression offload (dpcmdComp)
+#define COMP_MAX_DPRAM_TRANSFER AMICOMM_MAX_DPRAM_TRANSFER // else DMA or software
+#define COMP_ALGO_LZ4  0
+#define COMP_ALGO_ZSTD 1
+#define COMP_OP_COMPRESS   0
+#define COMP_OP_DECOMPRESS 1
+#define COMP_STATUS_OK     0
+#define COMP_STATUS_NOSPC  1 // output does not fit dstLen
+#define COMP_STATUS_BADDATA 2 // corrupt input (decompress)
+#define COMP_MAX_BATCH 16
+
+// cipher / hash offload (dpcmdCryptoBatch)
+#define CRYPTO_MAX_BATCH 16
+#define CRYPTO_MAX_KEY   64 // AES keys, HMAC keys up to the block size
+#define CRYPTO_ALGO_AES_CBC     0
+#define CRYPTO_ALGO_AES_CTR     1
+#define CRYPTO_ALGO_AES_GCM     2
+#define CRYPTO_ALGO_SHA1        3
+#define CRYPTO_ALGO_SHA256      4
+#define CRYPTO_ALGO_HMAC_SHA1   5
+#define CRYPTO_ALGO_HMAC_SHA256 6
+#define CRYPTO_FLAG_DECRYPT     0x01
+#define CRYPTO_FLAG_HASH_UPDATE 0x02 // hash src into state
+#define CRYPTO_FLAG_HASH_FINAL  0x04 // pad and write digest to dst
+#define CRYPTO_STATUS_OK     0
+#define CRYPTO_STATUS_BADTAG 1 // GCM decrypt: authentication failed
+#define CRYPTO_STATUS_ERR    2 // job not done, buffers untouched
+
+// JPEG decoding (dpcmdJpegDecode)
+#define JPEG_FLAG_DST_VRAM  0x01 // dstAddr is an offset into VRAM
+#define JPEG_FLAG_MJPEG     0x02 // MJPEG frame, use the standard Huffman tables if it has none
 
 // ETH/WIFI
 #define ETH_MTU_AND_HDR_SIZE    (1500 + 14)
@@ -89,6 +176,39 @@ typedef enum {
   dpcmdEthReceive,
   dpcmdEthGetMACAddr,
   dpcmdGetMouseWheelData,
+  dpcmdEthSetLoopback,
+  dpcmdEthCaptureStart,
+  dpcmdEthCaptureStop,
+  dpcmdEthFlowAdd,
+  dpcmdEthFlowDel,
+  dpcmdEthFlowStats,
+  dpcmdDiskQueue,
+  dpcmdDiskGetCompletions,
+  dpcmdDiskCacheCtrl,
+  dpcmdDiskCacheFlush,
+  dpcmdDiskCacheStats,
+  dpcmdDiskImageOpen,
+  dpcmdDiskImageClose,
+  dpcmdFsStat,
+  dpcmdFsReadDirBatch,
+  dpcmdFsRead,
+  dpcmdDiskRamSetup,
+  dpcmdDiskDiscard,
+  dpcmdDiskRamStats,
+  dpcmdComp,
+  dpcmdCompBatch,
+  dpcmdCryptoBatch,
+  dpcmdJpegDecode,
+  dpcmdJpegGetResult,
+  dpcmdAudioStreamOpen,
+  dpcmdAudioStreamCtrl,
+  dpcmdAudioStreamAppl,
+  dpcmdHIDMouseStart,
+  dpcmdHIDMouseStop,
+  dpcmdGetIdeClock,
+  dpcmdDiskAbort,
+  dpcmdJpegAbort,
+  dpcmdDiskPoll,
 } DprCmd;
 
 // Audio command types
@@ -97,6 +217,8 @@ typedef enum {
   audcmdPlay,
   audcmdPause,
   audcmdSetVolumes,
+  audcmdDrain,            // streams: play up to applBytes, then stop
+  audcmdGetVolumes,       // dpcmdAudioTest, reply dprplAudioVolumes
 } AudioCmd;
 
   // WiFi states
@@ -224,6 +346,255 @@ typedef struct {
   uint8_t diskNr;
 } DprCmdDiskWriteBlocks;
 
+// Tagged disk request: data is always moved by ARM DMA, following a
+// scatter list of DiskSgEntry in DDR. ARM acknowledges at once, may
+// merge and reorder queued requests (never one with an earlier request
+// on overlapping blocks, discards included) and signals DPREG_CR_IF_DISK
+// when completions can be fetched with dpcmdDiskGetCompletions.
+typedef struct {
+  uint32_t dmaDdrAddr;
+  uint32_t len;           // bytes, multiple of DISK_BLOCKSIZE
+} DiskSgEntry;
+
+typedef struct {
+  DprCmdHeader header;
+  uint8_t diskNr;
+  uint8_t tag;            // 0 .. DISK_MAX_TAGS-1, unique per disk
+  uint8_t write;
+  uint8_t flags;
+  uint32_t blockAddr;
+  uint32_t blocksCnt;
+  uint32_t sgDdrAddr;     // DiskSgEntry table
+  uint16_t sgCnt;
+} DprCmdDiskQueue;
+
+// drop a tagged request that did not complete in time (reply
+// dprplDiskStatus). success: the ARM stopped it, will not touch its
+// buffers anymore and reports no completion for it. Fails if the
+// request already completed, its completion is fetched as usual.
+typedef struct {
+  DprCmdHeader header;
+  uint8_t diskNr;
+  uint8_t tag;
+} DprCmdDiskAbort;
+
+// ARM block cache (LRU, sequential readahead, optional write-back)
+typedef struct {
+  DprCmdHeader header;
+  uint8_t diskNr;
+  uint8_t mode;           // DISK_CACHE_xxx
+  uint16_t readaheadKB;   // max. readahead for detected streams, 0 = none
+} DprCmdDiskCacheCtrl;
+
+// dpcmdDiskCacheFlush, dpcmdDiskImageOpen and dpcmdDiskRamSetup can
+// take seconds (cache write-back, FAT scan, clearing RAM). The ARM
+// answers them at once, with their reply if already done, otherwise
+// with dprplDiskBusy, and carries them out in the background.
+// dpcmdDiskPoll (DISK_NR_RAM for the RAM setup) then answers
+// dprplDiskBusy until the reply of the command is ready. A long command
+// for a disk still busy with one is refused (dprplDiskStatus, success 0).
+
+// cache flush / statistics / image close / poll
+typedef struct {
+  DprCmdHeader header;
+  uint8_t diskNr;
+} DprCmdDiskNr;
+
+// open image file (path as for dpcmdOpenDir) as disk
+// DISK_NR_IMAGE_FIRST .. +DISK_NR_IMAGES-1
+typedef struct {
+  DprCmdHeader header;
+  uint8_t diskNr;
+  uint8_t readOnly;
+  char path[AMICOMM_PATH_LEN];
+} DprCmdDiskImageOpen;
+
+// reserve ARM RAM for DISK_NR_RAM, ARM grants what it can spare
+// (reply dprplDiskRamInfo), 0 releases it
+typedef struct {
+  DprCmdHeader header;
+  uint32_t sizeKB;
+} DprCmdDiskRamSetup;
+
+// blocks no longer in use (ARM RAM disk frees the backing pages)
+typedef struct {
+  DprCmdHeader header;
+  uint8_t diskNr;
+  uint32_t blockAddr;
+  uint32_t blocksCnt;
+} DprCmdDiskDiscard;
+
+// compress / decompress one buffer, either by ARM DMA from/to DDR or
+// through data (then srcLen and dstLen <= COMP_MAX_DPRAM_TRANSFER)
+typedef struct {
+  DprCmdHeader header;
+  uint8_t algo;           // COMP_ALGO_xxx
+  uint8_t op;             // COMP_OP_xxx
+  uint8_t dmaEnable;
+  uint32_t srcLen;
+  uint32_t dstLen;        // room at destination
+  uint32_t srcDdrAddr;
+  uint32_t dstDdrAddr;
+  uint8_t data[COMP_MAX_DPRAM_TRANSFER];
+} DprCmdComp;
+
+// batch of (de)compress jobs, table of CompBatchEntry in DDR. Buffers
+// are always moved by ARM DMA, ARM fills in status and dstLen. ARM
+// acknowledges at once and raises DPREG_CR_IF_COMP when all are done,
+// an empty batch is only acknowledged.
+typedef struct {
+  uint8_t algo;           // COMP_ALGO_xxx
+  uint8_t op;             // COMP_OP_xxx
+  uint8_t status;         // COMP_STATUS_xxx, set by ARM
+  uint8_t reserved;
+  uint32_t srcDdrAddr;
+  uint32_t srcLen;
+  uint32_t dstDdrAddr;
+  uint32_t dstLen;        // room, on return bytes produced
+} CompBatchEntry;
+
+typedef struct {
+  DprCmdHeader header;
+  uint32_t tableDdrAddr;
+  uint16_t cnt;           // <= COMP_MAX_BATCH
+} DprCmdCompBatch;
+
+// running SHA-1/SHA-256 (HMAC: inner hash) state, kept by the Amiga
+// between requests. initialized = 0 lets ARM start over (HMAC: from key).
+// Same contents as the generic sha1_state/sha256_state, the HMAC count
+// includes the ipad block.
+typedef struct {
+  uint8_t initialized;
+  uint8_t bufLen;         // bytes in buf
+  uint32_t h[8];
+  uint32_t countHi;       // bytes hashed so far
+  uint32_t countLo;
+  uint8_t buf[64];        // partial block
+} CryptoHashState;
+
+// batch of cipher / hash jobs, table of CryptoBatchEntry in DDR, all
+// buffers moved by ARM DMA. CBC/CTR return the next IV at ivDdrAddr.
+// ARM acknowledges at once and raises DPREG_CR_IF_CRYPTO when all are
+// done, an empty batch is only acknowledged.
+// GCM: src holds assocLen bytes of associated data, then len bytes of
+// data and (decrypt) the tag, dst the same with the tag after encrypt.
+typedef struct {
+  uint8_t algo;           // CRYPTO_ALGO_xxx
+  uint8_t flags;          // CRYPTO_FLAG_xxx
+  uint8_t status;         // CRYPTO_STATUS_xxx, set by ARM
+  uint8_t keyLen;
+  uint32_t keyDdrAddr;
+  uint32_t ivDdrAddr;     // CBC/CTR: 16 bytes, GCM: 12 byte nonce
+  uint32_t stateDdrAddr;  // hashes: CryptoHashState
+  uint32_t srcDdrAddr;
+  uint32_t dstDdrAddr;    // hashes: digest
+  uint32_t len;
+  uint16_t assocLen;
+  uint16_t tagLen;
+} CryptoBatchEntry;
+
+typedef struct {
+  DprCmdHeader header;
+  uint32_t tableDdrAddr;
+  uint16_t cnt;           // <= CRYPTO_MAX_BATCH
+} DprCmdCryptoBatch;
+
+// decode a JPEG from DDR by ARM DMA, one job at a time. The image is
+// scaled down to fit dstWidth x dstHeight (aspect kept, centered on
+// black). ARM acknowledges at once (dprplJpegStatus) and raises
+// DPREG_CR_IF_JPEG when done, the result is read with dpcmdJpegGetResult.
+typedef struct {
+  DprCmdHeader header;
+  uint32_t jobId;
+  uint32_t srcDdrAddr;
+  uint32_t srcLen;
+  uint32_t dstAddr;       // DDR address or VRAM offset (JPEG_FLAG_DST_VRAM)
+  uint32_t dstStride;     // bytes per line
+  uint16_t dstWidth;
+  uint16_t dstHeight;
+  uint8_t bitsPerPixel;   // 16 (RGB565) or 32 (XRGB8888), big endian
+  uint8_t flags;          // JPEG_FLAG_xxx
+} DprCmdJpegDecode;
+
+// stop a job that did not finish in time (reply dprplJpegStatus).
+// success: the ARM stopped it, will not touch its buffers anymore and
+// raises no DPREG_CR_IF_JPEG for it. Fails if the job already ended,
+// its result is read as usual.
+typedef struct {
+  DprCmdHeader header;
+  uint32_t jobId;
+} DprCmdJpegAbort;
+
+// open an audio stream on a ring buffer in DDR. The ARM consumes the ring
+// by DMA, keeps the AudioStreamStatus at statusDdrAddr up to date and
+// raises DPREG_CR_IF_AUDIO every periodSize bytes consumed.
+typedef struct {
+  DprCmdHeader header;
+  uint8_t stream;         // AUD_STREAM_xxx
+  uint8_t channels;       // PCM only
+  uint32_t sampleRate;    // PCM only, MP3 rate comes from the stream
+  uint32_t ringDdrAddr;
+  uint32_t ringSize;
+  uint32_t periodSize;
+  uint32_t statusDdrAddr;
+} DprCmdAudioStreamOpen;
+
+typedef struct {
+  DprCmdHeader header;
+  uint8_t stream;
+  uint8_t audioCmd;       // audcmdPlay, audcmdPause, audcmdStop, audcmdDrain
+} DprCmdAudioStreamCtrl;  // audcmdStop also rewinds the ring and counters
+
+// compressed streams: ring data is valid up to applBytes (total written),
+// PCM rings are played continuously
+typedef struct {
+  DprCmdHeader header;
+  uint8_t stream;
+  uint32_t applBytes;
+} DprCmdAudioStreamAppl;
+
+// forward USB HID mouse reports to Linux instead of the Amiga mouse port.
+// The ARM puts them into the HidMouseRing at ringDdrAddr and raises
+// DPREG_CR_IF_HID; when the ring is full it adds to the newest report.
+typedef struct {
+  DprCmdHeader header;
+  uint32_t ringDdrAddr;
+} DprCmdHIDMouseStart;
+
+// per stream status, written by the ARM into DDR
+typedef struct {
+  uint32_t hwPtr;         // ring offset of the next byte to consume
+  uint32_t consumedBytes; // total consumed from the ring
+  uint32_t framesPlayed;  // total frames sent to the DAC
+  uint32_t sampleRate;    // MP3: rate of the decoded stream
+  uint8_t state;          // AUD_STATE_xxx
+  uint8_t pad;
+} AudioStreamStatus;
+
+// stat a file or directory
+typedef struct {
+  DprCmdHeader header;
+  char path[AMICOMM_PATH_LEN];
+} DprCmdFsStat;
+
+// read as many directory entries as fit into one reply, starting at
+// cookie (0 = first entry, else nextCookie of the previous reply)
+typedef struct {
+  DprCmdHeader header;
+  uint32_t cookie;
+  char path[AMICOMM_PATH_LEN];
+} DprCmdFsReadDirBatch;
+
+// read file data by ARM DMA into a DiskSgEntry scatter list
+typedef struct {
+  DprCmdHeader header;
+  uint32_t offset;
+  uint32_t len;
+  uint32_t sgDdrAddr;
+  uint16_t sgCnt;
+  char path[AMICOMM_PATH_LEN];
+} DprCmdFsRead;
+
 // Eth send packet
 typedef struct {
   DprCmdHeader header;
@@ -231,6 +602,49 @@ typedef struct {
   uint8_t packet[ETH_MTU_AND_HDR_SIZE];
 } DprCmdEthSend;
 
+// Eth loopback mode (tx frames returned on rx by ARM)
+typedef struct {
+  DprCmdHeader header;
+  uint8_t enable;
+} DprCmdEthLoopback;
+
+// Eth capture start (ARM filters frames into a ring in DDR3,
+// new ring data is signalled with DPREG_CR_IF_ETHST)
+typedef struct {
+  DprCmdHeader header;
+  uint32_t ringDdrAddr;   // ring header + data area
+  uint32_t ringSize;      // data area size
+  uint16_t etherType;     // 0 - any
+  uint8_t ipProto;        // 0 - any
+  uint16_t port;          // 0 - any
+  uint16_t snapLen;       // 0 - full frame
+} DprCmdEthCapture;
+
+// Eth flow offload entry (established IPv4 TCP/UDP flow, optional NAT)
+// exact match on all fields, addresses and ports in host byte order.
+// TCP segments with FIN or RST are always passed to the 68k.
+typedef struct {
+  DprCmdHeader header;
+  uint32_t flowId;
+  uint8_t ipProto;
+  uint32_t srcAddr;
+  uint32_t dstAddr;
+  uint16_t srcPort;
+  uint16_t dstPort;
+  uint32_t natSrcAddr;    // rewritten values (equal to the
+  uint32_t natDstAddr;    // matched ones when no NAT applies)
+  uint16_t natSrcPort;
+  uint16_t natDstPort;
+  uint8_t ethDst[ETH_MAC_SIZE];
+  uint8_t ethSrc[ETH_MAC_SIZE];
+} DprCmdEthFlowAdd;
+
+// Eth flow offload delete / stats request
+typedef struct {
+  DprCmdHeader header;
+  uint32_t flowId;
+} DprCmdEthFlowId;
+
 // Command communication frame
 typedef union {
   DprCmdHeader  header;
@@ -250,6 +664,29 @@ typedef union {
   DprCmdDiskReadBlocks diskRead;
   DprCmdDiskWriteBlocks diskWrite;
   DprCmdEthSend ethSend;
+  DprCmdEthLoopback ethLoopback;
+  DprCmdEthCapture ethCapture;
+  DprCmdEthFlowAdd ethFlowAdd;
+  DprCmdEthFlowId ethFlowId;
+  DprCmdDiskQueue diskQueue;
+  DprCmdDiskAbort diskAbort;
+  DprCmdDiskCacheCtrl diskCacheCtrl;
+  DprCmdDiskNr diskNr;
+  DprCmdDiskImageOpen diskImageOpen;
+  DprCmdFsStat fsStat;
+  DprCmdFsReadDirBatch fsReadDirBatch;
+  DprCmdFsRead fsRead;
+  DprCmdDiskRamSetup diskRamSetup;
+  DprCmdDiskDiscard diskDiscard;
+  DprCmdComp comp;
+  DprCmdCompBatch compBatch;
+  DprCmdCryptoBatch cryptoBatch;
+  DprCmdJpegDecode jpegDecode;
+  DprCmdJpegAbort jpegAbort;
+  DprCmdAudioStreamOpen audioStreamOpen;
+  DprCmdAudioStreamCtrl audioStreamCtrl;
+  DprCmdAudioStreamAppl audioStreamAppl;
+  DprCmdHIDMouseStart hidMouseStart;
 } DprCmdFrame;
 
 // -------------------------------------------------------------
@@ -271,6 +708,28 @@ typedef enum {
   dprplEthReceive,
   dprplEthMACAddr,
   dprplMouseWheelData,
+  dprplEthFlowStatus,
+  dprplEthFlowStats,
+  dprplDiskCompletions,
+  dprplDiskStatus,
+  dprplDiskCacheStats,
+  dprplDiskImageInfo,
+  dprplFsStat,
+  dprplFsDirBatch,
+  dprplFsRead,
+  dprplDiskRamInfo,
+  dprplDiskRamStats,
+  dprplComp,
+  dprplCompBatch,
+  dprplCryptoBatch,
+  dprplJpegStatus,
+  dprplJpegResult,
+  dprplAudioStatus,
+  dprplHIDMouseStatus,
+  dprplEthLoopbackStatus,
+  dprplIdeClock,
+  dprplAudioVolumes,
+  dprplDiskBusy,          // DprRplHeader only
 } DprRpl;
 
 // common reply header
@@ -279,7 +738,7 @@ typedef struct {
 } DprRplHeader;
 
 typedef enum {USBDevNone = 0, USBDevHID, USBDevMassStorage, USBDevOther} USBDevStatus;
-const char *USBDevStatusStr[] = {"No Device", "HID Device", "Mass Storage", "Other Device"};
+static const char * const USBDevStatusStr[] __maybe_unused = {"No Device", "HID Device", "Mass Storage", "Other Device"};
 
 // Diagnostic data frame
 typedef struct {
@@ -378,6 +837,12 @@ typedef struct {
   uint32_t halVersion;
 } DprRplARMInfo;
 
+// period of the FPGA clock the dpcmdSetIdeSpeed timings are counted in
+typedef struct {
+  DprRplHeader header;
+  uint32_t clkPeriodPs;
+} DprRplIdeClock;
+
 // Eth receive packet
 typedef struct {
   DprRplHeader header;
@@ -395,6 +860,181 @@ typedef struct {
   int8_t mouseWheelCnt;
 } DprRplMouseWheelData;
 
+// Eth flow offload add/del status
+typedef struct {
+  DprRplHeader header;
+  uint32_t success;
+} DprRplEthFlowStatus;
+
+// Eth flow offload counters (cumulative)
+typedef struct {
+  DprRplHeader header;
+  uint32_t packets;
+  uint32_t bytes;
+  uint32_t idleMs;        // time since last matching packet
+} DprRplEthFlowStats;
+
+// Eth loopback mode status
+typedef struct {
+  DprRplHeader header;
+  uint32_t success;
+} DprRplEthLoopbackStatus;
+
+// tagged disk completions
+typedef struct {
+  uint8_t diskNr;
+  uint8_t tag;
+  uint8_t status;         // 0 = ok
+  uint8_t reserved;
+} DiskCompletion;
+
+typedef struct {
+  DprRplHeader header;
+  uint8_t cnt;
+  uint8_t more;           // further completions pending
+  DiskCompletion cpl[DISK_MAX_COMPLETIONS];
+} DprRplDiskCompletions;
+
+// generic disk command status
+typedef struct {
+  DprRplHeader header;
+  uint8_t success;
+} DprRplDiskStatus;
+
+typedef struct {
+  DprRplHeader header;
+  uint32_t readHits;      // blocks
+  uint32_t readMisses;
+  uint32_t readaheadBlocks;
+  uint32_t writeBlocks;
+  uint32_t dirtyBlocks;
+  uint32_t flushes;
+} DprRplDiskCacheStats;
+
+typedef struct {
+  DprRplHeader header;
+  uint8_t success;
+  uint8_t readOnly;       // set if file or volume is write protected
+  uint32_t blockNbr;      // DISK_BLOCKSIZE blocks
+} DprRplDiskImageInfo;
+
+typedef struct {
+  DprRplHeader header;
+  uint8_t success;
+  uint32_t blockNbr;      // granted DISK_BLOCKSIZE blocks
+  uint32_t armFreeKB;     // ARM RAM left after the reservation
+} DprRplDiskRamInfo;
+
+typedef struct {
+  DprRplHeader header;
+  uint8_t success;        // 0: not a RAM disk / not set up
+  uint32_t usedBlocks;    // blocks holding data (written, not discarded)
+  uint32_t readBlocks;
+  uint32_t writeBlocks;
+  uint32_t discardBlocks;
+  uint32_t armFreeKB;
+} DprRplDiskRamStats;
+
+typedef struct {
+  DprRplHeader header;
+  uint8_t status;         // COMP_STATUS_xxx
+  uint32_t dstLen;        // bytes produced
+  uint8_t data[COMP_MAX_DPRAM_TRANSFER]; // without DMA
+} DprRplComp;
+
+typedef struct {
+  DprRplHeader header;
+  uint8_t success;        // batch accepted, see entry status after IF_COMP
+} DprRplCompBatch;
+
+typedef struct {
+  DprRplHeader header;
+  uint8_t success;        // batch accepted, see entry status after IF_CRYPTO
+} DprRplCryptoBatch;
+
+typedef struct {
+  DprRplHeader header;
+  uint8_t success;        // job accepted
+} DprRplJpegStatus;
+
+// state of the last job, kept until the next dpcmdJpegDecode
+typedef struct {
+  DprRplHeader header;
+  uint8_t busy;           // job still running
+  uint8_t success;
+  uint32_t jobId;
+  uint16_t imgWidth;      // decoded image, before scaling
+  uint16_t imgHeight;
+} DprRplJpegResult;
+
+typedef struct {
+  DprRplHeader header;
+  uint8_t success;
+} DprRplAudioStatus;
+
+// volumes in percent, as set by the Amiga side or the last audcmdSetVolumes
+typedef struct {
+  DprRplHeader header;
+  uint8_t mixAmiga;
+  uint8_t mixMp3;
+  uint8_t masterVolume;
+} DprRplAudioVolumes;
+
+typedef struct {
+  DprRplHeader header;
+  uint8_t success;
+} DprRplHIDMouseStatus;
+
+typedef struct {
+  int16_t dx;
+  int16_t dy;
+  int8_t wheel;
+  int8_t hwheel;
+  uint8_t buttons;        // bit 0 left, 1 right, 2 middle, 3 side, 4 extra
+  uint8_t pad;
+} HidMouseReport;
+
+// in DDR, written by the ARM except readIdx
+typedef struct {
+  uint16_t writeIdx;      // next report the ARM writes, 0..HID_MOUSE_RING-1
+  uint16_t readIdx;       // next report the 68k reads
+  HidMouseReport report[HID_MOUSE_RING];
+} HidMouseRing;
+
+typedef struct {
+  DprRplHeader header;
+  uint8_t success;
+  uint8_t attr;           // FS_ATTR_xxx
+  uint32_t size;
+  uint16_t date;          // FAT date/time
+  uint16_t time;
+} DprRplFsStat;
+
+// packed directory entry in DprRplFsDirBatch.data, 2-byte aligned
+typedef struct {
+  uint32_t size;
+  uint16_t date;
+  uint16_t time;
+  uint8_t attr;
+  uint8_t nameLen;        // without terminating 0
+  char name[];            // 0 terminated, padded to even length
+} FsDirEnt;
+
+typedef struct {
+  DprRplHeader header;
+  uint8_t success;
+  uint8_t eof;            // no entries after this batch
+  uint16_t cnt;
+  uint32_t nextCookie;
+  uint8_t data[FS_DIRBATCH_BYTES];
+} DprRplFsDirBatch;
+
+typedef struct {
+  DprRplHeader header;
+  uint8_t success;
+  uint32_t bytes;         // < len at end of file
+} DprRplFsRead;
+
 // Reply communication frame
 typedef union {
   DprRplHeader  header;
@@ -407,9 +1047,30 @@ typedef union {
   DprRplHIDMouseRes hidMouseRes;
   DprRplUSBGetInfo usbInfo;
   DprRplARMInfo armInfo;
+  DprRplIdeClock ideClock;
   DprRplEthRecv ethRecv;
   DprRplEthMACAddr ethMAC;
   DprRplMouseWheelData mouseWheel;
+  DprRplEthFlowStatus ethFlowStatus;
+  DprRplEthLoopbackStatus ethLoopbackStatus;
+  DprRplEthFlowStats ethFlowStats;
+  DprRplDiskCompletions diskCompletions;
+  DprRplDiskStatus diskStatus;
+  DprRplDiskCacheStats diskCacheStats;
+  DprRplDiskImageInfo diskImageInfo;
+  DprRplFsStat fsStat;
+  DprRplFsDirBatch fsDirBatch;
+  DprRplFsRead fsRead;
+  DprRplDiskRamInfo diskRamInfo;
+  DprRplDiskRamStats diskRamStats;
+  DprRplComp comp;
+  DprRplCompBatch compBatch;
+  DprRplCryptoBatch cryptoBatch;
+  DprRplJpegStatus jpegStatus;
+  DprRplJpegResult jpegResult;
+  DprRplAudioStatus audioStatus;
+  DprRplAudioVolumes audioVolumes;
+  DprRplHIDMouseStatus hidMouseStatus;
 } DprRplFrame;
 
 #pragma pack()
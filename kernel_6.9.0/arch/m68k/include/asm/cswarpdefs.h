@@ -134,6 +134,14 @@ typedef struct {
   uint32_t    trNumb;
 } WarpQSDMARegs;
 
+// QSDMA csr bits (ATA data port transfers)
+#define QSDMA_CSR_START   (1UL << 0)  // start / running
+#define QSDMA_CSR_TOMEM   (1UL << 1)  // direction: device -> memory
+#define QSDMA_CSR_ATA     (1UL << 2)  // device is the ATA data port (DMARQ/DMACK)
+#define QSDMA_CSR_BUSY    (1UL << 8)  // transfer in progress
+#define QSDMA_CSR_DONE    (1UL << 9)  // trNumb reached
+#define QSDMA_CSR_ERR     (1UL << 10) // bus error / transfer aborted
+
 typedef struct {
   uint32_t    res1;   // reserved, read 0x01234567
   uint32_t    cctrl;  // cache ctrl
@@ -14,12 +14,16 @@
 #include <linux/ata.h>
 #include <linux/blkdev.h>
 #include <linux/delay.h>
+#include <linux/dma-mapping.h>
 #include <linux/interrupt.h>
 #include <linux/kernel.h>
+#include <linux/ktime.h>
 #include <linux/libata.h>
 #include <linux/mm.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/platform_device.h>
+#include <linux/slab.h>
 #include <linux/zorro.h>
 #include <scsi/scsi_cmnd.h>
 #include <scsi/scsi_host.h>
@@ -28,27 +32,195 @@
 #include <asm/amigaints.h>
 #include <asm/amigayle.h>
 #include <asm/setup.h>
+#include <asm/cswarpamicomm.h>
 
 #define DRV_NAME "pata_cswarp"
-#define DRV_VERSION "0.1.0"
+#define DRV_VERSION "0.2.0"
 
-#define WARP_OFFSET_ATA         0x6000
 #define REV16(x) ((uint16_t)((x << 8) | (x >> 8)))
 
+/*
+ * Period of the FPGA clock the IDE strobe timings are counted in (ps).
+ * The ARM reports it (dpcmdGetIdeClock). Older firmware does not know
+ * the command and leaves it unanswered, after CSWARP_PROBE_TIMEOUT_US
+ * 100 MHz is assumed, an assumption only, not a value read from the
+ * board: the timings stay within spec for any slower clock.
+ */
+#define WARP_ATA_CLK_PS_DEFAULT	10000
+
+static unsigned int warp_ata_clk_ps = WARP_ATA_CLK_PS_DEFAULT;
+
+static bool pio_iordy;
+module_param(pio_iordy, bool, 0444);
+MODULE_PARM_DESC(pio_iordy, "FPGA honours IORDY, allow PIO3/4 on all drives (default: 0)");
+
+static bool polling;
+module_param(polling, bool, 0444);
+MODULE_PARM_DESC(polling, "Poll drive status instead of using the ATA interrupt (default: 0)");
+
+static bool dma;
+module_param(dma, bool, 0444);
+MODULE_PARM_DESC(dma, "Use QSDMA engine for multiword DMA (default: 0)");
+
+static char *timings;
+module_param(timings, charp, 0444);
+MODULE_PARM_DESC(timings, "Strobe timings \"ior_as,ior_ng,iow_as,iow_ng,ack_as[,mode]\" "
+		 "overriding the defaults of that mode, e.g. a saved ide_tune result");
+
+struct pata_cswarp_port {
+	void __iomem *data32;			/* 32-bit data window */
+	volatile WarpQSDMARegs __iomem *qsdma;	/* FPGA DMA engine */
+
+	/*
+	 * strobe timing override, set by module param, sysfs or tuner.
+	 * It is only valid for the transfer mode it was made for, after a
+	 * downgrade the mode's own timings are used again.
+	 */
+	DprCmdIdeSpeed override;
+	bool override_valid;
+	u8 override_mode;			/* 0: the next mode set */
+
+	/* requests from sysfs, carried out by the error handler */
+	struct mutex sysfs_mutex;
+	bool apply_pending;
+	bool tune_pending;
+	u32 tune_lba;
+	int tune_status;
+	char *tune_report;
+};
+
 static const struct scsi_host_template pata_cswarp_sht = {
 	ATA_PIO_SHT(DRV_NAME),
 };
 
-/* FIXME: is this needed? */
-static unsigned int pata_cswarp_data_xfer(struct ata_queued_cmd *qc,
-					 unsigned char *buf,
-					 unsigned int buflen, int rw)
+/* QSDMA moves one contiguous memory block per command */
+static const struct scsi_host_template pata_cswarp_dma_sht = {
+	ATA_BASE_SHT(DRV_NAME),
+	.sg_tablesize		= 1,
+	.dma_boundary		= ATA_DMA_BOUNDARY,
+};
+
+/*
+ * 32-bit data window: the FPGA turns every longword access into two
+ * 16-bit IDE data cycles. The window is mirrored over 32 bytes, so a
+ * single movem.l moves 8 longwords.
+ */
+#define WARP_ATA_DATA32		0x0800
+
+enum {
+	CSWARP_XFER_16,		/* raw_insw/raw_outsw on the data register */
+	CSWARP_XFER_32,		/* movem.l through the 32-bit data window */
+	CSWARP_XFER_32_MODEL,	/* 32-bit path, window emulated with 16-bit cycles */
+};
+
+static int data_xfer = CSWARP_XFER_16;
+module_param(data_xfer, int, 0444);
+MODULE_PARM_DESC(data_xfer, "PIO data transfer: 0=16-bit, 1=32-bit window (movem), "
+		 "2=32-bit window model for FPGAs without it (default: 0)");
+
+/* 512 byte blocks, 64 bytes (two movem.l bursts) per loop */
+static void pata_cswarp_read32(void __iomem *port, void *buf, unsigned int blocks)
+{
+	register void __iomem *a0 asm("a0") = port;
+	register void *a1 asm("a1") = buf;
+	register unsigned int d0 asm("d0") = blocks * (ATA_SECT_SIZE / 64);
+
+	asm volatile (
+		"1:	movem.l	(%0),%%d1-%%d7/%%a2\n"
+		"	movem.l	%%d1-%%d7/%%a2,(%1)\n"
+		"	movem.l	(%0),%%d1-%%d7/%%a2\n"
+		"	movem.l	%%d1-%%d7/%%a2,32(%1)\n"
+		"	lea	64(%1),%1\n"
+		"	subq.l	#1,%2\n"
+		"	jne	1b\n"
+		: "+a" (a0), "+a" (a1), "+d" (d0)
+		:
+		: "d1", "d2", "d3", "d4", "d5", "d6", "d7", "a2", "cc", "memory");
+}
+
+static void pata_cswarp_write32(void __iomem *port, const void *buf, unsigned int blocks)
+{
+	register void __iomem *a0 asm("a0") = port;
+	register const void *a1 asm("a1") = buf;
+	register unsigned int d0 asm("d0") = blocks * (ATA_SECT_SIZE / 64);
+
+	asm volatile (
+		"1:	movem.l	(%1)+,%%d1-%%d7/%%a2\n"
+		"	movem.l	%%d1-%%d7/%%a2,(%0)\n"
+		"	movem.l	(%1)+,%%d1-%%d7/%%a2\n"
+		"	movem.l	%%d1-%%d7/%%a2,(%0)\n"
+		"	subq.l	#1,%2\n"
+		"	jne	1b\n"
+		: "+a" (a0), "+a" (a1), "+d" (d0)
+		:
+		: "d1", "d2", "d3", "d4", "d5", "d6", "d7", "a2", "cc", "memory");
+}
+
+/*
+ * Stand-in for the FPGA 32-bit window: longwords are assembled from
+ * two data register cycles exactly like the FPGA does, which lets the
+ * 32-bit path (buffer handling, word order) be tested on any firmware.
+ */
+static void pata_cswarp_model_read32(void __iomem *data_addr, void *buf,
+				     unsigned int blocks)
+{
+	u32 *p = buf;
+	unsigned int longs = blocks * (ATA_SECT_SIZE / 4);
+
+	while (longs--) {
+		u32 hi = raw_inw((u16 *)data_addr);
+		u32 lo = raw_inw((u16 *)data_addr);
+
+		*p++ = (hi << 16) | lo;
+	}
+}
+
+static void pata_cswarp_model_write32(void __iomem *data_addr, const void *buf,
+				      unsigned int blocks)
+{
+	const u32 *p = buf;
+	unsigned int longs = blocks * (ATA_SECT_SIZE / 4);
+
+	while (longs--) {
+		u32 v = *p++;
+
+		raw_outw(v >> 16, (u16 *)data_addr);
+		raw_outw(v & 0xffff, (u16 *)data_addr);
+	}
+}
+
+/**
+ * @brief move PIO data between drive and buffer
+ * @return number of bytes transferred (rounded up to words)
+ */
+static unsigned int pata_cswarp_xfer(struct ata_port *ap, unsigned char *buf,
+				     unsigned int buflen, int rw)
 {
-	struct ata_device *dev = qc->dev;
-	struct ata_port *ap = dev->link->ap;
 	void __iomem *data_addr = ap->ioaddr.data_addr;
 	unsigned int words = buflen >> 1;
 
+	/* whole sectors from a longword aligned buffer take the 32-bit path */
+	if (data_xfer != CSWARP_XFER_16 && buflen &&
+	    (buflen % ATA_SECT_SIZE) == 0 && IS_ALIGNED((ulong)buf, 4)) {
+		unsigned int blocks = buflen / ATA_SECT_SIZE;
+
+		if (data_xfer == CSWARP_XFER_32) {
+			struct pata_cswarp_port *pp = ap->private_data;
+			void __iomem *data32 = pp->data32;
+
+			if (rw == READ)
+				pata_cswarp_read32(data32, buf, blocks);
+			else
+				pata_cswarp_write32(data32, buf, blocks);
+		} else {
+			if (rw == READ)
+				pata_cswarp_model_read32(data_addr, buf, blocks);
+			else
+				pata_cswarp_model_write32(data_addr, buf, blocks);
+		}
+		return buflen;
+	}
+
 	/* Transfer multiple of 2 bytes */
 	if (rw == READ)
 		raw_insw((u16 *)data_addr, (u16 *)buf, words);
@@ -75,30 +247,787 @@ static unsigned int pata_cswarp_data_xfer(struct ata_queued_cmd *qc,
 	return words << 1;
 }
 
+static unsigned int pata_cswarp_data_xfer(struct ata_queued_cmd *qc,
+					 unsigned char *buf,
+					 unsigned int buflen, int rw)
+{
+	return pata_cswarp_xfer(qc->dev->link->ap, buf, buflen, rw);
+}
+
+/**
+ * @brief send IDE strobe timings to ARM (it programs the FPGA)
+ */
+static void pata_cswarp_send_timings(struct ata_port *ap,
+				     const DprCmdIdeSpeed *speed)
+{
+	void __iomem *ctrlBase = ap->host->private_data;
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(ctrlBase);
+	ulong irqFlags;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdSetIdeSpeed;
+	cmd->ideSpeed.ataIOR_as = speed->ataIOR_as;
+	cmd->ideSpeed.ataIOR_ng = speed->ataIOR_ng;
+	cmd->ideSpeed.ataIOW_as = speed->ataIOW_as;
+	cmd->ideSpeed.ataIOW_ng = speed->ataIOW_ng;
+	cmd->ideSpeed.ataACK_as = speed->ataACK_as;
+	cswarpSendMsgToArm(ctrlBase, false);
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+}
+
+/**
+ * @brief ask the ARM for the FPGA IDE clock
+ * @return clock period in ps, 0 if the firmware does not know the command
+ *         (no reply within CSWARP_PROBE_TIMEOUT_US)
+ */
+static unsigned int pata_cswarp_get_clock(void __iomem *ctrlBase)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(ctrlBase);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(ctrlBase);
+	unsigned int ps = 0;
+	ulong irqFlags;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdGetIdeClock;
+	if (cswarpSendMsgToArmTimeout(ctrlBase, true, CSWARP_PROBE_TIMEOUT_US) == wacOK &&
+	    rpl->header.rpl == dprplIdeClock)
+		ps = rpl->ideClock.clkPeriodPs;
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	return ps;
+}
+
+/*
+ * Master and slave share one set of FPGA strobe timings, so the
+ * slower of both devices is programmed. Register (8-bit) and data
+ * cycles also share timings, so the longer of both is used. For DMA
+ * modes ata_timing_compute() already merges in the PIO timings.
+ */
+static int pata_cswarp_calc_timings(struct ata_device *adev, u8 mode,
+				    DprCmdIdeSpeed *speed)
+{
+	struct ata_device *pair = ata_dev_pair(adev);
+	struct ata_timing t, tp;
+
+	if (ata_timing_compute(adev, mode, &t, warp_ata_clk_ps, 0)) {
+		ata_dev_err(adev, "unknown transfer mode 0x%x\n", mode);
+		return -EINVAL;
+	}
+	if (pair) {
+		u8 pair_mode = ata_dma_enabled(pair) ? pair->dma_mode : pair->pio_mode;
+
+		if (pair_mode &&
+		    ata_timing_compute(pair, pair_mode, &tp, warp_ata_clk_ps, 0) == 0)
+			ata_timing_merge(&t, &tp, &t, ATA_TIMING_SETUP | ATA_TIMING_8BIT |
+					 ATA_TIMING_ACTIVE | ATA_TIMING_RECOVER);
+	}
+
+	speed->ataIOR_as = clamp_val(max(t.active, t.act8b), 1, 255);
+	speed->ataIOR_ng = clamp_val(max(t.recover, t.rec8b), 1, 255);
+	speed->ataIOW_as = speed->ataIOR_as;
+	speed->ataIOW_ng = speed->ataIOR_ng;
+	speed->ataACK_as = clamp_val(t.setup, 1, 255);
+	return 0;
+}
+
+static void pata_cswarp_set_timings(struct ata_port *ap, struct ata_device *adev,
+				    u8 mode)
+{
+	struct pata_cswarp_port *pp = ap->private_data;
+	DprCmdIdeSpeed speed;
+	bool use_override;
+
+	if (pp->override_valid && !pp->override_mode)
+		pp->override_mode = mode;
+	use_override = pp->override_valid && pp->override_mode == mode;
+
+	if (use_override)
+		speed = pp->override;
+	else if (pata_cswarp_calc_timings(adev, mode, &speed))
+		return;
+
+	pata_cswarp_send_timings(ap, &speed);
+
+	ata_dev_info(adev, "%s, strobe timings IOR %u/%u IOW %u/%u setup %u%s\n",
+		     ata_mode_string(ata_xfer_mode2mask(mode)),
+		     speed.ataIOR_as, speed.ataIOR_ng,
+		     speed.ataIOW_as, speed.ataIOW_ng, speed.ataACK_as,
+		     use_override ? " (override)" : "");
+	if (pp->override_valid && !use_override)
+		ata_dev_info(adev, "timing override is for %s, not used\n",
+			     ata_mode_string(ata_xfer_mode2mask(pp->override_mode)));
+}
+
+static void pata_cswarp_set_piomode(struct ata_port *ap, struct ata_device *adev)
+{
+	pata_cswarp_set_timings(ap, adev, adev->pio_mode);
+}
+
+static void pata_cswarp_set_dmamode(struct ata_port *ap, struct ata_device *adev)
+{
+	pata_cswarp_set_timings(ap, adev, adev->dma_mode);
+}
+
+// ############################################################################
+// strobe timing tuner
+// ############################################################################
+
 /*
- * Provide our own set_mode() as we don't want to change anything that has
- * already been configured..
+ * The mode timings above follow the ATA spec. Depending on drive and
+ * cable the FPGA strobes can usually be run tighter. The tuner writes
+ * test patterns to a scratch LBA given by the user and reads them
+ * back while stepping active, recovery and setup time down, one after
+ * the other, until verify fails. The last error free setting plus a
+ * safety margin is kept as override. The original sector contents
+ * are saved before and restored at spec timings afterwards.
+ *
+ * Taskfile, command and status cycles of the test run at spec timings,
+ * only the PIO data phase runs at the candidate, so a garbled LBA can
+ * not send the pattern to another sector. The LBA is also read back
+ * before each write. Register cycles share the strobe timings in
+ * production, so each candidate must also pass a write/read back test
+ * of the taskfile registers, no command is issued for that.
+ *
+ * Everything runs in EH context, so the port is quiescent. Only PIO
+ * is used for testing, DMA shares the same strobe timings.
+ */
+#define TUNE_SECTORS	8
+#define TUNE_PASSES	4
+#define TUNE_MARGIN	1
+#define TUNE_TIMEOUT	100000		/* 10us units */
+#define TUNE_BUFSIZE	(TUNE_SECTORS * ATA_SECT_SIZE)
+#define TUNE_REPORT_SIZE	2048
+
+struct pata_cswarp_tune {
+	struct ata_device *dev;
+	u32 lba;
+	DprCmdIdeSpeed spec;
+	u16 *save;
+	u16 *pattern;
+	u16 *verify;
+	char *report;
+	int len;
+};
+
+/**
+ * @brief PIO read or write of TUNE_SECTORS sectors, bypassing the qc path.
+ *        The data phase runs at the given timings, everything else at spec.
+ * @param ns if set, time spent in the data phase is added
+ */
+static int pata_cswarp_tune_rw(struct ata_port *ap, struct pata_cswarp_tune *tune,
+			       void *buf, int rw, const DprCmdIdeSpeed *speed, u64 *ns)
+{
+	struct ata_device *dev = tune->dev;
+	bool cand = speed != &tune->spec;
+	struct ata_taskfile tf, back;
+	u32 lba = tune->lba;
+	unsigned int i;
+	u64 start;
+	u8 status;
+
+	for (i = 0; i < TUNE_SECTORS; i++, lba++, buf += ATA_SECT_SIZE) {
+		memset(&tf, 0, sizeof(tf));
+		tf.flags = ATA_TFLAG_ISADDR | ATA_TFLAG_DEVICE | ATA_TFLAG_LBA;
+		if (rw == WRITE)
+			tf.flags |= ATA_TFLAG_WRITE;
+		tf.protocol = ATA_PROT_PIO;
+		tf.ctl = ap->ctl | ATA_NIEN;
+		tf.device = ATA_DEVICE_OBS | ATA_LBA | ((lba >> 24) & 0xf);
+		if (dev->devno)
+			tf.device |= ATA_DEV1;
+		tf.nsect = 1;
+		tf.lbal = lba;
+		tf.lbam = lba >> 8;
+		tf.lbah = lba >> 16;
+		tf.command = rw == WRITE ? ATA_CMD_PIO_WRITE : ATA_CMD_PIO_READ;
+
+		ap->ops->sff_dev_select(ap, dev->devno);
+		ap->ops->sff_tf_load(ap, &tf);
+		if (rw == WRITE) {
+			// never write a pattern anywhere but the scratch LBA
+			memset(&back, 0, sizeof(back));
+			ap->ops->sff_tf_read(ap, &back);
+			if (back.nsect != tf.nsect || back.lbal != tf.lbal ||
+			    back.lbam != tf.lbam || back.lbah != tf.lbah ||
+			    (back.device & (ATA_LBA | ATA_DEV1 | 0xf)) !=
+			    (tf.device & (ATA_LBA | ATA_DEV1 | 0xf)))
+				return -EIO;
+		}
+		ap->ops->sff_exec_command(ap, &tf);
+
+		status = ata_sff_busy_wait(ap, ATA_BUSY, TUNE_TIMEOUT);
+		if ((status & (ATA_BUSY | ATA_DF | ATA_ERR | ATA_DRQ)) != ATA_DRQ)
+			return -EIO;
+
+		if (cand)
+			pata_cswarp_send_timings(ap, speed);
+		start = ktime_get_ns();
+		pata_cswarp_xfer(ap, buf, ATA_SECT_SIZE, rw);
+		if (ns)
+			*ns += ktime_get_ns() - start;
+		if (cand)
+			pata_cswarp_send_timings(ap, &tune->spec);
+
+		status = ata_sff_busy_wait(ap, ATA_BUSY | ATA_DRQ, TUNE_TIMEOUT);
+		if (status & (ATA_BUSY | ATA_DF | ATA_ERR | ATA_DRQ))
+			return -EIO;
+	}
+	return 0;
+}
+
+static void pata_cswarp_tune_fill(u16 *buf, unsigned int pass, u32 lba)
+{
+	unsigned int i;
+
+	for (i = 0; i < TUNE_BUFSIZE / 2; i++) {
+		switch (pass) {
+		case 0:		// all lines toggling
+			buf[i] = (i & 1) ? 0xffff : 0x0000;
+			break;
+		case 1:		// neighbouring lines in opposite direction
+			buf[i] = (i & 1) ? 0x5555 : 0xaaaa;
+			break;
+		case 2:		// walking one
+			buf[i] = 1 << (i & 15);
+			break;
+		default:
+			buf[i] = (i + lba) * 0x9e37;
+			break;
+		}
+	}
+}
+
+/**
+ * @brief write and read back the taskfile registers at the given timings
+ *        (device selected and idle, no command is issued)
+ * @return true if all patterns read back unchanged
+ */
+static bool pata_cswarp_tune_regs(struct ata_port *ap, struct pata_cswarp_tune *tune,
+				  const DprCmdIdeSpeed *speed)
+{
+	static const u8 pat[] = { 0x00, 0xff, 0x55, 0xaa, 0x01, 0x80, 0xfe, 0x7f };
+	struct ata_ioports *ioaddr = &ap->ioaddr;
+	void __iomem *regs[] = { ioaddr->nsect_addr, ioaddr->lbal_addr,
+				 ioaddr->lbam_addr, ioaddr->lbah_addr };
+	unsigned int p, r;
+	bool ok = true;
+
+	ap->ops->sff_dev_select(ap, tune->dev->devno);
+	if (ata_sff_busy_wait(ap, ATA_BUSY | ATA_DRQ, TUNE_TIMEOUT) & (ATA_BUSY | ATA_DRQ))
+		return false;
+
+	pata_cswarp_send_timings(ap, speed);
+	for (p = 0; p < ARRAY_SIZE(pat) && ok; p++) {
+		// neighbouring registers hold different patterns
+		for (r = 0; r < ARRAY_SIZE(regs); r++)
+			iowrite8(pat[(p + r) % ARRAY_SIZE(pat)], regs[r]);
+		for (r = 0; r < ARRAY_SIZE(regs); r++)
+			if (ioread8(regs[r]) != pat[(p + r) % ARRAY_SIZE(pat)])
+				ok = false;
+	}
+	pata_cswarp_send_timings(ap, &tune->spec);
+	return ok;
+}
+
+/**
+ * @brief run all test passes at the given timings
+ * @return number of failed passes, read throughput in *kbps
+ */
+static unsigned int pata_cswarp_tune_test(struct ata_port *ap,
+					  struct pata_cswarp_tune *tune,
+					  const DprCmdIdeSpeed *speed, u32 *kbps)
+{
+	unsigned int pass, errors = 0;
+	u64 ns = 0;
+	int rc;
+
+	for (pass = 0; pass < TUNE_PASSES; pass++) {
+		if (!pata_cswarp_tune_regs(ap, tune, speed)) {
+			errors++;
+			continue;
+		}
+
+		pata_cswarp_tune_fill(tune->pattern, pass, tune->lba);
+		if (pata_cswarp_tune_rw(ap, tune, tune->pattern, WRITE, speed, NULL)) {
+			errors++;
+			continue;
+		}
+
+		memset(tune->verify, 0, TUNE_BUFSIZE);
+		rc = pata_cswarp_tune_rw(ap, tune, tune->verify, READ, speed, &ns);
+		if (rc || memcmp(tune->pattern, tune->verify, TUNE_BUFSIZE))
+			errors++;
+	}
+
+	*kbps = ns ? div64_u64((u64)TUNE_PASSES * TUNE_BUFSIZE * NSEC_PER_SEC, ns) / 1024 : 0;
+
+	tune->len += scnprintf(tune->report + tune->len, TUNE_REPORT_SIZE - tune->len,
+			       "%u,%u,%u,%u,%u errors %u/%u read %u KB/s\n",
+			       speed->ataIOR_as, speed->ataIOR_ng,
+			       speed->ataIOW_as, speed->ataIOW_ng,
+			       speed->ataACK_as, errors, TUNE_PASSES, *kbps);
+	return errors;
+}
+
+enum { TUNE_ACTIVE, TUNE_RECOVER, TUNE_SETUP };
+
+static uint8_t pata_cswarp_tune_get(const DprCmdIdeSpeed *speed, int field)
+{
+	switch (field) {
+	case TUNE_ACTIVE:
+		return speed->ataIOR_as;
+	case TUNE_RECOVER:
+		return speed->ataIOR_ng;
+	default:
+		return speed->ataACK_as;
+	}
+}
+
+static void pata_cswarp_tune_set(DprCmdIdeSpeed *speed, int field, uint8_t val)
+{
+	switch (field) {
+	case TUNE_ACTIVE:
+		speed->ataIOR_as = speed->ataIOW_as = val;
+		break;
+	case TUNE_RECOVER:
+		speed->ataIOR_ng = speed->ataIOW_ng = val;
+		break;
+	default:
+		speed->ataACK_as = val;
+		break;
+	}
+}
+
+/**
+ * @brief step one timing field down until verify fails, keep a margin
  */
-static int pata_cswarp_set_mode(struct ata_link *link,
-			       struct ata_device **unused)
+static void pata_cswarp_tune_field(struct ata_port *ap, struct pata_cswarp_tune *tune,
+				   const DprCmdIdeSpeed *spec, DprCmdIdeSpeed *best,
+				   int field)
+{
+	DprCmdIdeSpeed cand;
+	uint8_t val;
+	u32 kbps;
+
+	while ((val = pata_cswarp_tune_get(best, field)) > 1) {
+		cand = *best;
+		pata_cswarp_tune_set(&cand, field, val - 1);
+		if (pata_cswarp_tune_test(ap, tune, &cand, &kbps))
+			break;
+		*best = cand;
+	}
+
+	val = min(pata_cswarp_tune_get(best, field) + TUNE_MARGIN,
+		  (int)pata_cswarp_tune_get(spec, field));
+	pata_cswarp_tune_set(best, field, val);
+}
+
+static struct ata_device *pata_cswarp_tune_dev(struct ata_port *ap)
 {
 	struct ata_device *dev;
 
-	ata_for_each_dev(dev, link, ENABLED) {
-		/* We don't really care */
-		dev->pio_mode = dev->xfer_mode = XFER_PIO_0;
-		dev->xfer_shift = ATA_SHIFT_PIO;
-		dev->flags |= ATA_DFLAG_PIO;
-		ata_dev_info(dev, "configured for PIO\n");
+	ata_for_each_dev(dev, &ap->link, ENABLED)
+		if (dev->class == ATA_DEV_ATA)
+			return dev;
+	return NULL;
+}
+
+/**
+ * @brief tune strobe timings, called from the error handler
+ * @return 0 if an override was installed
+ */
+static int pata_cswarp_tune(struct ata_port *ap)
+{
+	struct pata_cswarp_port *pp = ap->private_data;
+	struct pata_cswarp_tune tune = { };
+	DprCmdIdeSpeed best;
+	u32 spec_kbps, best_kbps;
+	int field, rc;
+	u8 mode;
+
+	tune.report = pp->tune_report;
+	tune.lba = pp->tune_lba;
+	tune.dev = pata_cswarp_tune_dev(ap);
+	if (!tune.dev)
+		return -ENODEV;
+	// LBA28 commands only
+	if (tune.lba + TUNE_SECTORS > min_t(u64, tune.dev->n_sectors, 1 << 28))
+		return -EINVAL;
+
+	mode = ata_dma_enabled(tune.dev) ? tune.dev->dma_mode : tune.dev->pio_mode;
+	if (pata_cswarp_calc_timings(tune.dev, mode, &tune.spec))
+		return -EINVAL;
+
+	tune.save = kmalloc(TUNE_BUFSIZE, GFP_KERNEL);
+	tune.pattern = kmalloc(TUNE_BUFSIZE, GFP_KERNEL);
+	tune.verify = kmalloc(TUNE_BUFSIZE, GFP_KERNEL);
+	if (!tune.save || !tune.pattern || !tune.verify) {
+		rc = -ENOMEM;
+		goto out_free;
 	}
+
+	ata_dev_info(tune.dev, "tuning strobe timings on LBA %u-%u\n",
+		     tune.lba, tune.lba + TUNE_SECTORS - 1);
+
+	pata_cswarp_send_timings(ap, &tune.spec);
+	rc = pata_cswarp_tune_rw(ap, &tune, tune.save, READ, &tune.spec, NULL);
+	if (rc) {
+		ata_dev_err(tune.dev, "scratch LBA unreadable, tuning aborted\n");
+		goto out_restore_ctl;
+	}
+
+	tune.len = scnprintf(tune.report, TUNE_REPORT_SIZE,
+			     "lba %u mode %s\n", tune.lba,
+			     ata_mode_string(ata_xfer_mode2mask(mode)));
+
+	if (pata_cswarp_tune_test(ap, &tune, &tune.spec, &spec_kbps)) {
+		ata_dev_err(tune.dev, "verify fails at spec timings, tuning aborted\n");
+		rc = -EIO;
+		goto out_restore;
+	}
+
+	best = tune.spec;
+	for (field = TUNE_ACTIVE; field <= TUNE_SETUP; field++)
+		pata_cswarp_tune_field(ap, &tune, &tune.spec, &best, field);
+
+	// the combination of all steps has to pass as well
+	if (pata_cswarp_tune_test(ap, &tune, &best, &best_kbps)) {
+		best = tune.spec;
+		best_kbps = spec_kbps;
+	}
+
+	tune.len += scnprintf(tune.report + tune.len, TUNE_REPORT_SIZE - tune.len,
+			      "selected %u,%u,%u,%u,%u read %u KB/s (spec %u KB/s)\n",
+			      best.ataIOR_as, best.ataIOR_ng, best.ataIOW_as,
+			      best.ataIOW_ng, best.ataACK_as, best_kbps, spec_kbps);
+
+	pp->override = best;
+	pp->override_mode = mode;
+	pp->override_valid = true;
+
+out_restore:
+	pata_cswarp_send_timings(ap, &tune.spec);
+	if (pata_cswarp_tune_rw(ap, &tune, tune.save, WRITE, &tune.spec, NULL)) {
+		ata_dev_err(tune.dev, "failed to restore scratch LBA %u\n", tune.lba);
+		rc = -EIO;
+	}
+out_restore_ctl:
+	pata_cswarp_send_timings(ap, pp->override_valid ? &pp->override : &tune.spec);
+	iowrite8(ap->ctl, ap->ioaddr.ctl_addr);
+	ap->last_ctl = ap->ctl;
+	ap->ops->sff_check_status(ap);
+
+	if (!rc)
+		ata_dev_info(tune.dev, "strobe timings IOR %u/%u IOW %u/%u setup %u, "
+			     "%u KB/s (spec %u KB/s)\n",
+			     best.ataIOR_as, best.ataIOR_ng, best.ataIOW_as,
+			     best.ataIOW_ng, best.ataACK_as, best_kbps, spec_kbps);
+out_free:
+	kfree(tune.verify);
+	kfree(tune.pattern);
+	kfree(tune.save);
+	return rc;
+}
+
+/**
+ * @brief (re)program timings after the override changed
+ */
+static void pata_cswarp_apply_timings(struct ata_port *ap)
+{
+	struct ata_device *dev = pata_cswarp_tune_dev(ap);
+
+	if (dev)
+		pata_cswarp_set_timings(ap, dev, ata_dma_enabled(dev) ?
+					dev->dma_mode : dev->pio_mode);
+}
+
+static void pata_cswarp_error_handler(struct ata_port *ap)
+{
+	struct pata_cswarp_port *pp = ap->private_data;
+
+	if (dma)
+		ata_bmdma_error_handler(ap);
+	else
+		ata_sff_error_handler(ap);
+
+	if (pp->tune_pending) {
+		pp->tune_status = pata_cswarp_tune(ap);
+		pp->tune_pending = false;
+	}
+	if (pp->apply_pending) {
+		pata_cswarp_apply_timings(ap);
+		pp->apply_pending = false;
+	}
+}
+
+/**
+ * @brief let the EH thread carry out pending sysfs requests
+ */
+static void pata_cswarp_run_eh(struct ata_port *ap)
+{
+	ulong irqFlags;
+
+	spin_lock_irqsave(ap->lock, irqFlags);
+	ata_port_schedule_eh(ap);
+	spin_unlock_irqrestore(ap->lock, irqFlags);
+	ata_port_wait_eh(ap);
+}
+
+/* the modes this controller can run, named as ata_mode_string() does */
+static u8 pata_cswarp_parse_mode(const char *name)
+{
+	unsigned int n;
+
+	if (sscanf(name, "PIO%u", &n) == 1 && n <= 4)
+		return XFER_PIO_0 + n;
+	if (sscanf(name, "MWDMA%u", &n) == 1 && n <= 2)
+		return XFER_MW_DMA_0 + n;
 	return 0;
 }
 
+/**
+ * @brief parse "ior_as,ior_ng,iow_as,iow_ng,ack_as[,mode]"
+ * @param mode set to the XFER_xxx mode, 0 if none was given
+ */
+static int pata_cswarp_parse_timings(const char *buf, DprCmdIdeSpeed *speed,
+				     u8 *mode)
+{
+	unsigned int v[5];
+	char name[8];
+	int i, n;
+
+	n = sscanf(buf, "%u,%u,%u,%u,%u,%7s", &v[0], &v[1], &v[2], &v[3], &v[4], name);
+	if (n < 5)
+		return -EINVAL;
+	for (i = 0; i < 5; i++)
+		if (v[i] < 1 || v[i] > 255)
+			return -EINVAL;
+	*mode = 0;
+	if (n == 6) {
+		*mode = pata_cswarp_parse_mode(name);
+		if (!*mode)
+			return -EINVAL;
+	}
+
+	speed->ataIOR_as = v[0];
+	speed->ataIOR_ng = v[1];
+	speed->ataIOW_as = v[2];
+	speed->ataIOW_ng = v[3];
+	speed->ataACK_as = v[4];
+	return 0;
+}
+
+// ############################################################################
+// sysfs
+// ############################################################################
+
+static struct ata_port *pata_cswarp_dev_port(struct device *dev)
+{
+	struct ata_host *host = dev_get_drvdata(dev);
+
+	return host->ports[0];
+}
+
+/*
+ * ide_timings: "ior_as,ior_ng,iow_as,iow_ng,ack_as,mode" override or
+ * "auto". The same string is accepted by the timings= module parameter.
+ * Without the mode the override is bound to the next mode programmed.
+ */
+static ssize_t ide_timings_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct pata_cswarp_port *pp = pata_cswarp_dev_port(dev)->private_data;
+	DprCmdIdeSpeed *s = &pp->override;
+
+	if (!pp->override_valid)
+		return sysfs_emit(buf, "auto\n");
+	if (!pp->override_mode)
+		return sysfs_emit(buf, "%u,%u,%u,%u,%u\n", s->ataIOR_as, s->ataIOR_ng,
+				  s->ataIOW_as, s->ataIOW_ng, s->ataACK_as);
+	return sysfs_emit(buf, "%u,%u,%u,%u,%u,%s\n", s->ataIOR_as, s->ataIOR_ng,
+			  s->ataIOW_as, s->ataIOW_ng, s->ataACK_as,
+			  ata_mode_string(ata_xfer_mode2mask(pp->override_mode)));
+}
+
+static ssize_t ide_timings_store(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct ata_port *ap = pata_cswarp_dev_port(dev);
+	struct pata_cswarp_port *pp = ap->private_data;
+	DprCmdIdeSpeed speed;
+	bool valid = !sysfs_streq(buf, "auto");
+	u8 mode = 0;
+
+	if (valid && pata_cswarp_parse_timings(buf, &speed, &mode))
+		return -EINVAL;
+
+	mutex_lock(&pp->sysfs_mutex);
+	if (valid) {
+		pp->override = speed;
+		pp->override_mode = mode;
+	}
+	pp->override_valid = valid;
+	pp->apply_pending = true;
+	pata_cswarp_run_eh(ap);
+	mutex_unlock(&pp->sysfs_mutex);
+
+	return count;
+}
+static DEVICE_ATTR_RW(ide_timings);
+
+/*
+ * ide_tune: write a scratch LBA to start tuning, returns when done.
+ * TUNE_SECTORS sectors from there on are overwritten and restored.
+ */
+static ssize_t ide_tune_store(struct device *dev, struct device_attribute *attr,
+			      const char *buf, size_t count)
+{
+	struct ata_port *ap = pata_cswarp_dev_port(dev);
+	struct pata_cswarp_port *pp = ap->private_data;
+	u32 lba;
+	int rc;
+
+	rc = kstrtou32(buf, 0, &lba);
+	if (rc)
+		return rc;
+
+	mutex_lock(&pp->sysfs_mutex);
+	pp->tune_report[0] = 0;
+	pp->tune_lba = lba;
+	pp->tune_status = -EAGAIN;
+	pp->tune_pending = true;
+	pata_cswarp_run_eh(ap);
+	rc = pp->tune_status;
+	mutex_unlock(&pp->sysfs_mutex);
+
+	return rc ? rc : count;
+}
+static DEVICE_ATTR_WO(ide_tune);
+
+static ssize_t ide_tune_result_show(struct device *dev,
+				    struct device_attribute *attr, char *buf)
+{
+	struct pata_cswarp_port *pp = pata_cswarp_dev_port(dev)->private_data;
+	ssize_t len;
+
+	mutex_lock(&pp->sysfs_mutex);
+	len = sysfs_emit(buf, "%s", pp->tune_report);
+	mutex_unlock(&pp->sysfs_mutex);
+	return len;
+}
+static DEVICE_ATTR_RO(ide_tune_result);
+
+static struct attribute *pata_cswarp_attrs[] = {
+	&dev_attr_ide_timings.attr,
+	&dev_attr_ide_tune.attr,
+	&dev_attr_ide_tune_result.attr,
+	NULL
+};
+
+static const struct attribute_group pata_cswarp_attr_group = {
+	.attrs = pata_cswarp_attrs,
+};
+
+// ############################################################################
+// QSDMA pseudo bus-master DMA
+// ############################################################################
+
+static void pata_cswarp_bmdma_setup(struct ata_queued_cmd *qc)
+{
+	struct ata_port *ap = qc->ap;
+	struct pata_cswarp_port *pp = ap->private_data;
+	bool toMem = !(qc->tf.flags & ATA_TFLAG_WRITE);
+
+	WARN_ON_ONCE(qc->n_elem != 1);
+
+	pp->qsdma->csr = 0;
+	pp->qsdma->memAddr = sg_dma_address(qc->sg);
+	pp->qsdma->modulo = 0;
+	pp->qsdma->modInc = 0;
+	pp->qsdma->trNumb = sg_dma_len(qc->sg) >> 1;	/* 16-bit IDE words */
+	pp->qsdma->csr = QSDMA_CSR_ATA | (toMem ? QSDMA_CSR_TOMEM : 0);
+
+	/* issue r/w command */
+	ap->ops->sff_exec_command(ap, &qc->tf);
+}
+
+static void pata_cswarp_bmdma_start(struct ata_queued_cmd *qc)
+{
+	struct pata_cswarp_port *pp = qc->ap->private_data;
+
+	pp->qsdma->csr |= QSDMA_CSR_START;
+}
+
+static void pata_cswarp_bmdma_stop(struct ata_queued_cmd *qc)
+{
+	struct pata_cswarp_port *pp = qc->ap->private_data;
+
+	pp->qsdma->csr &= ~QSDMA_CSR_START;
+
+	/* one-PIO-cycle guaranteed wait, per spec, for HDMA1:0 transition */
+	ata_sff_dma_pause(qc->ap);
+}
+
+static u8 pata_cswarp_bmdma_status(struct ata_port *ap)
+{
+	struct pata_cswarp_port *pp = ap->private_data;
+	u32 csr = pp->qsdma->csr;
+	u8 status = 0;
+
+	if (csr & QSDMA_CSR_BUSY)
+		status |= ATA_DMA_ACTIVE;
+	if (csr & QSDMA_CSR_ERR)
+		status |= ATA_DMA_ERR;
+	if (csr & (QSDMA_CSR_DONE | QSDMA_CSR_ERR))
+		status |= ATA_DMA_INTR;
+
+	return status;
+}
+
+/*
+ * IRQ_AMIGA_PORTS is shared with the other Warp functions and Amiga
+ * hardware, so only the ATA INTRQ latched by the FPGA is handled here.
+ */
+static irqreturn_t pata_cswarp_interrupt(int irq, void *dev_instance)
+{
+	struct ata_host *host = dev_instance;
+	volatile u32 __iomem *dp_reg_cr = cswarpDpRegCR(host->private_data);
+
+	if (!(*dp_reg_cr & DPREG_CR_IF_ATA))
+		return IRQ_NONE;
+
+	// clear latch before status read acks the drive, so a new
+	// INTRQ is not lost
+	*dp_reg_cr = DPREG_CR_CLR | DPREG_CR_IF_ATA;
+
+	if (dma)
+		return ata_bmdma_interrupt(irq, dev_instance);
+	return ata_sff_interrupt(irq, dev_instance);
+}
+
 static struct ata_port_operations pata_cswarp_ops = {
 	.inherits	= &ata_sff_port_ops,
 	.sff_data_xfer	= pata_cswarp_data_xfer,
 	.cable_detect	= ata_cable_unknown,
-	.set_mode	= pata_cswarp_set_mode,
+	.set_piomode	= pata_cswarp_set_piomode,
+	.error_handler	= pata_cswarp_error_handler,
+};
+
+static struct ata_port_operations pata_cswarp_dma_ops = {
+	.inherits	= &ata_bmdma_port_ops,
+	.sff_data_xfer	= pata_cswarp_data_xfer,
+	.cable_detect	= ata_cable_unknown,
+	.set_piomode	= pata_cswarp_set_piomode,
+	.set_dmamode	= pata_cswarp_set_dmamode,
+	.error_handler	= pata_cswarp_error_handler,
+	/* no PRD table, QSDMA is programmed directly */
+	.qc_prep	= ata_noop_qc_prep,
+	.port_start	= ATA_OP_NULL,
+	.bmdma_setup	= pata_cswarp_bmdma_setup,
+	.bmdma_start	= pata_cswarp_bmdma_start,
+	.bmdma_stop	= pata_cswarp_bmdma_stop,
+	.bmdma_status	= pata_cswarp_bmdma_status,
 };
 
 static int pata_cswarp_probe(struct zorro_dev *z,
@@ -108,6 +1037,8 @@ static int pata_cswarp_probe(struct zorro_dev *z,
 	struct ata_host *host;
 	void __iomem *cswarp_ctrl_board;
 	unsigned long board;
+	unsigned int clk_ps;
+	int rc;
 
 	board = z->resource.start;
 
@@ -127,13 +1058,59 @@ static int pata_cswarp_probe(struct zorro_dev *z,
 
 	cswarp_ctrl_board = (void*)board;
 
+	/* anything outside 1..100 ns (1 GHz..10 MHz) is a bogus reply */
+	clk_ps = pata_cswarp_get_clock(cswarp_ctrl_board);
+	if (clk_ps >= 1000 && clk_ps <= 100000)
+		warp_ata_clk_ps = clk_ps;
+	dev_info(&z->dev, "IDE strobe clock %u.%02u MHz%s\n",
+		 1000000 / warp_ata_clk_ps, (100000000 / warp_ata_clk_ps) % 100,
+		 warp_ata_clk_ps == clk_ps ? "" : " (assumed)");
+
 	struct ata_port *ap = host->ports[0];
 	void __iomem *base = cswarp_ctrl_board + WARP_OFFSET_ATA;
+	struct pata_cswarp_port *pp;
 
-	ap->ops = &pata_cswarp_ops;
+	pp = devm_kzalloc(&z->dev, sizeof(*pp), GFP_KERNEL);
+	if (!pp)
+		return -ENOMEM;
+	pp->tune_report = devm_kzalloc(&z->dev, TUNE_REPORT_SIZE, GFP_KERNEL);
+	if (!pp->tune_report)
+		return -ENOMEM;
+	mutex_init(&pp->sysfs_mutex);
+
+	if (timings && *timings) {
+		if (pata_cswarp_parse_timings(timings, &pp->override, &pp->override_mode))
+			dev_warn(&z->dev, "invalid timings \"%s\", using mode defaults\n",
+				 timings);
+		else
+			pp->override_valid = true;
+	}
+
+	if (dma && polling) {
+		dev_warn(&z->dev, "DMA needs the ATA interrupt, using PIO\n");
+		dma = false;
+	}
+	if (dma && !devm_request_mem_region(&z->dev, board + WARP_OFFSET_QSDMA,
+					    sizeof(WarpQSDMARegs), DRV_NAME)) {
+		dev_warn(&z->dev, "QSDMA registers busy, using PIO\n");
+		dma = false;
+	}
+	if (dma && dma_set_mask_and_coherent(&z->dev, DMA_BIT_MASK(32))) {
+		dev_warn(&z->dev, "no usable DMA mask, using PIO\n");
+		dma = false;
+	}
+
+	ap->ops = dma ? &pata_cswarp_dma_ops : &pata_cswarp_ops;
 
 	ap->pio_mask = ATA_PIO4;
-	ap->flags |= ATA_FLAG_SLAVE_POSS | ATA_FLAG_NO_IORDY | ATA_FLAG_PIO_POLLING;
+	if (dma)
+		ap->mwdma_mask = ATA_MWDMA2;
+	ap->flags |= ATA_FLAG_SLAVE_POSS;
+	if (polling)
+		ap->flags |= ATA_FLAG_PIO_POLLING;
+	// without IORDY libata limits most drives to PIO2
+	if (!pio_iordy)
+		ap->flags |= ATA_FLAG_NO_IORDY;
 
 	ap->ioaddr.data_addr		= base;
 	ap->ioaddr.error_addr		= base + 1 * 4;
@@ -149,14 +1126,50 @@ static int pata_cswarp_probe(struct zorro_dev *z,
 	ap->ioaddr.altstatus_addr	= base + (0x1000 | (6UL << 2));
 	ap->ioaddr.ctl_addr			= base + (0x1000 | (6UL << 2));
 
-	ap->private_data = (void *)0;
+	// 32-bit data window (see data_xfer parameter) and DMA engine
+	pp->data32 = base + WARP_ATA_DATA32;
+	pp->qsdma = (volatile WarpQSDMARegs*)(cswarp_ctrl_board + WARP_OFFSET_QSDMA);
+	ap->private_data = pp;
+	// Warp-CTRL base, for ARM mailbox access
+	host->private_data = cswarp_ctrl_board;
 
 	ata_port_desc(ap, "  cmd 0x%lx ctl 0x%lx", 
 			(unsigned long)base, (unsigned long)ap->ioaddr.ctl_addr);
+	ata_port_desc(ap, "%s data", data_xfer == CSWARP_XFER_32 ? "32-bit" :
+		      data_xfer == CSWARP_XFER_32_MODEL ? "32-bit model" : "16-bit");
+	if (dma)
+		ata_port_desc(ap, "QSDMA 0x%lx", (unsigned long)pp->qsdma);
+
+	if (polling) {
+		rc = ata_host_activate(host, 0, NULL,
+				       IRQF_SHARED, &pata_cswarp_sht);
+		goto out_sysfs;
+	}
+
+	/*
+	 * open-coded ata_host_activate(), ATA INTRQ forwarding may be
+	 * enabled only after the handler is in place
+	 */
+	rc = ata_host_start(host);
+	if (rc)
+		return rc;
+
+	rc = devm_request_irq(&z->dev, IRQ_AMIGA_PORTS, pata_cswarp_interrupt,
+			      IRQF_SHARED, DRV_NAME, host);
+	if (rc)
+		return rc;
+	ata_port_desc(ap, "irq %d", IRQ_AMIGA_PORTS);
+
+	*cswarpDpRegCR(cswarp_ctrl_board) = DPREG_CR_CLR | DPREG_CR_IF_ATA;
+	*cswarpDpRegCR(cswarp_ctrl_board) = DPREG_CR_SET | DPREG_CR_IE_ATA;
 
-	ata_host_activate(host, 0, NULL,
-			  IRQF_SHARED, &pata_cswarp_sht);
+	rc = ata_host_register(host, dma ? &pata_cswarp_dma_sht : &pata_cswarp_sht);
 
+out_sysfs:
+	if (rc)
+		return rc;
+	if (sysfs_create_group(&z->dev.kobj, &pata_cswarp_attr_group))
+		dev_warn(&z->dev, "failed to create sysfs attributes\n");
 	return 0;
 }
 
@@ -164,7 +1177,9 @@ static void pata_cswarp_remove(struct zorro_dev *z)
 {
 	struct ata_host *host = dev_get_drvdata(&z->dev);
 
+	sysfs_remove_group(&z->dev.kobj, &pata_cswarp_attr_group);
 	ata_host_detach(host);
+	*cswarpDpRegCR(host->private_data) = DPREG_CR_CLR | DPREG_CR_IE_ATA;
 }
 
 static const struct zorro_device_id pata_cswarp_zorro_tbl[] = {
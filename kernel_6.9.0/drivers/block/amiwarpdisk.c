@@ -0,0 +1,1401 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  drivers/block/amiwarpdisk.c -- csWarp ARM attached storage
+ *
+ *      Copyright (C) 2024 Andrzej Rogozynski
+ *
+ *  The SD card slot and the USB mass storage port of the Warp board are
+ *  handled by the ARM. Blocks are moved through the dpRAM mailbox with
+ *  dpcmdDiskReadBlocks / dpcmdDiskWriteBlocks. In DMA mode (default) the
+ *  ARM reads or writes the bio pages in Warp DDR3 directly, at most
+ *  WARPDISK_DMA_CHUNK blocks per command. Otherwise, or for pages out of ARM reach, data is
+ *  copied through dpRAM, at most DISK_MAX_DPRAM_TRANSFER blocks per
+ *  round trip.
+ *
+ *  Requests are queued by blk-mq and carried out by a workqueue, so the
+ *  submitter does not wait for the ARM and other mailbox users (network,
+ *  ATA timings) can get in between two chunks.
+ *
+ *  With queue_depth > 1 reads, writes and discards are instead handed to
+ *  the ARM as tagged dpcmdDiskQueue commands with a scatter list in DDR.
+ *  The ARM merges and reorders them into large SD/USB transactions,
+ *  keeping overlapping requests in submission order, and raises
+ *  DPREG_CR_IF_DISK, the completions are then fetched by tag.
+ *
+ *  The ARM can keep a block cache (LRU, readahead of sequential streams,
+ *  optional write-back). In write-back mode the disk announces a volatile
+ *  write cache, so the block layer sends flushes (and FUA writes when
+ *  tagged). A flush can take seconds, the ARM carries it out in the
+ *  background while the worker sleeps and polls it, without holding the
+ *  mailbox. Hit/miss counters are found in /sys/block/warpXX/warpcache/.
+ *
+ *  Image files on the ARM filesystem can be attached as warpimg0..3
+ *  through the /dev/warpdisk-ctl ioctls (see <linux/amiwarpdisk.h>),
+ *  I/O then goes through the ARM's FAT/exFAT driver.
+ *
+ *  With ram_mb=<n> part of the ARM's own RAM is reserved as warpram, a
+ *  swap device much faster than swapping to IDE or over WiFi. The ARM
+ *  may grant less than asked for. Swap discards free the backing pages
+ *  again, usage is found in /sys/block/warpram/warpram/.
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of this archive for
+ *  more details.
+ */
+
+#include <linux/blk-mq.h>
+#include <linux/blkdev.h>
+#include <linux/delay.h>
+#include <linux/dma-mapping.h>
+#include <linux/interrupt.h>
+#include <linux/kernel.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/scatterlist.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/uaccess.h>
+#include <linux/zorro.h>
+#include <uapi/linux/amiwarpdisk.h>
+
+#include <asm/amigaints.h>
+#include <asm/cswarpamicomm.h>
+
+#define DRV_NAME	"amiwarpdisk"
+
+#define WARPDISK_MINORS	16
+
+// blocks (8 KB) per synchronous DMA command, bounds the time spent in
+// the mailbox with IRQs off
+#define WARPDISK_DMA_CHUNK	16
+
+// long commands (flush, image open, RAM setup) are polled this often
+// without holding the mailbox, and failed if not done in time
+#define WARPDISK_POLL_MS	10
+#define WARPDISK_LONG_TIMEOUT	(30 * HZ)
+
+static bool dma = true;
+module_param(dma, bool, 0444);
+MODULE_PARM_DESC(dma, "Let the ARM transfer blocks directly from/to memory (default: 1)");
+
+static int queue_depth = 1;
+module_param(queue_depth, int, 0444);
+MODULE_PARM_DESC(queue_depth, "Tagged requests in flight per disk, >1 needs DMA and "
+		 "ARM firmware with dpcmdDiskQueue (default: 1)");
+
+static int cache = DISK_CACHE_OFF;
+module_param(cache, int, 0444);
+MODULE_PARM_DESC(cache, "ARM block cache: 0 off, 1 write-through, 2 write-back (default: 0)");
+
+static int cache_readahead_kb = 128;
+module_param(cache_readahead_kb, int, 0444);
+MODULE_PARM_DESC(cache_readahead_kb, "ARM readahead for sequential reads (default: 128)");
+
+static int ram_mb;
+module_param(ram_mb, int, 0444);
+MODULE_PARM_DESC(ram_mb, "ARM RAM to reserve for the warpram swap disk, 0 = none (default: 0)");
+
+static const char * const warpdisk_cache_modes[] = {
+	[DISK_CACHE_OFF]		= "off",
+	[DISK_CACHE_WRITETHROUGH]	= "write-through",
+	[DISK_CACHE_WRITEBACK]		= "write-back",
+};
+
+// tagged request, blk-mq pdu
+typedef struct {
+	struct scatterlist sg[DISK_MAX_SG];
+	int sgMapped;		// entries passed to dma_map_sg
+	bool tagged;		// owned by the ARM until completion or abort
+} WarpDiskCmd;
+
+typedef struct {
+	const char *name;
+	uint8_t diskNr;
+	void __iomem *ctrlBase;
+	struct device *dmaDev;		// NULL: dpRAM copy only
+
+	struct gendisk *disk;
+	struct blk_mq_tag_set tagSet;
+
+	// per tag scatter lists read by ARM
+	DiskSgEntry *sgTable;
+	dma_addr_t sgTableDma;
+
+	// ARM block cache, DISK_CACHE_xxx
+	struct mutex cacheMutex;
+	uint8_t cacheMode;
+
+	// attached image (DISK_NR_IMAGE_FIRST..)
+	char imgPath[AMICOMM_PATH_LEN];
+	bool imgReadOnly;
+	bool detaching;			// set under disk->open_mutex
+
+	// requests waiting for the worker
+	spinlock_t lock;
+	struct list_head queue;
+	struct work_struct work;
+} WarpDisk;
+
+static int warpdisk_major;
+static struct workqueue_struct *warpdisk_wq;
+static void __iomem *warpdisk_ctrl;
+static bool warpdisk_tagged;
+
+// Warp DDR3 as seen by the 68k, NULL if not autoconfigured
+static struct resource *warpdisk_ddr;
+
+static struct zorro_dev *warpdisk_zdev;
+// serializes image attach/detach
+static DEFINE_MUTEX(warpdisk_img_mutex);
+
+static WarpDisk warpdisks[] = {
+	{ .name = "warpsd",   .diskNr = DISK_NR_SD },
+	{ .name = "warpusb",  .diskNr = DISK_NR_USB },
+	{ .name = "warpimg0", .diskNr = DISK_NR_IMAGE_FIRST + 0 },
+	{ .name = "warpimg1", .diskNr = DISK_NR_IMAGE_FIRST + 1 },
+	{ .name = "warpimg2", .diskNr = DISK_NR_IMAGE_FIRST + 2 },
+	{ .name = "warpimg3", .diskNr = DISK_NR_IMAGE_FIRST + 3 },
+	{ .name = "warpram",  .diskNr = DISK_NR_RAM },
+};
+
+static_assert(DISK_NR_IMAGES == WARPDISK_IMG_SLOTS);
+static_assert(AMICOMM_PATH_LEN == WARPDISK_IMG_PATH_LEN);
+
+// ############################################################################
+// ARM communication
+// ############################################################################
+
+/**
+ * @brief ask ARM for disk state and size
+ * @return number of DISK_BLOCKSIZE blocks, 0 if there is no medium
+ */
+static sector_t warpdisk_get_info(WarpDisk *wd)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(wd->ctrlBase);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(wd->ctrlBase);
+	uint32_t blockNbr = 0, blockSize = 0;
+	ulong irqFlags;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	if (wd->diskNr == DISK_NR_SD) {
+		cmd->header.cmd = dpcmdSDGetInfo;
+		cswarpSendMsgToArm(wd->ctrlBase, true);
+		if (rpl->header.rpl == dprplSDGetInfo && rpl->sdInfo.cardInitialized) {
+			blockNbr = rpl->sdInfo.blockNbr;
+			blockSize = rpl->sdInfo.blockSize;
+		}
+	} else {
+		cmd->header.cmd = dpcmdUSBDiskGetInfo;
+		cswarpSendMsgToArm(wd->ctrlBase, true);
+		if (rpl->header.rpl == dprplUSBGetInfo && rpl->usbInfo.diskInitialized) {
+			blockNbr = rpl->usbInfo.blockNbr;
+			blockSize = rpl->usbInfo.blockSize;
+		}
+	}
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	if (blockNbr && blockSize != DISK_BLOCKSIZE) {
+		pr_warn("%s: unsupported block size %u\n", wd->name, blockSize);
+		return 0;
+	}
+	return blockNbr;
+}
+
+/**
+ * @brief move up to DISK_MAX_DPRAM_TRANSFER blocks through dpRAM
+ */
+static blk_status_t warpdisk_xfer_chunk(WarpDisk *wd, sector_t block,
+					unsigned int cnt, void *buf, bool write)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(wd->ctrlBase);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(wd->ctrlBase);
+	blk_status_t status = BLK_STS_OK;
+	ulong irqFlags;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	if (write) {
+		cmd->header.cmd = dpcmdDiskWriteBlocks;
+		cmd->diskWrite.blockAddr = block;
+		cmd->diskWrite.writeBlocksCnt = cnt;
+		cmd->diskWrite.dmaDdrAddr = 0;
+		cmd->diskWrite.dmaEnable = 0;
+		cmd->diskWrite.diskNr = wd->diskNr;
+		memcpy((void*)cmd->diskWrite.data, buf, cnt * DISK_BLOCKSIZE);
+		cswarpSendMsgToArm(wd->ctrlBase, true);
+		if (rpl->header.rpl != dprplDiskWriteBlocks ||
+		    rpl->diskWrite.writeBlocksCnt != cnt)
+			status = BLK_STS_IOERR;
+	} else {
+		cmd->header.cmd = dpcmdDiskReadBlocks;
+		cmd->diskRead.blockAddr = block;
+		cmd->diskRead.readBlocksCnt = cnt;
+		cmd->diskRead.dmaDdrAddr = 0;
+		cmd->diskRead.dmaEnable = 0;
+		cmd->diskRead.diskNr = wd->diskNr;
+		cswarpSendMsgToArm(wd->ctrlBase, true);
+		if (rpl->header.rpl == dprplDiskReadBlocks &&
+		    rpl->diskRead.readBlocksCnt == cnt)
+			memcpy(buf, (void*)rpl->diskRead.data, cnt * DISK_BLOCKSIZE);
+		else
+			status = BLK_STS_IOERR;
+	}
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	return status;
+}
+
+/**
+ * @brief check that the ARM can reach a DMA buffer. Without a known
+ *        DDR3 window nothing is reachable.
+ */
+static bool warpdisk_ddr_ok(dma_addr_t addr, unsigned int len)
+{
+	return warpdisk_ddr && addr >= warpdisk_ddr->start &&
+	       addr + len - 1 <= warpdisk_ddr->end;
+}
+
+/**
+ * @brief one DMA command of at most WARPDISK_DMA_CHUNK blocks
+ */
+static int warpdisk_xfer_dma_chunk(WarpDisk *wd, sector_t block, unsigned int cnt,
+				   dma_addr_t addr, bool write)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(wd->ctrlBase);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(wd->ctrlBase);
+	ulong irqFlags;
+	int rc = 0;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	if (write) {
+		cmd->header.cmd = dpcmdDiskWriteBlocks;
+		cmd->diskWrite.blockAddr = block;
+		cmd->diskWrite.writeBlocksCnt = cnt;
+		cmd->diskWrite.dmaDdrAddr = addr;
+		cmd->diskWrite.dmaEnable = 1;
+		cmd->diskWrite.diskNr = wd->diskNr;
+		cswarpSendMsgToArm(wd->ctrlBase, true);
+		if (rpl->header.rpl != dprplDiskWriteBlocks ||
+		    rpl->diskWrite.writeBlocksCnt != cnt)
+			rc = -EIO;
+	} else {
+		cmd->header.cmd = dpcmdDiskReadBlocks;
+		cmd->diskRead.blockAddr = block;
+		cmd->diskRead.readBlocksCnt = cnt;
+		cmd->diskRead.dmaDdrAddr = addr;
+		cmd->diskRead.dmaEnable = 1;
+		cmd->diskRead.diskNr = wd->diskNr;
+		cswarpSendMsgToArm(wd->ctrlBase, true);
+		if (rpl->header.rpl != dprplDiskReadBlocks ||
+		    rpl->diskRead.readBlocksCnt != cnt)
+			rc = -EIO;
+	}
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	return rc;
+}
+
+/**
+ * @brief let the ARM move a whole segment from/to memory
+ *        (dma_map_page/dma_unmap_page do the 68060 cache push/invalidate).
+ *        The mailbox is held with IRQs off until the ARM replies, so the
+ *        segment is split into WARPDISK_DMA_CHUNK block commands.
+ * @return 0, -EIO or -ERANGE if the ARM cannot reach the buffer
+ */
+static int warpdisk_xfer_dma(WarpDisk *wd, sector_t block,
+			     struct bio_vec *bvec, bool write)
+{
+	enum dma_data_direction dir = write ? DMA_TO_DEVICE : DMA_FROM_DEVICE;
+	unsigned int blocks = bvec->bv_len / DISK_BLOCKSIZE;
+	dma_addr_t addr, pos;
+	int rc = 0;
+
+	addr = dma_map_page(wd->dmaDev, bvec->bv_page, bvec->bv_offset,
+			    bvec->bv_len, dir);
+	if (dma_mapping_error(wd->dmaDev, addr))
+		return -ERANGE;
+	if (!warpdisk_ddr_ok(addr, bvec->bv_len)) {
+		rc = -ERANGE;
+		goto out_unmap;
+	}
+
+	for (pos = addr; blocks && !rc; ) {
+		unsigned int cnt = min_t(unsigned int, blocks, WARPDISK_DMA_CHUNK);
+
+		rc = warpdisk_xfer_dma_chunk(wd, block, cnt, pos, write);
+		block += cnt;
+		blocks -= cnt;
+		pos += cnt * DISK_BLOCKSIZE;
+	}
+
+out_unmap:
+	dma_unmap_page(wd->dmaDev, addr, bvec->bv_len, dir);
+	return rc;
+}
+
+/**
+ * @brief copy a segment through dpRAM in DISK_MAX_DPRAM_TRANSFER chunks
+ */
+static blk_status_t warpdisk_xfer_pio(WarpDisk *wd, sector_t block,
+				      struct bio_vec *bvec, bool write)
+{
+	unsigned int blocks = bvec->bv_len / DISK_BLOCKSIZE;
+	// no highmem on m68k, multi-page segments are contiguous
+	void *buf = page_address(bvec->bv_page) + bvec->bv_offset;
+	blk_status_t status;
+
+	while (blocks) {
+		unsigned int cnt = min_t(unsigned int, blocks, DISK_MAX_DPRAM_TRANSFER);
+
+		status = warpdisk_xfer_chunk(wd, block, cnt, buf, write);
+		if (status)
+			return status;
+		block += cnt;
+		blocks -= cnt;
+		buf += cnt * DISK_BLOCKSIZE;
+	}
+	return BLK_STS_OK;
+}
+
+/**
+ * @brief send a disk command answered by DprRplDiskStatus
+ *        (frame is in dpRAM, cswarp_dpram_lock held)
+ */
+static int warpdisk_status_cmd(WarpDisk *wd)
+{
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(wd->ctrlBase);
+	int rc = 0;
+
+	cswarpSendMsgToArm(wd->ctrlBase, true);
+	if (rpl->header.rpl != dprplDiskStatus || !rpl->diskStatus.success)
+		rc = -EIO;
+	return rc;
+}
+
+/**
+ * @brief send a long disk command and sleep until the ARM is done with
+ *        it, polling with dpcmdDiskPoll. cswarp_dpram_lock is only held
+ *        for the round trips, so other mailbox users are not held up.
+ *        (frame is in dpRAM, cswarp_dpram_lock held, it is held again
+ *        on return with the reply of the command in dpRAM)
+ * @return 0, -ETIMEDOUT if the ARM is not done in WARPDISK_LONG_TIMEOUT
+ */
+static int warpdisk_long_cmd(WarpDisk *wd, ulong *irqFlags)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(wd->ctrlBase);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(wd->ctrlBase);
+	unsigned long timeout = jiffies + WARPDISK_LONG_TIMEOUT;
+
+	cswarpSendMsgToArm(wd->ctrlBase, true);
+	while (rpl->header.rpl == dprplDiskBusy) {
+		spin_unlock_irqrestore(&cswarp_dpram_lock, *irqFlags);
+		if (time_after(jiffies, timeout)) {
+			spin_lock_irqsave(&cswarp_dpram_lock, *irqFlags);
+			return -ETIMEDOUT;
+		}
+		msleep(WARPDISK_POLL_MS);
+
+		spin_lock_irqsave(&cswarp_dpram_lock, *irqFlags);
+		cmd->header.cmd = dpcmdDiskPoll;
+		cmd->diskNr.diskNr = wd->diskNr;
+		cswarpSendMsgToArm(wd->ctrlBase, true);
+	}
+	return 0;
+}
+
+static int warpdisk_cache_ctrl(WarpDisk *wd, uint8_t mode)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(wd->ctrlBase);
+	ulong irqFlags;
+	int rc;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdDiskCacheCtrl;
+	cmd->diskCacheCtrl.diskNr = wd->diskNr;
+	cmd->diskCacheCtrl.mode = mode;
+	cmd->diskCacheCtrl.readaheadKB = clamp(cache_readahead_kb, 0, 0xffff);
+	rc = warpdisk_status_cmd(wd);
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	return rc;
+}
+
+/**
+ * @brief write back dirty blocks of the ARM cache (and the medium's cache)
+ * @return 0, -EIO, -ETIMEDOUT
+ */
+static int warpdisk_cache_flush(WarpDisk *wd)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(wd->ctrlBase);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(wd->ctrlBase);
+	ulong irqFlags;
+	int rc;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdDiskCacheFlush;
+	cmd->diskNr.diskNr = wd->diskNr;
+	rc = warpdisk_long_cmd(wd, &irqFlags);
+	if (rc == 0 && (rpl->header.rpl != dprplDiskStatus || !rpl->diskStatus.success))
+		rc = -EIO;
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	if (rc == -ETIMEDOUT)
+		pr_warn_ratelimited("%s: cache flush timed out\n", wd->name);
+	return rc;
+}
+
+static int warpdisk_cache_stats(WarpDisk *wd, DprRplDiskCacheStats *stats)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(wd->ctrlBase);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(wd->ctrlBase);
+	ulong irqFlags;
+	int rc = 0;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdDiskCacheStats;
+	cmd->diskNr.diskNr = wd->diskNr;
+	cswarpSendMsgToArm(wd->ctrlBase, true);
+	if (rpl->header.rpl == dprplDiskCacheStats)
+		memcpy(stats, (void*)&rpl->diskCacheStats, sizeof(*stats));
+	else
+		rc = -EIO;
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	return rc;
+}
+
+/**
+ * @brief switch ARM cache mode, announce a volatile write cache for
+ *        write-back (FUA only works with tagged requests). The queue is
+ *        frozen so no write is in flight while the mode and the flush
+ *        flags change.
+ */
+static int warpdisk_set_cache(WarpDisk *wd, uint8_t mode)
+{
+	struct request_queue *q = wd->disk->queue;
+	int rc;
+
+	mutex_lock(&wd->cacheMutex);
+	blk_mq_freeze_queue(q);
+	if (wd->cacheMode == DISK_CACHE_WRITEBACK && mode != DISK_CACHE_WRITEBACK)
+		warpdisk_cache_flush(wd);
+	rc = warpdisk_cache_ctrl(wd, mode);
+	if (rc == 0)
+		wd->cacheMode = mode;
+	blk_queue_write_cache(q, wd->cacheMode == DISK_CACHE_WRITEBACK,
+			      wd->cacheMode == DISK_CACHE_WRITEBACK && warpdisk_tagged);
+	blk_mq_unfreeze_queue(q);
+	mutex_unlock(&wd->cacheMutex);
+
+	return rc;
+}
+
+/**
+ * @brief let ARM open an image file as disk wd->diskNr, sleeps while the
+ *        ARM scans the file
+ * @return number of blocks, 0 on error
+ */
+static sector_t warpdisk_image_open(WarpDisk *wd, const char *path, bool *readOnly)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(wd->ctrlBase);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(wd->ctrlBase);
+	sector_t blocks = 0;
+	ulong irqFlags;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdDiskImageOpen;
+	cmd->diskImageOpen.diskNr = wd->diskNr;
+	cmd->diskImageOpen.readOnly = *readOnly;
+	memcpy((void*)cmd->diskImageOpen.path, path, AMICOMM_PATH_LEN);
+	if (warpdisk_long_cmd(wd, &irqFlags) == 0 &&
+	    rpl->header.rpl == dprplDiskImageInfo && rpl->diskImageInfo.success) {
+		blocks = rpl->diskImageInfo.blockNbr;
+		*readOnly |= rpl->diskImageInfo.readOnly;
+	}
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	return blocks;
+}
+
+static int warpdisk_image_close(WarpDisk *wd)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(wd->ctrlBase);
+	ulong irqFlags;
+	int rc;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdDiskImageClose;
+	cmd->diskNr.diskNr = wd->diskNr;
+	rc = warpdisk_status_cmd(wd);
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	return rc;
+}
+
+/**
+ * @brief reserve (or with sizeKB 0 release) ARM RAM for the RAM disk,
+ *        sleeps while the ARM clears it
+ * @return number of granted blocks, 0 if none
+ */
+static sector_t warpdisk_ram_setup(WarpDisk *wd, uint32_t sizeKB)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(wd->ctrlBase);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(wd->ctrlBase);
+	uint32_t armFreeKB = 0;
+	sector_t blocks = 0;
+	ulong irqFlags;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdDiskRamSetup;
+	cmd->diskRamSetup.sizeKB = sizeKB;
+	if (warpdisk_long_cmd(wd, &irqFlags) == 0 &&
+	    rpl->header.rpl == dprplDiskRamInfo && rpl->diskRamInfo.success) {
+		blocks = rpl->diskRamInfo.blockNbr;
+		armFreeKB = rpl->diskRamInfo.armFreeKB;
+	}
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	if (sizeKB && blocks < sizeKB * 2)
+		pr_info("%s: ARM granted %llu of %u KB, %u KB left\n", wd->name,
+			(unsigned long long)blocks / 2, sizeKB, armFreeKB);
+	return blocks;
+}
+
+static int warpdisk_ram_stats(WarpDisk *wd, DprRplDiskRamStats *stats)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(wd->ctrlBase);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(wd->ctrlBase);
+	ulong irqFlags;
+	int rc = 0;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdDiskRamStats;
+	cmd->diskNr.diskNr = wd->diskNr;
+	cswarpSendMsgToArm(wd->ctrlBase, true);
+	if (rpl->header.rpl == dprplDiskRamStats && rpl->diskRamStats.success)
+		memcpy(stats, (void*)&rpl->diskRamStats, sizeof(*stats));
+	else
+		rc = -EIO;
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	return rc;
+}
+
+static int warpdisk_discard(WarpDisk *wd, sector_t block, unsigned int cnt)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(wd->ctrlBase);
+	ulong irqFlags;
+	int rc;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdDiskDiscard;
+	cmd->diskDiscard.diskNr = wd->diskNr;
+	cmd->diskDiscard.blockAddr = block;
+	cmd->diskDiscard.blocksCnt = cnt;
+	rc = warpdisk_status_cmd(wd);
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	return rc;
+}
+
+/**
+ * @brief hand a request to the ARM as tagged command, completion follows
+ *        by interrupt
+ * @return 0, -ERANGE if the request has to go the synchronous way
+ */
+static int warpdisk_queue_tagged(WarpDisk *wd, struct request *rq)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(wd->ctrlBase);
+	WarpDiskCmd *wc = blk_mq_rq_to_pdu(rq);
+	DiskSgEntry *sgList = wd->sgTable + rq->tag * DISK_MAX_SG;
+	enum dma_data_direction dir = rq_dma_dir(rq);
+	struct scatterlist *sg;
+	uint8_t flags = 0;
+	ulong irqFlags;
+	int i, nents = 0;
+
+	switch (req_op(rq)) {
+	case REQ_OP_READ:
+	case REQ_OP_WRITE:
+		break;
+	case REQ_OP_DISCARD:
+		// tagged too, so the ARM orders it against queued writes
+		wc->sgMapped = 0;
+		flags = DISK_FLAG_DISCARD;
+		goto queue;
+	default:
+		return -ERANGE;
+	}
+
+	sg_init_table(wc->sg, DISK_MAX_SG);
+	wc->sgMapped = blk_rq_map_sg(rq->q, rq, wc->sg);
+	nents = dma_map_sg(wd->dmaDev, wc->sg, wc->sgMapped, dir);
+	if (!nents)
+		return -ERANGE;
+
+	for_each_sg(wc->sg, sg, nents, i) {
+		if (!warpdisk_ddr_ok(sg_dma_address(sg), sg_dma_len(sg))) {
+			dma_unmap_sg(wd->dmaDev, wc->sg, wc->sgMapped, dir);
+			return -ERANGE;
+		}
+		sgList[i].dmaDdrAddr = sg_dma_address(sg);
+		sgList[i].len = sg_dma_len(sg);
+	}
+	if (rq->cmd_flags & REQ_FUA)
+		flags |= DISK_FLAG_FUA;
+
+queue:
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdDiskQueue;
+	cmd->diskQueue.diskNr = wd->diskNr;
+	cmd->diskQueue.tag = rq->tag;
+	cmd->diskQueue.write = rq_data_dir(rq) == WRITE;
+	cmd->diskQueue.flags = flags;
+	cmd->diskQueue.blockAddr = blk_rq_pos(rq);
+	cmd->diskQueue.blocksCnt = blk_rq_sectors(rq);
+	cmd->diskQueue.sgDdrAddr = wd->sgTableDma +
+		rq->tag * DISK_MAX_SG * sizeof(DiskSgEntry);
+	cmd->diskQueue.sgCnt = nents;
+	wc->tagged = true;
+	cswarpSendMsgToArm(wd->ctrlBase, false);
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	return 0;
+}
+
+/**
+ * @brief ask the ARM to drop a tagged request
+ * @return 0 if dropped, -EIO if it completed or the ARM did not answer
+ */
+static int warpdisk_abort_tagged(WarpDisk *wd, struct request *rq)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(wd->ctrlBase);
+	ulong irqFlags;
+	int rc;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdDiskAbort;
+	cmd->diskAbort.diskNr = wd->diskNr;
+	cmd->diskAbort.tag = rq->tag;
+	rc = warpdisk_status_cmd(wd);
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	return rc;
+}
+
+static WarpDisk *warpdisk_find(uint8_t diskNr)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(warpdisks); i++)
+		if (warpdisks[i].diskNr == diskNr && warpdisks[i].disk)
+			return &warpdisks[i];
+	return NULL;
+}
+
+/**
+ * @brief fetch tagged completions from ARM and end the requests
+ */
+static void warpdisk_cpl_work(struct work_struct *work)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(warpdisk_ctrl);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(warpdisk_ctrl);
+	DiskCompletion cpl[DISK_MAX_COMPLETIONS];
+	unsigned int i, cnt;
+	ulong irqFlags;
+	bool more;
+
+	do {
+		cnt = 0;
+		more = false;
+
+		spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+		cmd->header.cmd = dpcmdDiskGetCompletions;
+		cswarpSendMsgToArm(warpdisk_ctrl, true);
+		if (rpl->header.rpl == dprplDiskCompletions) {
+			cnt = min_t(unsigned int, rpl->diskCompletions.cnt, DISK_MAX_COMPLETIONS);
+			memcpy(cpl, (void*)rpl->diskCompletions.cpl, cnt * sizeof(DiskCompletion));
+			more = rpl->diskCompletions.more;
+		}
+		spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+		for (i = 0; i < cnt; i++) {
+			WarpDisk *wd = warpdisk_find(cpl[i].diskNr);
+			struct request *rq;
+			WarpDiskCmd *wc;
+
+			if (!wd || cpl[i].tag >= wd->tagSet.queue_depth)
+				continue;
+			rq = blk_mq_tag_to_rq(wd->tagSet.tags[0], cpl[i].tag);
+			if (!rq)
+				continue;
+
+			wc = blk_mq_rq_to_pdu(rq);
+			if (!wc->tagged)
+				continue;
+			wc->tagged = false;
+			dma_unmap_sg(wd->dmaDev, wc->sg, wc->sgMapped, rq_dma_dir(rq));
+			blk_mq_end_request(rq, cpl[i].status ? BLK_STS_IOERR : BLK_STS_OK);
+		}
+	} while (more);
+}
+static DECLARE_WORK(warpdisk_cpl, warpdisk_cpl_work);
+
+static irqreturn_t warpdisk_interrupt(int irq, void *data)
+{
+	volatile u32 __iomem *dp_reg_cr = cswarpDpRegCR(warpdisk_ctrl);
+
+	if ((*dp_reg_cr & DPREG_CR_IF_DISK) == 0)
+		return IRQ_NONE;
+
+	// clear before fetching, later completions raise it again
+	*dp_reg_cr = DPREG_CR_CLR | DPREG_CR_IF_DISK;
+	queue_work(warpdisk_wq, &warpdisk_cpl);
+	return IRQ_HANDLED;
+}
+
+// ############################################################################
+// blk-mq
+// ############################################################################
+
+static blk_status_t warpdisk_do_request(WarpDisk *wd, struct request *rq)
+{
+	bool write = rq_data_dir(rq) == WRITE;
+	sector_t block = blk_rq_pos(rq);
+	struct req_iterator iter;
+	struct bio_vec bvec;
+	blk_status_t status;
+	int rc;
+
+	switch (req_op(rq)) {
+	case REQ_OP_READ:
+	case REQ_OP_WRITE:
+		break;
+	case REQ_OP_FLUSH:
+		return warpdisk_cache_flush(wd) ? BLK_STS_IOERR : BLK_STS_OK;
+	case REQ_OP_DISCARD:
+		return errno_to_blk_status(warpdisk_discard(wd, block, blk_rq_sectors(rq)));
+	default:
+		return BLK_STS_NOTSUPP;
+	}
+
+	rq_for_each_bvec(bvec, rq, iter) {
+		rc = wd->dmaDev ? warpdisk_xfer_dma(wd, block, &bvec, write) : -ERANGE;
+		if (rc == -ERANGE)
+			status = warpdisk_xfer_pio(wd, block, &bvec, write);
+		else
+			status = errno_to_blk_status(rc);
+		if (status)
+			return status;
+
+		block += bvec.bv_len / DISK_BLOCKSIZE;
+		cond_resched();
+	}
+	return BLK_STS_OK;
+}
+
+static void warpdisk_work(struct work_struct *work)
+{
+	WarpDisk *wd = container_of(work, WarpDisk, work);
+	struct request *rq;
+
+	for (;;) {
+		spin_lock_irq(&wd->lock);
+		rq = list_first_entry_or_null(&wd->queue, struct request, queuelist);
+		if (rq)
+			list_del_init(&rq->queuelist);
+		spin_unlock_irq(&wd->lock);
+		if (!rq)
+			break;
+
+		blk_mq_end_request(rq, warpdisk_do_request(wd, rq));
+	}
+}
+
+static blk_status_t warpdisk_queue_rq(struct blk_mq_hw_ctx *hctx,
+				      const struct blk_mq_queue_data *bd)
+{
+	WarpDisk *wd = hctx->queue->queuedata;
+	struct request *rq = bd->rq;
+
+	blk_mq_start_request(rq);
+	((WarpDiskCmd *)blk_mq_rq_to_pdu(rq))->tagged = false;
+
+	if (warpdisk_tagged && warpdisk_queue_tagged(wd, rq) == 0)
+		return BLK_STS_OK;
+
+	spin_lock_irq(&wd->lock);
+	list_add_tail(&rq->queuelist, &wd->queue);
+	spin_unlock_irq(&wd->lock);
+
+	queue_work(warpdisk_wq, &wd->work);
+	return BLK_STS_OK;
+}
+
+/*
+ * A tagged request the ARM never completes is aborted and failed. If the
+ * ARM cannot drop it (completion already on its way, or no answer) it
+ * still owns the buffers, so the timer is restarted. Requests of the
+ * worker are always ended by the worker.
+ */
+static enum blk_eh_timer_return warpdisk_timeout(struct request *rq)
+{
+	WarpDisk *wd = rq->q->queuedata;
+	WarpDiskCmd *wc = blk_mq_rq_to_pdu(rq);
+
+	if (!wc->tagged)
+		return BLK_EH_RESET_TIMER;
+
+	// serialized with warpdisk_cpl_work, which ends tagged requests
+	flush_work(&warpdisk_cpl);
+	if (!wc->tagged)
+		return BLK_EH_DONE;
+	if (warpdisk_abort_tagged(wd, rq)) {
+		pr_warn_ratelimited("%s: tag %d timed out, ARM did not drop it\n",
+				    wd->name, rq->tag);
+		return BLK_EH_RESET_TIMER;
+	}
+
+	pr_warn("%s: tag %d timed out, aborted\n", wd->name, rq->tag);
+	wc->tagged = false;
+	dma_unmap_sg(wd->dmaDev, wc->sg, wc->sgMapped, rq_dma_dir(rq));
+	blk_mq_end_request(rq, BLK_STS_TIMEOUT);
+	return BLK_EH_DONE;
+}
+
+static const struct blk_mq_ops warpdisk_mq_ops = {
+	.queue_rq	= warpdisk_queue_rq,
+	.timeout	= warpdisk_timeout,
+};
+
+// called with disk->open_mutex held, so no open slips past a detach
+static int warpdisk_open(struct gendisk *disk, blk_mode_t mode)
+{
+	WarpDisk *wd = disk->private_data;
+
+	return wd->detaching ? -ENXIO : 0;
+}
+
+static const struct block_device_operations warpdisk_fops = {
+	.owner		= THIS_MODULE,
+	.open		= warpdisk_open,
+};
+
+// ############################################################################
+// sysfs
+// ############################################################################
+
+static WarpDisk *warpdisk_dev_disk(struct device *dev)
+{
+	return dev_to_disk(dev)->private_data;
+}
+
+static ssize_t cache_mode_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	WarpDisk *wd = warpdisk_dev_disk(dev);
+
+	return sysfs_emit(buf, "%s\n", warpdisk_cache_modes[wd->cacheMode]);
+}
+
+static ssize_t cache_mode_store(struct device *dev, struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	WarpDisk *wd = warpdisk_dev_disk(dev);
+	int mode, rc;
+
+	mode = sysfs_match_string(warpdisk_cache_modes, buf);
+	if (mode < 0)
+		return mode;
+
+	rc = warpdisk_set_cache(wd, mode);
+	return rc ? rc : count;
+}
+static DEVICE_ATTR_RW(cache_mode);
+
+#define WARPDISK_CACHE_STAT(_name, _field)					\
+static ssize_t _name##_show(struct device *dev,				\
+			    struct device_attribute *attr, char *buf)	\
+{										\
+	DprRplDiskCacheStats stats;						\
+										\
+	if (warpdisk_cache_stats(warpdisk_dev_disk(dev), &stats))		\
+		return -EIO;							\
+	return sysfs_emit(buf, "%u\n", stats._field);				\
+}										\
+static DEVICE_ATTR_RO(_name)
+
+WARPDISK_CACHE_STAT(read_hits, readHits);
+WARPDISK_CACHE_STAT(read_misses, readMisses);
+WARPDISK_CACHE_STAT(readahead_blocks, readaheadBlocks);
+WARPDISK_CACHE_STAT(write_blocks, writeBlocks);
+WARPDISK_CACHE_STAT(dirty_blocks, dirtyBlocks);
+WARPDISK_CACHE_STAT(flushes, flushes);
+
+static struct attribute *warpdisk_cache_attrs[] = {
+	&dev_attr_cache_mode.attr,
+	&dev_attr_read_hits.attr,
+	&dev_attr_read_misses.attr,
+	&dev_attr_readahead_blocks.attr,
+	&dev_attr_write_blocks.attr,
+	&dev_attr_dirty_blocks.attr,
+	&dev_attr_flushes.attr,
+	NULL
+};
+
+static umode_t warpdisk_cache_visible(struct kobject *kobj,
+				      struct attribute *attr, int n)
+{
+	WarpDisk *wd = warpdisk_dev_disk(kobj_to_dev(kobj));
+
+	return wd->diskNr == DISK_NR_RAM ? 0 : attr->mode;
+}
+
+static const struct attribute_group warpdisk_cache_group = {
+	.name		= "warpcache",
+	.attrs		= warpdisk_cache_attrs,
+	.is_visible	= warpdisk_cache_visible,
+};
+
+#define WARPDISK_RAM_STAT(_name, _expr)						\
+static ssize_t _name##_show(struct device *dev,				\
+			    struct device_attribute *attr, char *buf)	\
+{										\
+	DprRplDiskRamStats stats;						\
+										\
+	if (warpdisk_ram_stats(warpdisk_dev_disk(dev), &stats))			\
+		return -EIO;							\
+	return sysfs_emit(buf, "%u\n", _expr);					\
+}										\
+static DEVICE_ATTR_RO(_name)
+
+WARPDISK_RAM_STAT(used_kb, stats.usedBlocks / 2);
+WARPDISK_RAM_STAT(read_blocks, stats.readBlocks);
+WARPDISK_RAM_STAT(written_blocks, stats.writeBlocks);
+WARPDISK_RAM_STAT(discarded_blocks, stats.discardBlocks);
+WARPDISK_RAM_STAT(arm_free_kb, stats.armFreeKB);
+
+static ssize_t size_kb_show(struct device *dev,
+			    struct device_attribute *attr, char *buf)
+{
+	return sysfs_emit(buf, "%llu\n",
+			  (unsigned long long)get_capacity(dev_to_disk(dev)) / 2);
+}
+static DEVICE_ATTR_RO(size_kb);
+
+static struct attribute *warpdisk_ram_attrs[] = {
+	&dev_attr_size_kb.attr,
+	&dev_attr_used_kb.attr,
+	&dev_attr_read_blocks.attr,
+	&dev_attr_written_blocks.attr,
+	&dev_attr_discarded_blocks.attr,
+	&dev_attr_arm_free_kb.attr,
+	NULL
+};
+
+static umode_t warpdisk_ram_visible(struct kobject *kobj,
+				    struct attribute *attr, int n)
+{
+	WarpDisk *wd = warpdisk_dev_disk(kobj_to_dev(kobj));
+
+	return wd->diskNr == DISK_NR_RAM ? attr->mode : 0;
+}
+
+static const struct attribute_group warpdisk_ram_group = {
+	.name		= "warpram",
+	.attrs		= warpdisk_ram_attrs,
+	.is_visible	= warpdisk_ram_visible,
+};
+
+static const struct attribute_group *warpdisk_attr_groups[] = {
+	&warpdisk_cache_group,
+	&warpdisk_ram_group,
+	NULL
+};
+
+// ############################################################################
+// init
+// ############################################################################
+
+static void warpdisk_free_sg(WarpDisk *wd)
+{
+	if (!wd->sgTable)
+		return;
+	dma_free_coherent(wd->dmaDev, queue_depth * DISK_MAX_SG * sizeof(DiskSgEntry),
+			  wd->sgTable, wd->sgTableDma);
+	wd->sgTable = NULL;
+}
+
+static void warpdisk_setup(WarpDisk *wd)
+{
+	wd->ctrlBase = (void __iomem *)warpdisk_zdev->resource.start;
+	if (dma)
+		wd->dmaDev = &warpdisk_zdev->dev;
+	spin_lock_init(&wd->lock);
+	mutex_init(&wd->cacheMutex);
+	INIT_LIST_HEAD(&wd->queue);
+	INIT_WORK(&wd->work, warpdisk_work);
+}
+
+static int warpdisk_add(WarpDisk *wd, sector_t blocks, bool readOnly)
+{
+	struct queue_limits lim = {
+		.logical_block_size	= DISK_BLOCKSIZE,
+		.max_hw_sectors		= 256,
+		.max_segments		= DISK_MAX_SG,
+	};
+	struct gendisk *disk;
+	int rc;
+
+	// swap discards whole pages
+	if (wd->diskNr == DISK_NR_RAM) {
+		lim.max_hw_discard_sectors = UINT_MAX;
+		lim.discard_granularity = PAGE_SIZE;
+	}
+
+	if (warpdisk_tagged) {
+		wd->sgTable = dma_alloc_coherent(wd->dmaDev,
+					queue_depth * DISK_MAX_SG * sizeof(DiskSgEntry),
+					&wd->sgTableDma, GFP_KERNEL);
+		if (!wd->sgTable)
+			return -ENOMEM;
+		// read by ARM DMA
+		if (!warpdisk_ddr_ok(wd->sgTableDma,
+				     queue_depth * DISK_MAX_SG * sizeof(DiskSgEntry))) {
+			pr_err("%s: scatter lists out of ARM reach\n", wd->name);
+			warpdisk_free_sg(wd);
+			return -ENODEV;
+		}
+	}
+
+	// without tags the worker handles one request after the other
+	wd->tagSet.ops = &warpdisk_mq_ops;
+	wd->tagSet.nr_hw_queues = 1;
+	wd->tagSet.queue_depth = warpdisk_tagged ? queue_depth : 16;
+	wd->tagSet.numa_node = NUMA_NO_NODE;
+	wd->tagSet.cmd_size = sizeof(WarpDiskCmd);
+	wd->tagSet.flags = BLK_MQ_F_SHOULD_MERGE;
+	rc = blk_mq_alloc_tag_set(&wd->tagSet);
+	if (rc)
+		goto out_free_sg;
+
+	disk = blk_mq_alloc_disk(&wd->tagSet, &lim, wd);
+	if (IS_ERR(disk)) {
+		rc = PTR_ERR(disk);
+		goto out_free_tags;
+	}
+
+	disk->major = warpdisk_major;
+	disk->first_minor = wd->diskNr * WARPDISK_MINORS;
+	disk->minors = WARPDISK_MINORS;
+	disk->fops = &warpdisk_fops;
+	disk->private_data = wd;
+	strscpy(disk->disk_name, wd->name, DISK_NAME_LEN);
+	set_capacity(disk, blocks);
+	set_disk_ro(disk, readOnly);
+	blk_queue_flag_set(QUEUE_FLAG_NONROT, disk->queue);
+
+	// tagged completions are looked up through wd->disk
+	wd->disk = disk;
+	wd->cacheMode = DISK_CACHE_OFF;
+	wd->detaching = false;
+
+	if (cache != DISK_CACHE_OFF && wd->diskNr != DISK_NR_RAM &&
+	    warpdisk_set_cache(wd, clamp(cache, DISK_CACHE_OFF, DISK_CACHE_WRITEBACK)))
+		pr_warn("%s: ARM cache not available\n", wd->name);
+
+	rc = device_add_disk(&warpdisk_zdev->dev, disk, warpdisk_attr_groups);
+	if (rc)
+		goto out_put_disk;
+
+	pr_info("%s: %llu blocks (%llu MB)%s\n", wd->name,
+		(unsigned long long)blocks, (unsigned long long)blocks >> 11,
+		readOnly ? ", read-only" : "");
+	return 0;
+
+out_put_disk:
+	wd->disk = NULL;
+	put_disk(disk);
+out_free_tags:
+	blk_mq_free_tag_set(&wd->tagSet);
+out_free_sg:
+	warpdisk_free_sg(wd);
+	return rc;
+}
+
+static void warpdisk_del(WarpDisk *wd)
+{
+	if (!wd->disk)
+		return;
+	del_gendisk(wd->disk);
+	if (wd->cacheMode == DISK_CACHE_WRITEBACK)
+		warpdisk_cache_flush(wd);
+	put_disk(wd->disk);
+	blk_mq_free_tag_set(&wd->tagSet);
+	warpdisk_free_sg(wd);
+	wd->disk = NULL;
+}
+
+// ############################################################################
+// image control device
+// ############################################################################
+
+static WarpDisk *warpdisk_img_slot(u32 slot)
+{
+	if (slot >= DISK_NR_IMAGES)
+		return NULL;
+	// warpdisks[] is indexed by diskNr
+	return &warpdisks[DISK_NR_IMAGE_FIRST + slot];
+}
+
+static int warpdisk_img_attach(struct warpdisk_img *img)
+{
+	WarpDisk *wd = warpdisk_img_slot(img->slot);
+	bool readOnly = img->flags & WARPDISK_IMG_RDONLY;
+	sector_t blocks;
+	int rc;
+
+	if (!wd)
+		return -EINVAL;
+	img->path[WARPDISK_IMG_PATH_LEN - 1] = 0;
+	if (wd->disk)
+		return -EBUSY;
+
+	blocks = warpdisk_image_open(wd, img->path, &readOnly);
+	if (!blocks)
+		return -ENOENT;
+
+	strscpy(wd->imgPath, img->path, sizeof(wd->imgPath));
+	wd->imgReadOnly = readOnly;
+	rc = warpdisk_add(wd, blocks, readOnly);
+	if (rc) {
+		warpdisk_image_close(wd);
+		return rc;
+	}
+
+	img->blocks = blocks;
+	img->flags = readOnly ? WARPDISK_IMG_RDONLY : 0;
+	return 0;
+}
+
+static int warpdisk_img_detach(u32 slot)
+{
+	WarpDisk *wd = warpdisk_img_slot(slot);
+
+	if (!wd)
+		return -EINVAL;
+	if (!wd->disk)
+		return -ENXIO;
+
+	// like loop's LOOP_CLR_FD: check openers and block new ones atomically,
+	// del_gendisk then drains I/O before the tag set goes away
+	mutex_lock(&wd->disk->open_mutex);
+	if (disk_openers(wd->disk)) {
+		mutex_unlock(&wd->disk->open_mutex);
+		return -EBUSY;
+	}
+	wd->detaching = true;
+	mutex_unlock(&wd->disk->open_mutex);
+
+	warpdisk_del(wd);
+	return warpdisk_image_close(wd);
+}
+
+static void warpdisk_img_status(struct warpdisk_img *img)
+{
+	WarpDisk *wd = warpdisk_img_slot(img->slot);
+
+	img->flags = 0;
+	img->blocks = 0;
+	memset(img->path, 0, sizeof(img->path));
+	if (!wd || !wd->disk)
+		return;
+
+	img->flags = WARPDISK_IMG_ATTACHED;
+	if (wd->imgReadOnly)
+		img->flags |= WARPDISK_IMG_RDONLY;
+	img->blocks = get_capacity(wd->disk);
+	strscpy(img->path, wd->imgPath, sizeof(img->path));
+}
+
+static long warpdisk_ctl_ioctl(struct file *file, unsigned int ioctlCmd,
+			       unsigned long arg)
+{
+	void __user *argp = (void __user *)arg;
+	struct warpdisk_img img;
+	u32 slot;
+	int rc;
+
+	mutex_lock(&warpdisk_img_mutex);
+	switch (ioctlCmd) {
+	case WARPDISK_IMG_ATTACH:
+		if (copy_from_user(&img, argp, sizeof(img))) {
+			rc = -EFAULT;
+			break;
+		}
+		rc = warpdisk_img_attach(&img);
+		if (rc == 0 && copy_to_user(argp, &img, sizeof(img)))
+			rc = -EFAULT;
+		break;
+	case WARPDISK_IMG_DETACH:
+		if (get_user(slot, (u32 __user *)argp)) {
+			rc = -EFAULT;
+			break;
+		}
+		rc = warpdisk_img_detach(slot);
+		break;
+	case WARPDISK_IMG_STATUS:
+		if (copy_from_user(&img, argp, sizeof(img))) {
+			rc = -EFAULT;
+			break;
+		}
+		if (img.slot >= DISK_NR_IMAGES) {
+			rc = -EINVAL;
+			break;
+		}
+		warpdisk_img_status(&img);
+		rc = copy_to_user(argp, &img, sizeof(img)) ? -EFAULT : 0;
+		break;
+	default:
+		rc = -ENOTTY;
+		break;
+	}
+	mutex_unlock(&warpdisk_img_mutex);
+
+	return rc;
+}
+
+static const struct file_operations warpdisk_ctl_fops = {
+	.owner		= THIS_MODULE,
+	.unlocked_ioctl	= warpdisk_ctl_ioctl,
+	.compat_ioctl	= compat_ptr_ioctl,
+	.llseek		= noop_llseek,
+};
+
+static struct miscdevice warpdisk_ctl = {
+	.minor	= MISC_DYNAMIC_MINOR,
+	.name	= "warpdisk-ctl",
+	.fops	= &warpdisk_ctl_fops,
+};
+
+static void warpdisk_irq_off(void)
+{
+	if (!warpdisk_tagged)
+		return;
+	*cswarpDpRegCR(warpdisk_ctrl) = DPREG_CR_CLR | DPREG_CR_IE_DISK;
+	free_irq(IRQ_AMIGA_PORTS, warpdisks);
+	cancel_work_sync(&warpdisk_cpl);
+	warpdisk_tagged = false;
+}
+
+static int __init warpdisk_init(void)
+{
+	struct zorro_dev *z;
+	sector_t blocks;
+	int i, rc;
+
+	z = zorro_find_device(ZORRO_PROD_CSLAB_WARP_CTRL, NULL);
+	if (!z)
+		return -ENODEV;
+
+	if (dma && dma_set_mask_and_coherent(&z->dev, DMA_BIT_MASK(32))) {
+		pr_warn("%s: no usable DMA mask, using dpRAM copy\n", DRV_NAME);
+		dma = false;
+	}
+	if (dma) {
+		struct zorro_dev *ddr = zorro_find_device(ZORRO_PROD_CSLAB_WARP_DDR3, NULL);
+
+		if (ddr) {
+			warpdisk_ddr = &ddr->resource;
+		} else {
+			pr_warn("%s: Warp DDR3 not found, using dpRAM copy\n", DRV_NAME);
+			dma = false;
+		}
+	}
+	warpdisk_ctrl = (void __iomem *)z->resource.start;
+	warpdisk_zdev = z;
+
+	warpdisk_major = register_blkdev(0, DRV_NAME);
+	if (warpdisk_major < 0)
+		return warpdisk_major;
+
+	warpdisk_wq = alloc_workqueue(DRV_NAME, WQ_UNBOUND | WQ_MEM_RECLAIM, 0);
+	if (!warpdisk_wq) {
+		unregister_blkdev(warpdisk_major, DRV_NAME);
+		return -ENOMEM;
+	}
+
+	if (queue_depth > 1 && !dma) {
+		pr_warn("%s: tagged requests need DMA, queue depth 1\n", DRV_NAME);
+		queue_depth = 1;
+	}
+	queue_depth = clamp(queue_depth, 1, DISK_MAX_TAGS);
+	// partition scan in add_disk() already needs completions
+	if (queue_depth > 1) {
+		if (request_irq(IRQ_AMIGA_PORTS, warpdisk_interrupt, IRQF_SHARED,
+				DRV_NAME, warpdisks)) {
+			pr_warn("%s: can't get irq, queue depth 1\n", DRV_NAME);
+			queue_depth = 1;
+		} else {
+			*cswarpDpRegCR(warpdisk_ctrl) = DPREG_CR_CLR | DPREG_CR_IF_DISK;
+			*cswarpDpRegCR(warpdisk_ctrl) = DPREG_CR_SET | DPREG_CR_IE_DISK;
+			warpdisk_tagged = true;
+		}
+	}
+
+	for (i = 0; i < ARRAY_SIZE(warpdisks); i++)
+		warpdisk_setup(&warpdisks[i]);
+
+	// SD card and USB disk, images are attached later
+	for (i = DISK_NR_SD; i <= DISK_NR_USB; i++) {
+		blocks = warpdisk_get_info(&warpdisks[i]);
+		if (blocks)
+			warpdisk_add(&warpdisks[i], blocks, false);
+		else
+			pr_info("%s: no medium\n", warpdisks[i].name);
+	}
+
+	if (ram_mb > 0) {
+		WarpDisk *wd = &warpdisks[DISK_NR_RAM];
+
+		blocks = warpdisk_ram_setup(wd, ram_mb * 1024);
+		if (blocks && warpdisk_add(wd, blocks, false))
+			warpdisk_ram_setup(wd, 0);
+		else if (!blocks)
+			pr_warn("%s: no ARM RAM available\n", wd->name);
+	}
+
+	rc = misc_register(&warpdisk_ctl);
+	if (rc)
+		pr_warn("%s: can't register %s, no image support\n",
+			DRV_NAME, warpdisk_ctl.name);
+	return 0;
+}
+
+static void __exit warpdisk_exit(void)
+{
+	int i;
+
+	if (warpdisk_ctl.this_device)
+		misc_deregister(&warpdisk_ctl);
+	for (i = 0; i < ARRAY_SIZE(warpdisks); i++) {
+		if (!warpdisks[i].disk)
+			continue;
+		warpdisk_del(&warpdisks[i]);
+		if (warpdisks[i].diskNr == DISK_NR_RAM)
+			warpdisk_ram_setup(&warpdisks[i], 0);
+		else if (warpdisks[i].diskNr >= DISK_NR_IMAGE_FIRST)
+			warpdisk_image_close(&warpdisks[i]);
+	}
+	warpdisk_irq_off();
+	destroy_workqueue(warpdisk_wq);
+	unregister_blkdev(warpdisk_major, DRV_NAME);
+}
+
+module_init(warpdisk_init);
+module_exit(warpdisk_exit);
+
+MODULE_AUTHOR("Andrzej Rogozynski");
+MODULE_DESCRIPTION("csWarp SD card / USB mass storage driver");
+MODULE_LICENSE("GPL v2");
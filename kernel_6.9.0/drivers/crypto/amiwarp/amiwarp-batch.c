@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  drivers/crypto/amiwarp/amiwarp-batch.c -- csWarp ARM job batches
+ *
+ *      Copyright (C) 2024 Andrzej Rogozynski
+ *
+ *  Submit, wait and interrupt part of dpcmdCompBatch and
+ *  dpcmdCryptoBatch, shared by amiwarp-comp and amiwarp-cipher. The
+ *  drivers fill the job table, the ARM works through it while the
+ *  submitter sleeps.
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of this archive for
+ *  more details.
+ */
+
+#include <linux/interrupt.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/spinlock.h>
+
+#include <asm/amigaints.h>
+
+#include "amiwarp-batch.h"
+
+// a batch of 16 x 128 KB takes well below that
+#define WARPBATCH_TIMEOUT	(5 * HZ)
+
+// both commands and replies share one layout
+static_assert(sizeof(DprCmdCompBatch) == sizeof(DprCmdCryptoBatch));
+static_assert(offsetof(DprCmdCompBatch, tableDdrAddr) ==
+	      offsetof(DprCmdCryptoBatch, tableDdrAddr));
+static_assert(offsetof(DprCmdCompBatch, cnt) == offsetof(DprCmdCryptoBatch, cnt));
+static_assert(offsetof(DprRplCompBatch, success) ==
+	      offsetof(DprRplCryptoBatch, success));
+
+/**
+ * @brief post the batch command
+ * @param timeoutUs 0: wait for the reply as long as it takes
+ * @return true if the ARM accepted the batch
+ */
+static bool warpbatch_post(WarpBatch *wb, unsigned int cnt, unsigned int timeoutUs)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(wb->ctrlBase);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(wb->ctrlBase);
+	uint32_t rplId = wb->cmd == dpcmdCompBatch ? dprplCompBatch : dprplCryptoBatch;
+	WarpAmiCommStatus status;
+	ulong irqFlags;
+	bool ok;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = wb->cmd;
+	cmd->compBatch.tableDdrAddr = wb->tableDma;
+	cmd->compBatch.cnt = cnt;
+	if (timeoutUs)
+		status = cswarpSendMsgToArmTimeout(wb->ctrlBase, true, timeoutUs);
+	else
+		status = cswarpSendMsgToArm(wb->ctrlBase, true);
+	ok = status == wacOK && rpl->header.rpl == rplId && rpl->compBatch.success;
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	return ok;
+}
+
+/**
+ * @brief empty batch. Older ARM firmware does not know the command and
+ *        never answers, so the wait is bounded.
+ */
+bool warpbatch_probe(WarpBatch *wb)
+{
+	return warpbatch_post(wb, 0, CSWARP_PROBE_TIMEOUT_US);
+}
+EXPORT_SYMBOL(warpbatch_probe);
+
+/**
+ * @brief hand the batch table to the ARM and sleep until it is done
+ * @return true if the ARM processed the table
+ */
+bool warpbatch_send(WarpBatch *wb, unsigned int cnt)
+{
+	reinit_completion(&wb->done);
+	if (!warpbatch_post(wb, cnt, 0))
+		return false;
+
+	// the ARM owns the buffers until it is done, never give them back early
+	while (!wait_for_completion_timeout(&wb->done, WARPBATCH_TIMEOUT))
+		pr_warn_ratelimited("%s: ARM batch of %u overdue\n", wb->name, cnt);
+	return true;
+}
+EXPORT_SYMBOL(warpbatch_send);
+
+static irqreturn_t warpbatch_interrupt(int irq, void *data)
+{
+	WarpBatch *wb = data;
+	volatile u32 __iomem *dp_reg_cr = cswarpDpRegCR(wb->ctrlBase);
+
+	if ((*dp_reg_cr & wb->irqFlag) == 0)
+		return IRQ_NONE;
+
+	*dp_reg_cr = DPREG_CR_CLR | wb->irqFlag;
+	complete(&wb->done);
+	return IRQ_HANDLED;
+}
+
+/**
+ * @brief hook up the batch done interrupt
+ */
+int warpbatch_irq_init(WarpBatch *wb)
+{
+	int rc;
+
+	init_completion(&wb->done);
+	rc = request_irq(IRQ_AMIGA_PORTS, warpbatch_interrupt, IRQF_SHARED,
+			 wb->name, wb);
+	if (rc)
+		return rc;
+	*cswarpDpRegCR(wb->ctrlBase) = DPREG_CR_CLR | wb->irqFlag;
+	*cswarpDpRegCR(wb->ctrlBase) = DPREG_CR_SET | wb->irqEnable;
+	return 0;
+}
+EXPORT_SYMBOL(warpbatch_irq_init);
+
+void warpbatch_irq_exit(WarpBatch *wb)
+{
+	*cswarpDpRegCR(wb->ctrlBase) = DPREG_CR_CLR | wb->irqEnable;
+	free_irq(IRQ_AMIGA_PORTS, wb);
+}
+EXPORT_SYMBOL(warpbatch_irq_exit);
+
+MODULE_AUTHOR("Andrzej Rogozynski");
+MODULE_DESCRIPTION("csWarp ARM job batches");
+MODULE_LICENSE("GPL v2");
@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ *  drivers/crypto/amiwarp/amiwarp-batch.h -- csWarp ARM job batches
+ *
+ *      Copyright (C) 2024 Andrzej Rogozynski
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of this archive for
+ *  more details.
+ */
+
+#ifndef AMIWARP_BATCH_H
+#define AMIWARP_BATCH_H
+
+#include <linux/completion.h>
+#include <linux/types.h>
+
+#include <asm/cswarpamicomm.h>
+
+/*
+ * A table of jobs in DDR handed to the ARM with one mailbox command
+ * (dpcmdCompBatch, dpcmdCryptoBatch). The ARM acknowledges at once and
+ * raises its DPREG_CR_IF_xxx bit when all jobs are done.
+ */
+typedef struct {
+	const char *name;		// for messages
+	void __iomem *ctrlBase;
+	uint32_t cmd;			// dpcmdXxxBatch
+	u32 irqEnable;			// DPREG_CR_IE_xxx
+	u32 irqFlag;			// DPREG_CR_IF_xxx
+	dma_addr_t tableDma;
+	struct completion done;
+} WarpBatch;
+
+bool warpbatch_probe(WarpBatch *wb);
+bool warpbatch_send(WarpBatch *wb, unsigned int cnt);
+int warpbatch_irq_init(WarpBatch *wb);
+void warpbatch_irq_exit(WarpBatch *wb);
+
+#endif // AMIWARP_BATCH_H
@@ -0,0 +1,984 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  drivers/crypto/amiwarp/amiwarp-cipher.c -- AES/SHA by the csWarp ARM
+ *
+ *      Copyright (C) 2024 Andrzej Rogozynski
+ *
+ *  TLS and ssh are bound by AES and SHA on the 68060. The ARM provides:
+ *
+ *    skcipher  cbc(aes), ctr(aes)
+ *    aead      gcm(aes)
+ *    ahash     sha1, sha256, hmac(sha1), hmac(sha256)
+ *
+ *  registered as xxx-warp above the generic code, so they are also used
+ *  through AF_ALG (OpenSSL afalg engine).
+ *
+ *  Requests are asynchronous. A worker hands up to CRYPTO_MAX_BATCH of
+ *  them to the ARM in one dpcmdCryptoBatch and sleeps until
+ *  DPREG_CR_IF_CRYPTO says the ARM is done. Key, IV and hash state go
+ *  through a slot next to the batch table, data that sits in one segment
+ *  is mapped where it is, anything else is copied once into a bounce
+ *  buffer. Hash state stays on the Amiga side between requests, so
+ *  export and import are plain copies.
+ *
+ *  Jobs the ARM cannot take (out of its reach, refused by the firmware)
+ *  are done by the generic code, so the high priority never costs a
+ *  request.
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of this archive for
+ *  more details.
+ */
+
+#include <crypto/aes.h>
+#include <crypto/gcm.h>
+#include <crypto/hash.h>
+#include <crypto/internal/aead.h>
+#include <crypto/internal/hash.h>
+#include <crypto/internal/skcipher.h>
+#include <crypto/sha1.h>
+#include <crypto/sha2.h>
+#include <linux/dma-mapping.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/scatterlist.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/zorro.h>
+
+#include <asm/cswarpamicomm.h>
+
+#include "amiwarp-batch.h"
+
+#define DRV_NAME	"amiwarp-cipher"
+
+#define WARPCRYPT_PRIORITY	300
+
+enum {
+	WARPCRYPT_SKCIPHER,
+	WARPCRYPT_AEAD,
+	WARPCRYPT_AHASH,
+};
+
+// tfm context
+typedef struct {
+	uint8_t algo;			// CRYPTO_ALGO_xxx
+	uint8_t keyLen;
+	uint8_t key[CRYPTO_MAX_KEY];
+	union {				// generic code, for jobs the ARM cannot do
+		struct crypto_skcipher *skcipher;
+		struct crypto_aead *aead;
+		struct crypto_shash *hash;
+	} fb;
+} WarpCryptCtx;
+
+// per job part of the batch, next to the table
+typedef struct {
+	uint8_t key[CRYPTO_MAX_KEY];
+	uint8_t iv[AES_BLOCK_SIZE];
+	CryptoHashState state;
+	uint8_t digest[SHA256_DIGEST_SIZE];
+} WarpCryptSlot;
+
+// read and written by ARM
+typedef struct {
+	CryptoBatchEntry ent[CRYPTO_MAX_BATCH];
+	WarpCryptSlot slot[CRYPTO_MAX_BATCH];
+} WarpCryptBatch;
+
+// request context, the fallback request follows it
+typedef struct {
+	struct list_head list;
+	struct crypto_async_request *areq;
+	uint8_t type;			// WARPCRYPT_xxx
+	uint8_t flags;			// CRYPTO_FLAG_xxx
+	bool split;			// src and dst mapped on their own
+	void *bounce;			// data copy, NULL if mapped where it is
+	unsigned int inLen;
+	unsigned int outLen;
+	dma_addr_t srcDma;
+	dma_addr_t dstDma;
+	CryptoHashState state;		// ahash
+	uint8_t fbReq[] __aligned(CRYPTO_MINALIGN);
+} WarpCryptReq;
+
+// generic sha1/sha256 export format, see CryptoHashState
+typedef union {
+	struct sha1_state sha1;
+	struct sha256_state sha256;
+} WarpCryptSwState;
+
+static struct device *warpcrypt_dmadev;
+
+// Warp DDR3 as seen by the 68k
+static struct resource *warpcrypt_ddr;
+
+// requests waiting for the batch worker
+static LIST_HEAD(warpcrypt_queue);
+static DEFINE_SPINLOCK(warpcrypt_queue_lock);
+
+static WarpCryptBatch *warpcrypt_batch;
+static dma_addr_t warpcrypt_batchDma;
+
+static WarpBatch warpcrypt_wb = {
+	.name		= DRV_NAME,
+	.cmd		= dpcmdCryptoBatch,
+	.irqEnable	= DPREG_CR_IE_CRYPTO,
+	.irqFlag	= DPREG_CR_IF_CRYPTO,
+};
+
+// ############################################################################
+// job data
+// ############################################################################
+
+static int warpcrypt_status(uint8_t status)
+{
+	switch (status) {
+	case CRYPTO_STATUS_OK:
+		return 0;
+	case CRYPTO_STATUS_BADTAG:
+		return -EBADMSG;
+	default:
+		return -EIO;
+	}
+}
+
+static bool warpcrypt_reach(dma_addr_t dma, unsigned int len)
+{
+	return warpcrypt_ddr && dma >= warpcrypt_ddr->start &&
+	       dma + len - 1 <= warpcrypt_ddr->end;
+}
+
+static bool warpcrypt_map_page(struct page *page, unsigned int offset, unsigned int len,
+			       enum dma_data_direction dir, dma_addr_t *dma)
+{
+	*dma = dma_map_page(warpcrypt_dmadev, page, offset, len, dir);
+	if (dma_mapping_error(warpcrypt_dmadev, *dma))
+		return false;
+	if (warpcrypt_reach(*dma, len))
+		return true;
+	dma_unmap_page(warpcrypt_dmadev, *dma, len, dir);
+	return false;
+}
+
+/**
+ * @brief map the data for the ARM, bounce only what is scattered or out of reach
+ * @return -ERANGE if even the bounce buffer is out of ARM reach
+ */
+static int warpcrypt_map(WarpCryptReq *wr, struct scatterlist *src,
+			 struct scatterlist *dst)
+{
+	unsigned int room = max(wr->inLen, wr->outLen);
+
+	wr->split = false;
+	wr->bounce = NULL;
+	if (!room)
+		return 0;
+
+	if ((src == dst || !wr->outLen) && src->length >= room) {
+		if (warpcrypt_map_page(sg_page(src), src->offset, room,
+				       DMA_BIDIRECTIONAL, &wr->srcDma)) {
+			wr->dstDma = wr->srcDma;
+			return 0;
+		}
+	} else if (wr->outLen && src->length >= wr->inLen && dst->length >= wr->outLen) {
+		if (warpcrypt_map_page(sg_page(src), src->offset, wr->inLen,
+				       DMA_TO_DEVICE, &wr->srcDma)) {
+			if (warpcrypt_map_page(sg_page(dst), dst->offset, wr->outLen,
+					       DMA_FROM_DEVICE, &wr->dstDma)) {
+				wr->split = true;
+				return 0;
+			}
+			dma_unmap_page(warpcrypt_dmadev, wr->srcDma, wr->inLen, DMA_TO_DEVICE);
+		}
+	}
+
+	wr->bounce = kmalloc(room, GFP_KERNEL);
+	if (!wr->bounce)
+		return -ENOMEM;
+	sg_copy_to_buffer(src, sg_nents(src), wr->bounce, wr->inLen);
+	if (warpcrypt_map_page(virt_to_page(wr->bounce), offset_in_page(wr->bounce), room,
+			       DMA_BIDIRECTIONAL, &wr->srcDma)) {
+		wr->dstDma = wr->srcDma;
+		return 0;
+	}
+	kfree(wr->bounce);
+	wr->bounce = NULL;
+	pr_warn_ratelimited("%s: buffer out of ARM reach\n", DRV_NAME);
+	return -ERANGE;
+}
+
+static void warpcrypt_unmap(WarpCryptReq *wr)
+{
+	unsigned int room = max(wr->inLen, wr->outLen);
+
+	if (!room)
+		return;
+	if (wr->split) {
+		dma_unmap_page(warpcrypt_dmadev, wr->srcDma, wr->inLen, DMA_TO_DEVICE);
+		dma_unmap_page(warpcrypt_dmadev, wr->dstDma, wr->outLen, DMA_FROM_DEVICE);
+	} else {
+		dma_unmap_page(warpcrypt_dmadev, wr->srcDma, room, DMA_BIDIRECTIONAL);
+	}
+}
+
+/**
+ * @brief map a request and fill in batch entry and slot i
+ */
+static int warpcrypt_prepare(WarpCryptReq *wr, unsigned int i)
+{
+	WarpCryptCtx *ctx = crypto_tfm_ctx(wr->areq->tfm);
+	CryptoBatchEntry *ent = &warpcrypt_batch->ent[i];
+	WarpCryptSlot *slot = &warpcrypt_batch->slot[i];
+	dma_addr_t slotDma = warpcrypt_batchDma + offsetof(WarpCryptBatch, slot) +
+			     i * sizeof(*slot);
+	struct scatterlist *src = NULL, *dst = NULL;
+	int rc;
+
+	memset(ent, 0, sizeof(*ent));
+	wr->inLen = wr->outLen = 0;
+
+	switch (wr->type) {
+	case WARPCRYPT_SKCIPHER: {
+		struct skcipher_request *req = skcipher_request_cast(wr->areq);
+
+		src = req->src;
+		dst = req->dst;
+		wr->inLen = wr->outLen = req->cryptlen;
+		ent->len = req->cryptlen;
+		memcpy(slot->iv, req->iv, AES_BLOCK_SIZE);
+		break;
+	}
+	case WARPCRYPT_AEAD: {
+		struct aead_request *req = aead_request_cast(wr->areq);
+		unsigned int authsize = crypto_aead_authsize(crypto_aead_reqtfm(req));
+
+		src = req->src;
+		dst = req->dst;
+		wr->inLen = req->assoclen + req->cryptlen;
+		ent->len = req->cryptlen;
+		if (wr->flags & CRYPTO_FLAG_DECRYPT) {
+			wr->outLen = wr->inLen - authsize;
+			ent->len -= authsize;
+		} else {
+			wr->outLen = wr->inLen + authsize;
+		}
+		ent->assocLen = req->assoclen;
+		ent->tagLen = authsize;
+		memcpy(slot->iv, req->iv, GCM_AES_IV_SIZE);
+		break;
+	}
+	case WARPCRYPT_AHASH: {
+		struct ahash_request *req = ahash_request_cast(wr->areq);
+
+		if (wr->flags & CRYPTO_FLAG_HASH_UPDATE) {
+			src = req->src;
+			wr->inLen = req->nbytes;
+			ent->len = req->nbytes;
+		}
+		slot->state = wr->state;
+		break;
+	}
+	}
+
+	rc = warpcrypt_map(wr, src, dst);
+	if (rc)
+		return rc;
+
+	memcpy(slot->key, ctx->key, ctx->keyLen);
+	ent->algo = ctx->algo;
+	ent->flags = wr->flags;
+	ent->keyLen = ctx->keyLen;
+	ent->keyDdrAddr = slotDma + offsetof(WarpCryptSlot, key);
+	ent->ivDdrAddr = slotDma + offsetof(WarpCryptSlot, iv);
+	ent->stateDdrAddr = slotDma + offsetof(WarpCryptSlot, state);
+	ent->srcDdrAddr = wr->srcDma;
+	ent->dstDdrAddr = wr->type == WARPCRYPT_AHASH ?
+		slotDma + offsetof(WarpCryptSlot, digest) : wr->dstDma;
+	return 0;
+}
+
+/**
+ * @brief copy the results of slot i back to the request
+ */
+static void warpcrypt_results(WarpCryptReq *wr, unsigned int i)
+{
+	WarpCryptSlot *slot = &warpcrypt_batch->slot[i];
+
+	switch (wr->type) {
+	case WARPCRYPT_SKCIPHER: {
+		struct skcipher_request *req = skcipher_request_cast(wr->areq);
+
+		if (wr->bounce)
+			sg_copy_from_buffer(req->dst, sg_nents(req->dst), wr->bounce,
+					    wr->outLen);
+		// next IV for chained requests
+		memcpy(req->iv, slot->iv, AES_BLOCK_SIZE);
+		break;
+	}
+	case WARPCRYPT_AEAD: {
+		struct aead_request *req = aead_request_cast(wr->areq);
+
+		if (wr->bounce)
+			sg_copy_from_buffer(req->dst, sg_nents(req->dst), wr->bounce,
+					    wr->outLen);
+		break;
+	}
+	case WARPCRYPT_AHASH: {
+		struct ahash_request *req = ahash_request_cast(wr->areq);
+
+		wr->state = slot->state;
+		if (wr->flags & CRYPTO_FLAG_HASH_FINAL)
+			memcpy(req->result, slot->digest,
+			       crypto_ahash_digestsize(crypto_ahash_reqtfm(req)));
+		break;
+	}
+	}
+}
+
+static void warpcrypt_complete(WarpCryptReq *wr, int rc)
+{
+	local_bh_disable();
+	crypto_request_complete(wr->areq, rc);
+	local_bh_enable();
+}
+
+// ############################################################################
+// fallback
+// ############################################################################
+
+static bool warpcrypt_is_sha1(uint8_t algo)
+{
+	return algo == CRYPTO_ALGO_SHA1 || algo == CRYPTO_ALGO_HMAC_SHA1;
+}
+
+static void warpcrypt_state_to_sw(uint8_t algo, const CryptoHashState *st,
+				  WarpCryptSwState *sw)
+{
+	u64 count = ((u64)st->countHi << 32) | st->countLo;
+
+	if (warpcrypt_is_sha1(algo)) {
+		memcpy(sw->sha1.state, st->h, sizeof(sw->sha1.state));
+		sw->sha1.count = count;
+		memcpy(sw->sha1.buffer, st->buf, sizeof(sw->sha1.buffer));
+	} else {
+		memcpy(sw->sha256.state, st->h, sizeof(sw->sha256.state));
+		sw->sha256.count = count;
+		memcpy(sw->sha256.buf, st->buf, sizeof(sw->sha256.buf));
+	}
+}
+
+static void warpcrypt_state_from_sw(uint8_t algo, const WarpCryptSwState *sw,
+				    CryptoHashState *st)
+{
+	u64 count;
+
+	memset(st, 0, sizeof(*st));
+	if (warpcrypt_is_sha1(algo)) {
+		memcpy(st->h, sw->sha1.state, sizeof(sw->sha1.state));
+		count = sw->sha1.count;
+		memcpy(st->buf, sw->sha1.buffer, sizeof(st->buf));
+	} else {
+		memcpy(st->h, sw->sha256.state, sizeof(sw->sha256.state));
+		count = sw->sha256.count;
+		memcpy(st->buf, sw->sha256.buf, sizeof(st->buf));
+	}
+	st->initialized = 1;
+	st->bufLen = count % sizeof(st->buf);
+	st->countHi = count >> 32;
+	st->countLo = count;
+}
+
+/**
+ * @brief hash step by the generic code, continuing from the ARM state
+ */
+static int warpcrypt_hash_fallback(WarpCryptReq *wr)
+{
+	struct ahash_request *req = ahash_request_cast(wr->areq);
+	WarpCryptCtx *ctx = crypto_tfm_ctx(wr->areq->tfm);
+	SHASH_DESC_ON_STACK(desc, ctx->fb.hash);
+	WarpCryptSwState sw;
+	int rc;
+
+	desc->tfm = ctx->fb.hash;
+	if (wr->state.initialized) {
+		warpcrypt_state_to_sw(ctx->algo, &wr->state, &sw);
+		rc = crypto_shash_import(desc, &sw);
+	} else {
+		rc = crypto_shash_init(desc);
+	}
+	if (rc == 0 && (wr->flags & CRYPTO_FLAG_HASH_UPDATE))
+		rc = shash_ahash_update(req, desc);
+	if (rc == 0) {
+		if (wr->flags & CRYPTO_FLAG_HASH_FINAL) {
+			rc = crypto_shash_final(desc, req->result);
+		} else {
+			rc = crypto_shash_export(desc, &sw);
+			if (rc == 0)
+				warpcrypt_state_from_sw(ctx->algo, &sw, &wr->state);
+		}
+	}
+	shash_desc_zero(desc);
+	memzero_explicit(&sw, sizeof(sw));
+	return rc;
+}
+
+/**
+ * @brief do a request the ARM could not take with the generic code
+ */
+static int warpcrypt_fallback(WarpCryptReq *wr)
+{
+	WarpCryptCtx *ctx = crypto_tfm_ctx(wr->areq->tfm);
+	bool decrypt = wr->flags & CRYPTO_FLAG_DECRYPT;
+
+	switch (wr->type) {
+	case WARPCRYPT_SKCIPHER: {
+		struct skcipher_request *req = skcipher_request_cast(wr->areq);
+		struct skcipher_request *sub = (void *)wr->fbReq;
+
+		skcipher_request_set_tfm(sub, ctx->fb.skcipher);
+		skcipher_request_set_callback(sub, req->base.flags, NULL, NULL);
+		skcipher_request_set_crypt(sub, req->src, req->dst, req->cryptlen, req->iv);
+		return decrypt ? crypto_skcipher_decrypt(sub) : crypto_skcipher_encrypt(sub);
+	}
+	case WARPCRYPT_AEAD: {
+		struct aead_request *req = aead_request_cast(wr->areq);
+		struct aead_request *sub = (void *)wr->fbReq;
+
+		aead_request_set_tfm(sub, ctx->fb.aead);
+		aead_request_set_callback(sub, req->base.flags, NULL, NULL);
+		aead_request_set_crypt(sub, req->src, req->dst, req->cryptlen, req->iv);
+		aead_request_set_ad(sub, req->assoclen);
+		return decrypt ? crypto_aead_decrypt(sub) : crypto_aead_encrypt(sub);
+	}
+	default:
+		return warpcrypt_hash_fallback(wr);
+	}
+}
+
+// ############################################################################
+// batches
+// ############################################################################
+
+static void warpcrypt_run_batch(WarpCryptReq **reqs, unsigned int cnt)
+{
+	unsigned int i, n = 0;
+	bool ok;
+	int rc;
+
+	for (i = 0; i < cnt; i++) {
+		if (warpcrypt_prepare(reqs[i], n) == 0)
+			reqs[n++] = reqs[i];
+		else
+			warpcrypt_complete(reqs[i], warpcrypt_fallback(reqs[i]));
+	}
+	if (!n)
+		return;
+
+	ok = warpbatch_send(&warpcrypt_wb, n);
+
+	for (i = 0; i < n; i++) {
+		WarpCryptReq *wr = reqs[i];
+
+		warpcrypt_unmap(wr);
+		rc = ok ? warpcrypt_status(warpcrypt_batch->ent[i].status) : -EIO;
+		if (rc == 0)
+			warpcrypt_results(wr, i);
+		kfree(wr->bounce);
+		wr->bounce = NULL;
+		// refused or failed jobs left the buffers untouched
+		if (rc && rc != -EBADMSG)
+			rc = warpcrypt_fallback(wr);
+		warpcrypt_complete(wr, rc);
+	}
+}
+
+static void warpcrypt_batch_work(struct work_struct *work)
+{
+	WarpCryptReq *reqs[CRYPTO_MAX_BATCH];
+	unsigned int cnt;
+
+	do {
+		cnt = 0;
+		spin_lock_bh(&warpcrypt_queue_lock);
+		while (cnt < CRYPTO_MAX_BATCH && !list_empty(&warpcrypt_queue)) {
+			reqs[cnt] = list_first_entry(&warpcrypt_queue, WarpCryptReq, list);
+			list_del(&reqs[cnt]->list);
+			cnt++;
+		}
+		spin_unlock_bh(&warpcrypt_queue_lock);
+
+		if (cnt)
+			warpcrypt_run_batch(reqs, cnt);
+	} while (cnt);
+}
+static DECLARE_WORK(warpcrypt_work, warpcrypt_batch_work);
+
+static int warpcrypt_queue_req(WarpCryptReq *wr, struct crypto_async_request *areq,
+			       uint8_t type, uint8_t flags)
+{
+	wr->areq = areq;
+	wr->type = type;
+	wr->flags = flags;
+
+	spin_lock_bh(&warpcrypt_queue_lock);
+	list_add_tail(&wr->list, &warpcrypt_queue);
+	spin_unlock_bh(&warpcrypt_queue_lock);
+
+	queue_work(system_unbound_wq, &warpcrypt_work);
+	return -EINPROGRESS;
+}
+
+static void warpcrypt_tfm_init(struct crypto_tfm *tfm, uint8_t algo)
+{
+	WarpCryptCtx *ctx = crypto_tfm_ctx(tfm);
+
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->algo = algo;
+}
+
+// ############################################################################
+// skcipher / aead
+// ############################################################################
+
+static int warpcrypt_aes_setkey(struct crypto_skcipher *tfm, const u8 *key,
+				unsigned int keyLen)
+{
+	WarpCryptCtx *ctx = crypto_skcipher_ctx(tfm);
+	int rc;
+
+	rc = aes_check_keylen(keyLen);
+	if (rc)
+		return rc;
+	crypto_skcipher_clear_flags(ctx->fb.skcipher, CRYPTO_TFM_REQ_MASK);
+	crypto_skcipher_set_flags(ctx->fb.skcipher,
+				  crypto_skcipher_get_flags(tfm) & CRYPTO_TFM_REQ_MASK);
+	rc = crypto_skcipher_setkey(ctx->fb.skcipher, key, keyLen);
+	if (rc)
+		return rc;
+	memcpy(ctx->key, key, keyLen);
+	ctx->keyLen = keyLen;
+	return 0;
+}
+
+static int warpcrypt_skcipher_crypt(struct skcipher_request *req, uint8_t flags)
+{
+	WarpCryptCtx *ctx = crypto_skcipher_ctx(crypto_skcipher_reqtfm(req));
+
+	if (!req->cryptlen)
+		return 0;
+	if (ctx->algo == CRYPTO_ALGO_AES_CBC && !IS_ALIGNED(req->cryptlen, AES_BLOCK_SIZE))
+		return -EINVAL;
+	return warpcrypt_queue_req(skcipher_request_ctx(req), &req->base,
+				   WARPCRYPT_SKCIPHER, flags);
+}
+
+static int warpcrypt_skcipher_encrypt(struct skcipher_request *req)
+{
+	return warpcrypt_skcipher_crypt(req, 0);
+}
+
+static int warpcrypt_skcipher_decrypt(struct skcipher_request *req)
+{
+	return warpcrypt_skcipher_crypt(req, CRYPTO_FLAG_DECRYPT);
+}
+
+static int warpcrypt_skcipher_init(struct crypto_skcipher *tfm, uint8_t algo)
+{
+	WarpCryptCtx *ctx = crypto_skcipher_ctx(tfm);
+	struct crypto_skcipher *fb;
+
+	warpcrypt_tfm_init(crypto_skcipher_tfm(tfm), algo);
+	fb = crypto_alloc_skcipher(crypto_tfm_alg_name(crypto_skcipher_tfm(tfm)), 0,
+				   CRYPTO_ALG_ASYNC | CRYPTO_ALG_NEED_FALLBACK);
+	if (IS_ERR(fb))
+		return PTR_ERR(fb);
+	ctx->fb.skcipher = fb;
+	crypto_skcipher_set_reqsize(tfm, sizeof(WarpCryptReq) +
+				    sizeof(struct skcipher_request) +
+				    crypto_skcipher_reqsize(fb));
+	return 0;
+}
+
+static int warpcrypt_cbc_init(struct crypto_skcipher *tfm)
+{
+	return warpcrypt_skcipher_init(tfm, CRYPTO_ALGO_AES_CBC);
+}
+
+static int warpcrypt_ctr_init(struct crypto_skcipher *tfm)
+{
+	return warpcrypt_skcipher_init(tfm, CRYPTO_ALGO_AES_CTR);
+}
+
+static void warpcrypt_skcipher_exit(struct crypto_skcipher *tfm)
+{
+	WarpCryptCtx *ctx = crypto_skcipher_ctx(tfm);
+
+	crypto_free_skcipher(ctx->fb.skcipher);
+}
+
+static int warpcrypt_gcm_setkey(struct crypto_aead *tfm, const u8 *key,
+				unsigned int keyLen)
+{
+	WarpCryptCtx *ctx = crypto_aead_ctx(tfm);
+	int rc;
+
+	rc = aes_check_keylen(keyLen);
+	if (rc)
+		return rc;
+	crypto_aead_clear_flags(ctx->fb.aead, CRYPTO_TFM_REQ_MASK);
+	crypto_aead_set_flags(ctx->fb.aead, crypto_aead_get_flags(tfm) & CRYPTO_TFM_REQ_MASK);
+	rc = crypto_aead_setkey(ctx->fb.aead, key, keyLen);
+	if (rc)
+		return rc;
+	memcpy(ctx->key, key, keyLen);
+	ctx->keyLen = keyLen;
+	return 0;
+}
+
+static int warpcrypt_gcm_setauthsize(struct crypto_aead *tfm, unsigned int authsize)
+{
+	WarpCryptCtx *ctx = crypto_aead_ctx(tfm);
+	int rc;
+
+	rc = crypto_gcm_check_authsize(authsize);
+	if (rc)
+		return rc;
+	return crypto_aead_setauthsize(ctx->fb.aead, authsize);
+}
+
+static int warpcrypt_gcm_encrypt(struct aead_request *req)
+{
+	return warpcrypt_queue_req(aead_request_ctx(req), &req->base,
+				   WARPCRYPT_AEAD, 0);
+}
+
+static int warpcrypt_gcm_decrypt(struct aead_request *req)
+{
+	if (req->cryptlen < crypto_aead_authsize(crypto_aead_reqtfm(req)))
+		return -EINVAL;
+	return warpcrypt_queue_req(aead_request_ctx(req), &req->base,
+				   WARPCRYPT_AEAD, CRYPTO_FLAG_DECRYPT);
+}
+
+static int warpcrypt_gcm_init(struct crypto_aead *tfm)
+{
+	WarpCryptCtx *ctx = crypto_aead_ctx(tfm);
+	struct crypto_aead *fb;
+
+	warpcrypt_tfm_init(crypto_aead_tfm(tfm), CRYPTO_ALGO_AES_GCM);
+	fb = crypto_alloc_aead("gcm(aes)", 0, CRYPTO_ALG_ASYNC | CRYPTO_ALG_NEED_FALLBACK);
+	if (IS_ERR(fb))
+		return PTR_ERR(fb);
+	ctx->fb.aead = fb;
+	crypto_aead_set_reqsize(tfm, sizeof(WarpCryptReq) + sizeof(struct aead_request) +
+				crypto_aead_reqsize(fb));
+	return 0;
+}
+
+static void warpcrypt_gcm_exit(struct crypto_aead *tfm)
+{
+	WarpCryptCtx *ctx = crypto_aead_ctx(tfm);
+
+	crypto_free_aead(ctx->fb.aead);
+}
+
+#define WARPCRYPT_BASE(_name, _drv, _blocksize)					\
+	.base = {								\
+		.cra_name		= _name,				\
+		.cra_driver_name	= _drv,					\
+		.cra_priority		= WARPCRYPT_PRIORITY,			\
+		.cra_flags		= CRYPTO_ALG_ASYNC |			\
+					  CRYPTO_ALG_KERN_DRIVER_ONLY |		\
+					  CRYPTO_ALG_NEED_FALLBACK,		\
+		.cra_blocksize		= _blocksize,				\
+		.cra_ctxsize		= sizeof(WarpCryptCtx),			\
+		.cra_module		= THIS_MODULE,				\
+	}
+
+static struct skcipher_alg warpcrypt_skciphers[] = {
+	{
+		.setkey		= warpcrypt_aes_setkey,
+		.encrypt	= warpcrypt_skcipher_encrypt,
+		.decrypt	= warpcrypt_skcipher_decrypt,
+		.init		= warpcrypt_cbc_init,
+		.exit		= warpcrypt_skcipher_exit,
+		.min_keysize	= AES_MIN_KEY_SIZE,
+		.max_keysize	= AES_MAX_KEY_SIZE,
+		.ivsize		= AES_BLOCK_SIZE,
+		WARPCRYPT_BASE("cbc(aes)", "cbc-aes-warp", AES_BLOCK_SIZE),
+	}, {
+		.setkey		= warpcrypt_aes_setkey,
+		.encrypt	= warpcrypt_skcipher_encrypt,
+		.decrypt	= warpcrypt_skcipher_decrypt,
+		.init		= warpcrypt_ctr_init,
+		.exit		= warpcrypt_skcipher_exit,
+		.min_keysize	= AES_MIN_KEY_SIZE,
+		.max_keysize	= AES_MAX_KEY_SIZE,
+		.ivsize		= AES_BLOCK_SIZE,
+		.chunksize	= AES_BLOCK_SIZE,
+		WARPCRYPT_BASE("ctr(aes)", "ctr-aes-warp", 1),
+	},
+};
+
+static struct aead_alg warpcrypt_aeads[] = {
+	{
+		.setkey		= warpcrypt_gcm_setkey,
+		.setauthsize	= warpcrypt_gcm_setauthsize,
+		.encrypt	= warpcrypt_gcm_encrypt,
+		.decrypt	= warpcrypt_gcm_decrypt,
+		.init		= warpcrypt_gcm_init,
+		.exit		= warpcrypt_gcm_exit,
+		.ivsize		= GCM_AES_IV_SIZE,
+		.maxauthsize	= AES_BLOCK_SIZE,
+		.chunksize	= AES_BLOCK_SIZE,
+		WARPCRYPT_BASE("gcm(aes)", "gcm-aes-warp", 1),
+	},
+};
+
+// ############################################################################
+// ahash
+// ############################################################################
+
+static int warpcrypt_hash_init(struct ahash_request *req)
+{
+	WarpCryptReq *wr = ahash_request_ctx(req);
+
+	// ARM starts over (HMAC: from the key) with the first update/final
+	memset(&wr->state, 0, sizeof(wr->state));
+	return 0;
+}
+
+static int warpcrypt_hash_update(struct ahash_request *req)
+{
+	if (!req->nbytes)
+		return 0;
+	return warpcrypt_queue_req(ahash_request_ctx(req), &req->base,
+				   WARPCRYPT_AHASH, CRYPTO_FLAG_HASH_UPDATE);
+}
+
+static int warpcrypt_hash_final(struct ahash_request *req)
+{
+	return warpcrypt_queue_req(ahash_request_ctx(req), &req->base,
+				   WARPCRYPT_AHASH, CRYPTO_FLAG_HASH_FINAL);
+}
+
+static int warpcrypt_hash_finup(struct ahash_request *req)
+{
+	return warpcrypt_queue_req(ahash_request_ctx(req), &req->base,
+				   WARPCRYPT_AHASH,
+				   (req->nbytes ? CRYPTO_FLAG_HASH_UPDATE : 0) |
+				   CRYPTO_FLAG_HASH_FINAL);
+}
+
+static int warpcrypt_hash_digest(struct ahash_request *req)
+{
+	warpcrypt_hash_init(req);
+	return warpcrypt_hash_finup(req);
+}
+
+static int warpcrypt_hash_export(struct ahash_request *req, void *out)
+{
+	WarpCryptReq *wr = ahash_request_ctx(req);
+
+	memcpy(out, &wr->state, sizeof(wr->state));
+	return 0;
+}
+
+static int warpcrypt_hash_import(struct ahash_request *req, const void *in)
+{
+	WarpCryptReq *wr = ahash_request_ctx(req);
+
+	memcpy(&wr->state, in, sizeof(wr->state));
+	return 0;
+}
+
+/**
+ * @brief HMAC key, longer keys are replaced by their hash (RFC 2104)
+ */
+static int warpcrypt_hmac_setkey(struct crypto_ahash *tfm, const u8 *key,
+				 unsigned int keyLen)
+{
+	WarpCryptCtx *ctx = crypto_ahash_ctx(tfm);
+	struct crypto_shash *hash;
+	int rc;
+
+	rc = crypto_shash_setkey(ctx->fb.hash, key, keyLen);
+	if (rc)
+		return rc;
+
+	if (keyLen <= crypto_ahash_blocksize(tfm)) {
+		memcpy(ctx->key, key, keyLen);
+		ctx->keyLen = keyLen;
+		return 0;
+	}
+
+	hash = crypto_alloc_shash(ctx->algo == CRYPTO_ALGO_HMAC_SHA1 ? "sha1" : "sha256",
+				  0, 0);
+	if (IS_ERR(hash))
+		return PTR_ERR(hash);
+	rc = crypto_shash_tfm_digest(hash, key, keyLen, ctx->key);
+	if (rc == 0)
+		ctx->keyLen = crypto_shash_digestsize(hash);
+	crypto_free_shash(hash);
+	return rc;
+}
+
+/**
+ * @brief the fallback must be the generic code, its state is converted
+ */
+static int warpcrypt_hash_init_tfm(struct crypto_ahash *tfm, uint8_t algo,
+				   const char *fallback)
+{
+	WarpCryptCtx *ctx = crypto_ahash_ctx(tfm);
+	struct crypto_shash *fb;
+
+	warpcrypt_tfm_init(crypto_ahash_tfm(tfm), algo);
+	fb = crypto_alloc_shash(fallback, 0, CRYPTO_ALG_NEED_FALLBACK);
+	if (IS_ERR(fb))
+		return PTR_ERR(fb);
+	ctx->fb.hash = fb;
+	crypto_ahash_set_reqsize(tfm, sizeof(WarpCryptReq));
+	return 0;
+}
+
+static void warpcrypt_hash_exit_tfm(struct crypto_ahash *tfm)
+{
+	WarpCryptCtx *ctx = crypto_ahash_ctx(tfm);
+
+	crypto_free_shash(ctx->fb.hash);
+}
+
+#define WARPCRYPT_HASH_INIT(_name, _algo, _fallback)				\
+static int warpcrypt_##_name##_init_tfm(struct crypto_ahash *tfm)		\
+{										\
+	return warpcrypt_hash_init_tfm(tfm, _algo, _fallback);			\
+}
+
+WARPCRYPT_HASH_INIT(sha1, CRYPTO_ALGO_SHA1, "sha1-generic")
+WARPCRYPT_HASH_INIT(sha256, CRYPTO_ALGO_SHA256, "sha256-generic")
+WARPCRYPT_HASH_INIT(hmac_sha1, CRYPTO_ALGO_HMAC_SHA1, "hmac(sha1-generic)")
+WARPCRYPT_HASH_INIT(hmac_sha256, CRYPTO_ALGO_HMAC_SHA256, "hmac(sha256-generic)")
+
+#define WARPCRYPT_AHASH(_init, _setkey, _digest, _block, _name, _drv)		\
+{										\
+	.init		= warpcrypt_hash_init,					\
+	.update		= warpcrypt_hash_update,				\
+	.final		= warpcrypt_hash_final,					\
+	.finup		= warpcrypt_hash_finup,					\
+	.digest		= warpcrypt_hash_digest,				\
+	.export		= warpcrypt_hash_export,				\
+	.import		= warpcrypt_hash_import,				\
+	.setkey		= _setkey,						\
+	.init_tfm	= _init,						\
+	.exit_tfm	= warpcrypt_hash_exit_tfm,				\
+	.halg = {								\
+		.digestsize	= _digest,					\
+		.statesize	= sizeof(CryptoHashState),			\
+		WARPCRYPT_BASE(_name, _drv, _block),				\
+	},									\
+}
+
+static struct ahash_alg warpcrypt_ahashes[] = {
+	WARPCRYPT_AHASH(warpcrypt_sha1_init_tfm, NULL, SHA1_DIGEST_SIZE,
+			SHA1_BLOCK_SIZE, "sha1", "sha1-warp"),
+	WARPCRYPT_AHASH(warpcrypt_sha256_init_tfm, NULL, SHA256_DIGEST_SIZE,
+			SHA256_BLOCK_SIZE, "sha256", "sha256-warp"),
+	WARPCRYPT_AHASH(warpcrypt_hmac_sha1_init_tfm, warpcrypt_hmac_setkey,
+			SHA1_DIGEST_SIZE, SHA1_BLOCK_SIZE,
+			"hmac(sha1)", "hmac-sha1-warp"),
+	WARPCRYPT_AHASH(warpcrypt_hmac_sha256_init_tfm, warpcrypt_hmac_setkey,
+			SHA256_DIGEST_SIZE, SHA256_BLOCK_SIZE,
+			"hmac(sha256)", "hmac-sha256-warp"),
+};
+
+// ############################################################################
+// init
+// ############################################################################
+
+static void warpcrypt_free_batch(void)
+{
+	dma_free_coherent(warpcrypt_dmadev, sizeof(WarpCryptBatch),
+			  warpcrypt_batch, warpcrypt_batchDma);
+}
+
+static int __init warpcrypt_init(void)
+{
+	struct zorro_dev *z, *ddr;
+	int rc;
+
+	z = zorro_find_device(ZORRO_PROD_CSLAB_WARP_CTRL, NULL);
+	if (!z)
+		return -ENODEV;
+	// everything is moved by ARM DMA
+	ddr = zorro_find_device(ZORRO_PROD_CSLAB_WARP_DDR3, NULL);
+	if (!ddr)
+		return -ENODEV;
+	if (dma_set_mask_and_coherent(&z->dev, DMA_BIT_MASK(32)))
+		return -ENODEV;
+	warpcrypt_wb.ctrlBase = (void __iomem *)z->resource.start;
+	warpcrypt_dmadev = &z->dev;
+	warpcrypt_ddr = &ddr->resource;
+
+	warpcrypt_batch = dma_alloc_coherent(warpcrypt_dmadev, sizeof(WarpCryptBatch),
+					     &warpcrypt_batchDma, GFP_KERNEL);
+	if (!warpcrypt_batch)
+		return -ENOMEM;
+	if (!warpcrypt_reach(warpcrypt_batchDma, sizeof(WarpCryptBatch))) {
+		rc = -ENODEV;
+		goto out_free;
+	}
+
+	warpcrypt_wb.tableDma = warpcrypt_batchDma + offsetof(WarpCryptBatch, ent);
+	if (!warpbatch_probe(&warpcrypt_wb)) {
+		pr_info("%s: ARM firmware without crypto support\n", DRV_NAME);
+		rc = -ENODEV;
+		goto out_free;
+	}
+
+	rc = warpbatch_irq_init(&warpcrypt_wb);
+	if (rc)
+		goto out_free;
+
+	rc = crypto_register_skciphers(warpcrypt_skciphers, ARRAY_SIZE(warpcrypt_skciphers));
+	if (rc)
+		goto out_irq;
+	rc = crypto_register_aeads(warpcrypt_aeads, ARRAY_SIZE(warpcrypt_aeads));
+	if (rc)
+		goto out_skciphers;
+	rc = crypto_register_ahashes(warpcrypt_ahashes, ARRAY_SIZE(warpcrypt_ahashes));
+	if (rc)
+		goto out_aeads;
+
+	pr_info("%s: AES (CBC, CTR, GCM), SHA-1, SHA-256 offloaded to ARM\n", DRV_NAME);
+	return 0;
+
+out_aeads:
+	crypto_unregister_aeads(warpcrypt_aeads, ARRAY_SIZE(warpcrypt_aeads));
+out_skciphers:
+	crypto_unregister_skciphers(warpcrypt_skciphers, ARRAY_SIZE(warpcrypt_skciphers));
+out_irq:
+	warpbatch_irq_exit(&warpcrypt_wb);
+out_free:
+	warpcrypt_free_batch();
+	return rc;
+}
+
+static void __exit warpcrypt_exit(void)
+{
+	crypto_unregister_ahashes(warpcrypt_ahashes, ARRAY_SIZE(warpcrypt_ahashes));
+	crypto_unregister_aeads(warpcrypt_aeads, ARRAY_SIZE(warpcrypt_aeads));
+	crypto_unregister_skciphers(warpcrypt_skciphers, ARRAY_SIZE(warpcrypt_skciphers));
+	flush_work(&warpcrypt_work);
+	warpbatch_irq_exit(&warpcrypt_wb);
+	warpcrypt_free_batch();
+}
+
+module_init(warpcrypt_init);
+module_exit(warpcrypt_exit);
+
+MODULE_AUTHOR("Andrzej Rogozynski");
+MODULE_DESCRIPTION("csWarp ARM AES/SHA offload");
+MODULE_LICENSE("GPL v2");
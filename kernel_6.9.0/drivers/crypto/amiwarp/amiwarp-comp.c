@@ -0,0 +1,642 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  drivers/crypto/amiwarp/amiwarp-comp.c -- lz4/zstd by the csWarp ARM
+ *
+ *      Copyright (C) 2024 Andrzej Rogozynski
+ *
+ *  Compressing a 4 KB page takes milliseconds on the 68060, the ARM does
+ *  it much faster. lz4 and zstd are registered as "lz4-warp" and
+ *  "zstd-warp" with a priority above the generic code, both as legacy
+ *  compression algorithm (used by zram) and as acomp (zswap, ...).
+ *
+ *  Legacy calls are synchronous and do not sleep, zram compresses with
+ *  preemption disabled. The ARM reads the source and writes the result
+ *  by DMA when both buffers are in its reach, otherwise they are copied
+ *  through dpRAM if they fit (COMP_MAX_DPRAM_TRANSFER bytes). Anything
+ *  else is done by the generic lz4/zstd code (lz4-generic, zstd-generic).
+ *
+ *  acomp requests are asynchronous. They are queued and a worker hands
+ *  up to COMP_MAX_BATCH of them to the ARM in one dpcmdCompBatch, so
+ *  callers with many blocks in flight pay one mailbox round trip per
+ *  batch instead of one per block. The ARM only acknowledges the batch,
+ *  the worker sleeps until DPREG_CR_IF_COMP tells it is done. Requests
+ *  out of ARM reach take the legacy path, including its fallback.
+ *
+ *  zram uses the legacy interface. The batched acomp path serves
+ *  squashfs lz4 images through SQUASHFS_LZ4_WARP (fs/squashfs/lz4_warp.c),
+ *  with parallel decompressors several blocks share one batch. zswap
+ *  would use it too.
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of this archive for
+ *  more details.
+ */
+
+#include <crypto/internal/acompress.h>
+#include <linux/crypto.h>
+#include <linux/dma-mapping.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/scatterlist.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/zorro.h>
+
+#include <asm/cswarpamicomm.h>
+
+#include "amiwarp-batch.h"
+
+#define DRV_NAME	"amiwarp-comp"
+
+#define WARPCOMP_PRIORITY	300
+
+static void __iomem *warpcomp_ctrl;
+static struct device *warpcomp_dmadev;		// NULL: dpRAM copy only
+
+// Warp DDR3 as seen by the 68k, NULL if not autoconfigured (no DMA then)
+static struct resource *warpcomp_ddr;
+
+// legacy and acomp tfm context
+typedef struct {
+	struct crypto_comp *fallback;	// generic code, for buffers out of reach
+} WarpCompCtx;
+
+// acomp request context
+typedef struct {
+	uint8_t algo;
+	uint8_t op;
+	void *src, *dst;		// linear buffers
+	bool srcBounce, dstBounce;	// kmalloc'ed, src/dst sg not linear
+	dma_addr_t srcDma, dstDma;
+} WarpCompReq;
+
+// acomp requests waiting for the batch worker
+static LIST_HEAD(warpcomp_queue);
+static DEFINE_SPINLOCK(warpcomp_queue_lock);
+
+// CompBatchEntry table read and written by ARM
+static CompBatchEntry *warpcomp_batch;
+static dma_addr_t warpcomp_batchDma;
+
+static WarpBatch warpcomp_wb = {
+	.name		= DRV_NAME,
+	.cmd		= dpcmdCompBatch,
+	.irqEnable	= DPREG_CR_IE_COMP,
+	.irqFlag	= DPREG_CR_IF_COMP,
+};
+
+// ############################################################################
+// ARM communication
+// ############################################################################
+
+/**
+ * @brief true if the ARM can reach len bytes at addr (fails closed
+ *        without DDR3)
+ */
+static bool warpcomp_reach(dma_addr_t addr, unsigned int len)
+{
+	return warpcomp_ddr && addr >= warpcomp_ddr->start &&
+	       addr + len - 1 <= warpcomp_ddr->end;
+}
+
+/**
+ * @brief map a buffer for the ARM
+ * @return 0, -ERANGE if the ARM cannot reach it
+ */
+static int warpcomp_map(const void *buf, unsigned int len,
+			enum dma_data_direction dir, dma_addr_t *addr)
+{
+	if (!warpcomp_ddr || !len || !virt_addr_valid(buf) ||
+	    !virt_addr_valid(buf + len - 1))
+		return -ERANGE;
+
+	*addr = dma_map_single(warpcomp_dmadev, (void *)buf, len, dir);
+	if (dma_mapping_error(warpcomp_dmadev, *addr))
+		return -ERANGE;
+	if (!warpcomp_reach(*addr, len)) {
+		dma_unmap_single(warpcomp_dmadev, *addr, len, dir);
+		return -ERANGE;
+	}
+	return 0;
+}
+
+static int warpcomp_status(uint8_t status)
+{
+	switch (status) {
+	case COMP_STATUS_OK:
+		return 0;
+	case COMP_STATUS_NOSPC:
+		return -ENOSPC;
+	case COMP_STATUS_BADDATA:
+		return -EINVAL;
+	default:
+		return -EIO;
+	}
+}
+
+/**
+ * @brief let the ARM (de)compress src into dst
+ * @param dlen room at dst, on return bytes produced
+ * @return 0, -ERANGE if the ARM cannot reach the buffers and they do not
+ *         fit dpRAM (caller falls back to the generic code)
+ */
+static int warpcomp_run(uint8_t algo, uint8_t op, const u8 *src,
+			unsigned int slen, u8 *dst, unsigned int *dlen)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(warpcomp_ctrl);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(warpcomp_ctrl);
+	dma_addr_t srcDma, dstDma;
+	unsigned int room = *dlen;
+	bool useDma, clamped = false;
+	ulong irqFlags;
+	int rc;
+
+	useDma = warpcomp_map(src, slen, DMA_TO_DEVICE, &srcDma) == 0;
+	if (useDma && warpcomp_map(dst, room, DMA_FROM_DEVICE, &dstDma)) {
+		dma_unmap_single(warpcomp_dmadev, srcDma, slen, DMA_TO_DEVICE);
+		useDma = false;
+	}
+	if (!useDma) {
+		if (slen > COMP_MAX_DPRAM_TRANSFER)
+			return -ERANGE;
+		clamped = room > COMP_MAX_DPRAM_TRANSFER;
+		room = min_t(unsigned int, room, COMP_MAX_DPRAM_TRANSFER);
+	}
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdComp;
+	cmd->comp.algo = algo;
+	cmd->comp.op = op;
+	cmd->comp.dmaEnable = useDma;
+	cmd->comp.srcLen = slen;
+	cmd->comp.dstLen = room;
+	cmd->comp.srcDdrAddr = useDma ? srcDma : 0;
+	cmd->comp.dstDdrAddr = useDma ? dstDma : 0;
+	if (!useDma)
+		memcpy((void*)cmd->comp.data, src, slen);
+	cswarpSendMsgToArm(warpcomp_ctrl, true);
+	if (rpl->header.rpl != dprplComp) {
+		rc = -EIO;
+	} else {
+		rc = warpcomp_status(rpl->comp.status);
+		// might have fit the caller's buffer
+		if (rc == -ENOSPC && clamped)
+			rc = -ERANGE;
+		if (rc == 0 && rpl->comp.dstLen > room)
+			rc = -EIO;
+		if (rc == 0) {
+			*dlen = rpl->comp.dstLen;
+			if (!useDma)
+				memcpy(dst, (void*)rpl->comp.data, *dlen);
+		}
+	}
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	if (useDma) {
+		dma_unmap_single(warpcomp_dmadev, dstDma, room, DMA_FROM_DEVICE);
+		dma_unmap_single(warpcomp_dmadev, srcDma, slen, DMA_TO_DEVICE);
+	}
+	return rc;
+}
+
+/**
+ * @brief warpcomp_run, the generic code when the ARM cannot take the buffers
+ */
+static int warpcomp_run_fb(WarpCompCtx *ctx, uint8_t algo, uint8_t op,
+			   const u8 *src, unsigned int slen, u8 *dst,
+			   unsigned int *dlen)
+{
+	int rc = warpcomp_run(algo, op, src, slen, dst, dlen);
+
+	if (rc != -ERANGE)
+		return rc;
+	if (op == COMP_OP_COMPRESS)
+		return crypto_comp_compress(ctx->fallback, src, slen, dst, dlen);
+	return crypto_comp_decompress(ctx->fallback, src, slen, dst, dlen);
+}
+
+// ############################################################################
+// batched acomp requests
+// ############################################################################
+
+static void warpcomp_req_done(struct acomp_req *req, int rc)
+{
+	WarpCompReq *wr = acomp_request_ctx(req);
+
+	if (rc == 0 && wr->dstBounce)
+		sg_copy_from_buffer(req->dst, sg_nents(req->dst), wr->dst, req->dlen);
+	if (wr->srcBounce)
+		kfree(wr->src);
+	if (wr->dstBounce)
+		kfree(wr->dst);
+
+	local_bh_disable();
+	acomp_request_complete(req, rc);
+	local_bh_enable();
+}
+
+/**
+ * @brief get linear buffers for a request, bouncing scattered sg lists
+ */
+static int warpcomp_req_linear(struct acomp_req *req)
+{
+	WarpCompReq *wr = acomp_request_ctx(req);
+
+	wr->srcBounce = sg_nents_for_len(req->src, req->slen) != 1;
+	wr->dstBounce = sg_nents_for_len(req->dst, req->dlen) != 1;
+
+	if (wr->srcBounce) {
+		wr->src = kmalloc(req->slen, GFP_KERNEL);
+		if (!wr->src) {
+			wr->dstBounce = false;
+			return -ENOMEM;
+		}
+		sg_copy_to_buffer(req->src, sg_nents(req->src), wr->src, req->slen);
+	} else {
+		wr->src = sg_virt(req->src);
+	}
+
+	if (wr->dstBounce) {
+		wr->dst = kmalloc(req->dlen, GFP_KERNEL);
+		if (!wr->dst)
+			return -ENOMEM;
+	} else {
+		wr->dst = sg_virt(req->dst);
+	}
+	return 0;
+}
+
+/**
+ * @brief fill in a batch entry
+ * @return 0, -ERANGE if the ARM cannot reach the buffers
+ */
+static int warpcomp_req_map(struct acomp_req *req, CompBatchEntry *ent)
+{
+	WarpCompReq *wr = acomp_request_ctx(req);
+
+	if (warpcomp_map(wr->src, req->slen, DMA_TO_DEVICE, &wr->srcDma))
+		return -ERANGE;
+	if (warpcomp_map(wr->dst, req->dlen, DMA_FROM_DEVICE, &wr->dstDma)) {
+		dma_unmap_single(warpcomp_dmadev, wr->srcDma, req->slen, DMA_TO_DEVICE);
+		return -ERANGE;
+	}
+
+	ent->algo = wr->algo;
+	ent->op = wr->op;
+	ent->status = COMP_STATUS_OK;
+	ent->srcDdrAddr = wr->srcDma;
+	ent->srcLen = req->slen;
+	ent->dstDdrAddr = wr->dstDma;
+	ent->dstLen = req->dlen;
+	return 0;
+}
+
+/**
+ * @brief one request outside a batch: dpRAM copy or generic code
+ */
+static int warpcomp_req_sync(struct acomp_req *req)
+{
+	WarpCompReq *wr = acomp_request_ctx(req);
+	WarpCompCtx *ctx = acomp_tfm_ctx(crypto_acomp_reqtfm(req));
+	unsigned int dlen = req->dlen;
+	int rc;
+
+	rc = warpcomp_run_fb(ctx, wr->algo, wr->op, wr->src, req->slen,
+			     wr->dst, &dlen);
+	if (rc == 0)
+		req->dlen = dlen;
+	return rc;
+}
+
+static void warpcomp_run_batch(struct acomp_req **reqs, unsigned int cnt)
+{
+	unsigned int i, n = 0;
+	bool ok;
+	int rc;
+
+	for (i = 0; i < cnt; i++) {
+		struct acomp_req *req = reqs[i];
+
+		rc = warpcomp_req_linear(req);
+		if (rc == 0)
+			rc = warpcomp_req_map(req, &warpcomp_batch[n]);
+		if (rc == 0) {
+			reqs[n++] = req;
+			continue;
+		}
+		// out of ARM reach
+		if (rc == -ERANGE)
+			rc = warpcomp_req_sync(req);
+		warpcomp_req_done(req, rc);
+	}
+	if (!n)
+		return;
+
+	ok = warpbatch_send(&warpcomp_wb, n);
+
+	for (i = 0; i < n; i++) {
+		struct acomp_req *req = reqs[i];
+		WarpCompReq *wr = acomp_request_ctx(req);
+		CompBatchEntry *ent = &warpcomp_batch[i];
+
+		dma_unmap_single(warpcomp_dmadev, wr->dstDma, req->dlen, DMA_FROM_DEVICE);
+		dma_unmap_single(warpcomp_dmadev, wr->srcDma, req->slen, DMA_TO_DEVICE);
+
+		if (!ok) {
+			// batch refused, still get the job done
+			warpcomp_req_done(req, warpcomp_req_sync(req));
+			continue;
+		}
+		rc = warpcomp_status(ent->status);
+		if (rc == 0 && ent->dstLen > req->dlen)
+			rc = -EIO;
+		if (rc == 0)
+			req->dlen = ent->dstLen;
+		warpcomp_req_done(req, rc);
+	}
+}
+
+static void warpcomp_batch_work(struct work_struct *work)
+{
+	struct acomp_req *reqs[COMP_MAX_BATCH];
+	unsigned int cnt;
+
+	do {
+		cnt = 0;
+		spin_lock_bh(&warpcomp_queue_lock);
+		while (cnt < COMP_MAX_BATCH && !list_empty(&warpcomp_queue)) {
+			reqs[cnt] = list_first_entry(&warpcomp_queue, struct acomp_req,
+						     base.list);
+			list_del(&reqs[cnt]->base.list);
+			cnt++;
+		}
+		spin_unlock_bh(&warpcomp_queue_lock);
+
+		if (cnt)
+			warpcomp_run_batch(reqs, cnt);
+	} while (cnt);
+}
+static DECLARE_WORK(warpcomp_work, warpcomp_batch_work);
+
+static int warpcomp_queue_req(struct acomp_req *req, uint8_t algo, uint8_t op)
+{
+	WarpCompReq *wr = acomp_request_ctx(req);
+
+	// no allocation of the destination for the caller
+	if (!req->src || !req->dst || !req->slen || !req->dlen)
+		return -EINVAL;
+
+	wr->algo = algo;
+	wr->op = op;
+
+	spin_lock_bh(&warpcomp_queue_lock);
+	list_add_tail(&req->base.list, &warpcomp_queue);
+	spin_unlock_bh(&warpcomp_queue_lock);
+
+	queue_work(system_unbound_wq, &warpcomp_work);
+	return -EINPROGRESS;
+}
+
+// ############################################################################
+// crypto API
+// ############################################################################
+
+static int warpcomp_init_tfm(struct crypto_tfm *tfm, const char *fallback)
+{
+	WarpCompCtx *ctx = crypto_tfm_ctx(tfm);
+
+	ctx->fallback = crypto_alloc_comp(fallback, 0, 0);
+	return PTR_ERR_OR_ZERO(ctx->fallback);
+}
+
+static void warpcomp_exit_tfm(struct crypto_tfm *tfm)
+{
+	WarpCompCtx *ctx = crypto_tfm_ctx(tfm);
+
+	crypto_free_comp(ctx->fallback);
+}
+
+static void warpcomp_exit_acomp(struct crypto_acomp *tfm)
+{
+	warpcomp_exit_tfm(crypto_acomp_tfm(tfm));
+}
+
+#define WARPCOMP_OPS(_name, _algo)						\
+static int warpcomp_##_name##_compress(struct crypto_tfm *tfm, const u8 *src,	\
+				       unsigned int slen, u8 *dst,		\
+				       unsigned int *dlen)			\
+{										\
+	return warpcomp_run_fb(crypto_tfm_ctx(tfm), _algo, COMP_OP_COMPRESS,	\
+			       src, slen, dst, dlen);				\
+}										\
+										\
+static int warpcomp_##_name##_decompress(struct crypto_tfm *tfm, const u8 *src,\
+					 unsigned int slen, u8 *dst,		\
+					 unsigned int *dlen)			\
+{										\
+	return warpcomp_run_fb(crypto_tfm_ctx(tfm), _algo, COMP_OP_DECOMPRESS,	\
+			       src, slen, dst, dlen);				\
+}										\
+										\
+static int warpcomp_##_name##_init(struct crypto_tfm *tfm)			\
+{										\
+	return warpcomp_init_tfm(tfm, #_name "-generic");			\
+}										\
+										\
+static int warpcomp_##_name##_acompress(struct acomp_req *req)		\
+{										\
+	return warpcomp_queue_req(req, _algo, COMP_OP_COMPRESS);		\
+}										\
+										\
+static int warpcomp_##_name##_adecompress(struct acomp_req *req)		\
+{										\
+	return warpcomp_queue_req(req, _algo, COMP_OP_DECOMPRESS);		\
+}										\
+										\
+static int warpcomp_##_name##_ainit(struct crypto_acomp *tfm)			\
+{										\
+	return warpcomp_init_tfm(crypto_acomp_tfm(tfm), #_name "-generic");	\
+}
+
+WARPCOMP_OPS(lz4, COMP_ALGO_LZ4)
+WARPCOMP_OPS(zstd, COMP_ALGO_ZSTD)
+
+#define WARPCOMP_ALG(_name)							\
+{										\
+	.cra_name		= #_name,					\
+	.cra_driver_name	= #_name "-warp",				\
+	.cra_priority		= WARPCOMP_PRIORITY,				\
+	.cra_flags		= CRYPTO_ALG_TYPE_COMPRESS,			\
+	.cra_ctxsize		= sizeof(WarpCompCtx),				\
+	.cra_module		= THIS_MODULE,					\
+	.cra_init		= warpcomp_##_name##_init,			\
+	.cra_exit		= warpcomp_exit_tfm,				\
+	.cra_u			= { .compress = {				\
+		.coa_compress	= warpcomp_##_name##_compress,			\
+		.coa_decompress	= warpcomp_##_name##_decompress } },		\
+}
+
+#define WARPCOMP_ACOMP(_name)							\
+{										\
+	.compress		= warpcomp_##_name##_acompress,			\
+	.decompress		= warpcomp_##_name##_adecompress,		\
+	.init			= warpcomp_##_name##_ainit,			\
+	.exit			= warpcomp_exit_acomp,				\
+	.reqsize		= sizeof(WarpCompReq),				\
+	.base			= {						\
+		.cra_flags		= CRYPTO_ALG_ASYNC,			\
+		.cra_name		= #_name,				\
+		.cra_driver_name	= #_name "-warp-acomp",			\
+		.cra_priority		= WARPCOMP_PRIORITY,			\
+		.cra_ctxsize		= sizeof(WarpCompCtx),			\
+		.cra_module		= THIS_MODULE,				\
+	},									\
+}
+
+static struct crypto_alg warpcomp_algs[] = {
+	WARPCOMP_ALG(lz4),
+	WARPCOMP_ALG(zstd),
+};
+
+static struct acomp_alg warpcomp_acomps[] = {
+	WARPCOMP_ACOMP(lz4),
+	WARPCOMP_ACOMP(zstd),
+};
+
+// ############################################################################
+// init
+// ############################################################################
+
+/**
+ * @brief round trip a small buffer. Older ARM firmware does not know
+ *        dpcmdComp and never answers, so it is asked with a bounded
+ *        wait first.
+ */
+static bool warpcomp_probe(void)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(warpcomp_ctrl);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(warpcomp_ctrl);
+	static u8 src[64], comp[128], out[64];
+	unsigned int clen = sizeof(comp), olen = sizeof(out);
+	ulong irqFlags;
+	bool known;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdComp;
+	cmd->comp.algo = COMP_ALGO_LZ4;
+	cmd->comp.op = COMP_OP_COMPRESS;
+	cmd->comp.dmaEnable = 0;
+	cmd->comp.srcLen = 0;
+	cmd->comp.dstLen = 0;
+	cmd->comp.srcDdrAddr = 0;
+	cmd->comp.dstDdrAddr = 0;
+	known = cswarpSendMsgToArmTimeout(warpcomp_ctrl, true,
+					  CSWARP_PROBE_TIMEOUT_US) == wacOK &&
+		rpl->header.rpl == dprplComp;
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+	if (!known)
+		return false;
+
+	memset(src, 0x5a, sizeof(src));
+	return warpcomp_run(COMP_ALGO_LZ4, COMP_OP_COMPRESS, src, sizeof(src),
+			    comp, &clen) == 0 &&
+	       warpcomp_run(COMP_ALGO_LZ4, COMP_OP_DECOMPRESS, comp, clen,
+			    out, &olen) == 0 &&
+	       olen == sizeof(src) && memcmp(src, out, olen) == 0;
+}
+
+static void warpcomp_free_batch(void)
+{
+	dma_free_coherent(warpcomp_dmadev, COMP_MAX_BATCH * sizeof(CompBatchEntry),
+			  warpcomp_batch, warpcomp_batchDma);
+	warpcomp_batch = NULL;
+}
+
+static int __init warpcomp_init(void)
+{
+	struct zorro_dev *z, *ddr;
+	int rc;
+
+	z = zorro_find_device(ZORRO_PROD_CSLAB_WARP_CTRL, NULL);
+	if (!z)
+		return -ENODEV;
+	warpcomp_ctrl = (void __iomem *)z->resource.start;
+
+	if (dma_set_mask_and_coherent(&z->dev, DMA_BIT_MASK(32))) {
+		pr_warn("%s: no usable DMA mask, using dpRAM copy\n", DRV_NAME);
+	} else {
+		warpcomp_dmadev = &z->dev;
+		ddr = zorro_find_device(ZORRO_PROD_CSLAB_WARP_DDR3, NULL);
+		if (ddr)
+			warpcomp_ddr = &ddr->resource;
+	}
+
+	if (!warpcomp_probe()) {
+		pr_info("%s: ARM firmware without compression support\n", DRV_NAME);
+		return -ENODEV;
+	}
+
+	rc = crypto_register_algs(warpcomp_algs, ARRAY_SIZE(warpcomp_algs));
+	if (rc)
+		return rc;
+
+	// batches are always moved by DMA
+	if (warpcomp_ddr)
+		warpcomp_batch = dma_alloc_coherent(warpcomp_dmadev,
+					COMP_MAX_BATCH * sizeof(CompBatchEntry),
+					&warpcomp_batchDma, GFP_KERNEL);
+	if (warpcomp_batch) {
+		warpcomp_wb.ctrlBase = warpcomp_ctrl;
+		warpcomp_wb.tableDma = warpcomp_batchDma;
+		// the table is read and written by ARM DMA
+		if (!warpcomp_reach(warpcomp_batchDma,
+				    COMP_MAX_BATCH * sizeof(CompBatchEntry)) ||
+		    !warpbatch_probe(&warpcomp_wb)) {
+			pr_info("%s: batch table out of ARM reach or firmware "
+				"without dpcmdCompBatch, no batched acomp\n", DRV_NAME);
+			warpcomp_free_batch();
+		}
+	}
+	if (warpcomp_batch) {
+		rc = warpbatch_irq_init(&warpcomp_wb);
+		if (rc == 0) {
+			rc = crypto_register_acomps(warpcomp_acomps,
+						    ARRAY_SIZE(warpcomp_acomps));
+			if (rc)
+				warpbatch_irq_exit(&warpcomp_wb);
+		}
+		if (rc) {
+			warpcomp_free_batch();
+			crypto_unregister_algs(warpcomp_algs, ARRAY_SIZE(warpcomp_algs));
+			return rc;
+		}
+	}
+
+	pr_info("%s: lz4, zstd offloaded to ARM%s\n", DRV_NAME,
+		warpcomp_batch ? " (DMA, batched acomp)" : "");
+	return 0;
+}
+
+static void __exit warpcomp_exit(void)
+{
+	if (warpcomp_batch) {
+		crypto_unregister_acomps(warpcomp_acomps, ARRAY_SIZE(warpcomp_acomps));
+		flush_work(&warpcomp_work);
+		warpbatch_irq_exit(&warpcomp_wb);
+		warpcomp_free_batch();
+	}
+	crypto_unregister_algs(warpcomp_algs, ARRAY_SIZE(warpcomp_algs));
+}
+
+module_init(warpcomp_init);
+module_exit(warpcomp_exit);
+
+MODULE_AUTHOR("Andrzej Rogozynski");
+MODULE_DESCRIPTION("csWarp ARM lz4/zstd compression offload");
+MODULE_LICENSE("GPL v2");
+MODULE_ALIAS_CRYPTO("lz4");
+MODULE_ALIAS_CRYPTO("lz4-warp");
+MODULE_ALIAS_CRYPTO("zstd");
+MODULE_ALIAS_CRYPTO("zstd-warp");
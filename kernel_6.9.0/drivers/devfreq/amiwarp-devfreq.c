@@ -0,0 +1,273 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  drivers/devfreq/amiwarp-devfreq.c -- csWarp CPU turbo level scaling
+ *
+ *      Copyright (C) 2024 Andrzej Rogozynski
+ *
+ *  The ARM sets the effective speed of the 68060 by turbo level
+ *  (dpcmdSetCpuTurbo). m68k has no cpufreq, so the levels are exposed as
+ *  a devfreq device: the "frequencies" are turbo level + 1, the default
+ *  simple_ondemand governor follows the CPU load, and devfreq provides
+ *  trans_stat (transitions and time in state).
+ *
+ *  Near the ARM temperature regulator target (tempRegCpu) the highest
+ *  allowed level is stepped down, and raised again once the CPU cooled.
+ *  The temperature is checked by a work of its own, so the cap also
+ *  holds with the performance and userspace governors.
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of this archive for
+ *  more details.
+ */
+
+#include <linux/devfreq.h>
+#include <linux/jiffies.h>
+#include <linux/kernel.h>
+#include <linux/kernel_stat.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/platform_device.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <linux/zorro.h>
+
+#include <asm/cswarpamicomm.h>
+
+#define DRV_NAME	"amiwarp-devfreq"
+
+#define THERMAL_CHECK	msecs_to_jiffies(2000)
+
+static unsigned int max_level = 3;
+module_param(max_level, uint, 0444);
+MODULE_PARM_DESC(max_level, "Highest CPU turbo level of the board (default: 3)");
+
+static unsigned int thermal_margin = 5;
+module_param(thermal_margin, uint, 0644);
+MODULE_PARM_DESC(thermal_margin, "Step down this many degrees C below tempRegCpu (default: 5)");
+
+typedef struct {
+	void __iomem *ctrlBase;
+	struct platform_device *pdev;	// the 68060 as a devfreq device
+	struct devfreq *devfreq;
+	struct devfreq_dev_profile profile;
+	struct devfreq_simple_ondemand_data ondemand;
+
+	struct mutex lock;
+	unsigned int level;	// current turbo level
+	unsigned int cap;	// thermal limit
+	struct delayed_work thermalWork;
+
+	// load accounting
+	u64 lastIdle;
+	u64 lastTime;
+} WarpDevfreq;
+
+static WarpDevfreq *warpdevfreq;
+
+static void warpdevfreq_set_level(WarpDevfreq *wd, unsigned int level)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(wd->ctrlBase);
+	ulong irqFlags;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdSetCpuTurbo;
+	cmd->setCpuTurbo.turboLevel = level;
+	cswarpSendMsgToArm(wd->ctrlBase, false);
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	wd->level = level;
+}
+
+/**
+ * @brief move the thermal cap one level per check, lock held
+ * @param wd driver data
+ * @return true if the cap changed
+*/
+static bool warpdevfreq_thermal(WarpDevfreq *wd)
+{
+	DprRplDiagMsg diag;
+	int temp, limit;
+
+	if (!cswarpReadDiag(wd->ctrlBase, &diag) || diag.tempRegCpu <= 0)
+		return false;
+
+	temp = cswarpFloatToMilli(&diag.t60ntc);
+	limit = (diag.tempRegCpu - (int)thermal_margin) * 1000;
+
+	if (temp >= limit && wd->cap > 0) {
+		wd->cap--;
+		dev_info_ratelimited(&wd->pdev->dev,
+				     "CPU at %s%d.%d C, turbo level limited to %u\n",
+				     temp < 0 ? "-" : "", abs(temp) / 1000,
+				     (abs(temp) % 1000) / 100, wd->cap);
+		return true;
+	}
+	if (temp < limit - (int)thermal_margin * 1000 && wd->cap < max_level) {
+		wd->cap++;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @brief periodic temperature check, whatever the governor
+ * @param work thermalWork
+*/
+static void warpdevfreq_thermal_work(struct work_struct *work)
+{
+	WarpDevfreq *wd = container_of(to_delayed_work(work), WarpDevfreq, thermalWork);
+	bool changed;
+
+	mutex_lock(&wd->lock);
+	changed = warpdevfreq_thermal(wd);
+	mutex_unlock(&wd->lock);
+
+	// let the governor pick again, target applies the new cap
+	if (changed) {
+		mutex_lock(&wd->devfreq->lock);
+		update_devfreq(wd->devfreq);
+		mutex_unlock(&wd->devfreq->lock);
+	}
+	schedule_delayed_work(&wd->thermalWork, THERMAL_CHECK);
+}
+
+static int warpdevfreq_target(struct device *dev, unsigned long *freq, u32 flags)
+{
+	WarpDevfreq *wd = dev_get_drvdata(dev);
+	unsigned int level;
+
+	mutex_lock(&wd->lock);
+	level = clamp_t(unsigned long, *freq, 1, max_level + 1) - 1;
+	level = min(level, wd->cap);
+	if (level != wd->level)
+		warpdevfreq_set_level(wd, level);
+	*freq = level + 1;
+
+	mutex_unlock(&wd->lock);
+	return 0;
+}
+
+static int warpdevfreq_get_dev_status(struct device *dev,
+				      struct devfreq_dev_status *stat)
+{
+	WarpDevfreq *wd = dev_get_drvdata(dev);
+	u64 idle, now;
+
+	// the 68060 is the only CPU
+	idle = kcpustat_cpu(0).cpustat[CPUTIME_IDLE] +
+	       kcpustat_cpu(0).cpustat[CPUTIME_IOWAIT];
+	now = ktime_get_ns();
+
+	stat->total_time = (now - wd->lastTime) >> 10;
+	stat->busy_time = (stat->total_time > (idle - wd->lastIdle) >> 10) ?
+			  stat->total_time - ((idle - wd->lastIdle) >> 10) : 0;
+	stat->current_frequency = wd->level + 1;
+
+	wd->lastIdle = idle;
+	wd->lastTime = now;
+	return 0;
+}
+
+static int warpdevfreq_get_cur_freq(struct device *dev, unsigned long *freq)
+{
+	WarpDevfreq *wd = dev_get_drvdata(dev);
+
+	*freq = wd->level + 1;
+	return 0;
+}
+
+static int __init warpdevfreq_init(void)
+{
+	struct zorro_dev *z;
+	DprRplDiagMsg diag;
+	WarpDevfreq *wd;
+	unsigned int i;
+	int rc;
+
+	z = zorro_find_device(ZORRO_PROD_CSLAB_WARP_CTRL, NULL);
+	if (!z)
+		return -ENODEV;
+	if (max_level == 0)
+		return -EINVAL;
+
+	wd = kzalloc(sizeof(*wd), GFP_KERNEL);
+	if (!wd)
+		return -ENOMEM;
+	wd->ctrlBase = (void __iomem *)z->resource.start;
+	wd->cap = max_level;
+	mutex_init(&wd->lock);
+	INIT_DELAYED_WORK(&wd->thermalWork, warpdevfreq_thermal_work);
+
+	if (!cswarpReadDiag(wd->ctrlBase, &diag)) {
+		rc = -ENODEV;
+		goto err;
+	}
+	wd->level = min(diag.currentTurboLevel, max_level);
+	wd->lastTime = ktime_get_ns();
+
+	wd->profile.freq_table = kcalloc(max_level + 1, sizeof(unsigned long), GFP_KERNEL);
+	if (!wd->profile.freq_table) {
+		rc = -ENOMEM;
+		goto err;
+	}
+	for (i = 0; i <= max_level; i++)
+		wd->profile.freq_table[i] = i + 1;
+	wd->profile.max_state = max_level + 1;
+	wd->profile.initial_freq = wd->level + 1;
+	wd->profile.polling_ms = 100;
+	wd->profile.timer = DEVFREQ_TIMER_DELAYED;
+	wd->profile.target = warpdevfreq_target;
+	wd->profile.get_dev_status = warpdevfreq_get_dev_status;
+	wd->profile.get_cur_freq = warpdevfreq_get_cur_freq;
+
+	// full speed above 60% load, step down below 40%
+	wd->ondemand.upthreshold = 60;
+	wd->ondemand.downdifferential = 20;
+
+	wd->pdev = platform_device_register_simple(DRV_NAME, PLATFORM_DEVID_NONE, NULL, 0);
+	if (IS_ERR(wd->pdev)) {
+		rc = PTR_ERR(wd->pdev);
+		goto err_table;
+	}
+	platform_set_drvdata(wd->pdev, wd);
+
+	wd->devfreq = devfreq_add_device(&wd->pdev->dev, &wd->profile,
+					 DEVFREQ_GOV_SIMPLE_ONDEMAND, &wd->ondemand);
+	if (IS_ERR(wd->devfreq)) {
+		rc = PTR_ERR(wd->devfreq);
+		goto err_pdev;
+	}
+
+	warpdevfreq = wd;
+	schedule_delayed_work(&wd->thermalWork, THERMAL_CHECK);
+	return 0;
+
+err_pdev:
+	platform_device_unregister(wd->pdev);
+err_table:
+	kfree(wd->profile.freq_table);
+err:
+	kfree(wd);
+	return rc;
+}
+
+static void __exit warpdevfreq_exit(void)
+{
+	WarpDevfreq *wd = warpdevfreq;
+
+	cancel_delayed_work_sync(&wd->thermalWork);
+	devfreq_remove_device(wd->devfreq);
+	platform_device_unregister(wd->pdev);
+	// leave the CPU at full speed
+	warpdevfreq_set_level(wd, max_level);
+	kfree(wd->profile.freq_table);
+	kfree(wd);
+}
+
+module_init(warpdevfreq_init);
+module_exit(warpdevfreq_exit);
+
+MODULE_AUTHOR("Andrzej Rogozynski");
+MODULE_DESCRIPTION("csWarp CPU turbo level scaling");
+MODULE_LICENSE("GPL v2");
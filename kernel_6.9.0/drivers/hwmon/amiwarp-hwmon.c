@@ -0,0 +1,254 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  drivers/hwmon/amiwarp-hwmon.c -- csWarp board sensors
+ *
+ *      Copyright (C) 2024 Andrzej Rogozynski
+ *
+ *  Voltages, temperatures and the fan come from the ARM diagnostic frame
+ *  (dpcmdGetDiag). Getting it takes the mailbox, so the whole frame is
+ *  cached and refreshed at most once per update_interval, however many
+ *  attributes are read. The FPGA temperature is a plain register read.
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of this archive for
+ *  more details.
+ */
+
+#include <linux/hwmon.h>
+#include <linux/hwmon-sysfs.h>
+#include <linux/jiffies.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/zorro.h>
+
+#include <asm/cswarpamicomm.h>
+
+#define DRV_NAME	"amiwarp"
+
+static unsigned int update_ms = 2000;
+module_param(update_ms, uint, 0444);
+MODULE_PARM_DESC(update_ms, "Minimum time between ARM diagnostic reads (default: 2000)");
+
+typedef struct {
+	void __iomem *ctrlBase;
+	WarpRegs_mclk *mregs;
+	struct device *hwmonDev;
+
+	struct mutex lock;	// diag cache
+	DprRplDiagMsg diag;
+	unsigned long updated;	// jiffies
+	unsigned long interval;	// jiffies
+	bool valid;
+} WarpHwmon;
+
+static WarpHwmon *warphwmon;
+
+enum { TEMP_CPU, TEMP_CPU_INT, TEMP_ARM, TEMP_FPGA };
+
+static const char * const warphwmon_temp_labels[] = {
+	"CPU", "CPU internal", "ARM", "FPGA"
+};
+
+static const char * const warphwmon_in_labels[] = {
+	"+5V", "VBat"
+};
+
+/**
+ * @brief refresh the diag cache if it is older than the update interval
+ * @param wh driver data, lock held
+ * @return 0 or -EIO if the ARM never replied
+*/
+static int warphwmon_update(WarpHwmon *wh)
+{
+	if (wh->valid && time_before(jiffies, wh->updated + wh->interval))
+		return 0;
+
+	if (cswarpReadDiag(wh->ctrlBase, &wh->diag)) {
+		wh->updated = jiffies;
+		wh->valid = true;
+	}
+	// keep serving a stale frame rather than failing
+	return wh->valid ? 0 : -EIO;
+}
+
+/**
+ * @brief FPGA (Artix XADC) temperature, 12 bit code in bits 15..4
+*/
+static long warphwmon_fpga_temp(WarpHwmon *wh)
+{
+	u32 code = (wh->mregs->artix_temp >> 4) & 0xfff;
+
+	return (long)code * 503975 / 4096 - 273150;
+}
+
+static int warphwmon_read(struct device *dev, enum hwmon_sensor_types type,
+			  u32 attr, int channel, long *val)
+{
+	WarpHwmon *wh = dev_get_drvdata(dev);
+	int rc = 0;
+
+	if (type == hwmon_chip) {
+		*val = jiffies_to_msecs(wh->interval);
+		return 0;
+	}
+	if (type == hwmon_temp && channel == TEMP_FPGA) {
+		*val = warphwmon_fpga_temp(wh);
+		return 0;
+	}
+
+	mutex_lock(&wh->lock);
+	rc = warphwmon_update(wh);
+	if (rc)
+		goto out;
+
+	switch (type) {
+	case hwmon_in:
+		*val = cswarpFloatToMilli(channel ? &wh->diag.vBatt : &wh->diag.vcc5v);
+		break;
+	case hwmon_temp:
+		if (attr == hwmon_temp_max) {
+			*val = wh->diag.tempRegCpu * 1000;
+			break;
+		}
+		if (channel == TEMP_CPU)
+			*val = cswarpFloatToMilli(&wh->diag.t60ntc);
+		else if (channel == TEMP_CPU_INT)
+			*val = cswarpFloatToMilli(&wh->diag.t60internal);
+		else
+			*val = cswarpFloatToMilli(&wh->diag.tArm);
+		break;
+	case hwmon_pwm:
+		*val = min_t(u32, wh->diag.fanPercent, 100) * 255 / 100;
+		break;
+	default:
+		rc = -EOPNOTSUPP;
+	}
+out:
+	mutex_unlock(&wh->lock);
+	return rc;
+}
+
+static int warphwmon_read_string(struct device *dev, enum hwmon_sensor_types type,
+				 u32 attr, int channel, const char **str)
+{
+	if (type == hwmon_temp)
+		*str = warphwmon_temp_labels[channel];
+	else
+		*str = warphwmon_in_labels[channel];
+	return 0;
+}
+
+static int warphwmon_write(struct device *dev, enum hwmon_sensor_types type,
+			   u32 attr, int channel, long val)
+{
+	WarpHwmon *wh = dev_get_drvdata(dev);
+
+	if (type != hwmon_chip || attr != hwmon_chip_update_interval)
+		return -EOPNOTSUPP;
+
+	mutex_lock(&wh->lock);
+	wh->interval = msecs_to_jiffies(clamp_val(val, 100, 60000));
+	mutex_unlock(&wh->lock);
+	return 0;
+}
+
+static umode_t warphwmon_is_visible(const void *data, enum hwmon_sensor_types type,
+				    u32 attr, int channel)
+{
+	if (type == hwmon_chip)
+		return 0644;
+	return 0444;
+}
+
+static const struct hwmon_channel_info * const warphwmon_info[] = {
+	HWMON_CHANNEL_INFO(chip, HWMON_C_UPDATE_INTERVAL),
+	HWMON_CHANNEL_INFO(in,
+			   HWMON_I_INPUT | HWMON_I_LABEL,
+			   HWMON_I_INPUT | HWMON_I_LABEL),
+	HWMON_CHANNEL_INFO(temp,
+			   HWMON_T_INPUT | HWMON_T_LABEL | HWMON_T_MAX,
+			   HWMON_T_INPUT | HWMON_T_LABEL,
+			   HWMON_T_INPUT | HWMON_T_LABEL,
+			   HWMON_T_INPUT | HWMON_T_LABEL),
+	HWMON_CHANNEL_INFO(pwm, HWMON_PWM_INPUT),
+	NULL
+};
+
+static const struct hwmon_ops warphwmon_ops = {
+	.is_visible	= warphwmon_is_visible,
+	.read		= warphwmon_read,
+	.read_string	= warphwmon_read_string,
+	.write		= warphwmon_write,
+};
+
+static const struct hwmon_chip_info warphwmon_chip_info = {
+	.ops	= &warphwmon_ops,
+	.info	= warphwmon_info,
+};
+
+// CPU turbo level, from the same diag frame
+static ssize_t turbo_level_show(struct device *dev, struct device_attribute *attr,
+				char *buf)
+{
+	WarpHwmon *wh = dev_get_drvdata(dev);
+	int rc;
+
+	mutex_lock(&wh->lock);
+	rc = warphwmon_update(wh);
+	if (!rc)
+		rc = sprintf(buf, "%u\n", wh->diag.currentTurboLevel);
+	mutex_unlock(&wh->lock);
+	return rc;
+}
+static DEVICE_ATTR_RO(turbo_level);
+
+static struct attribute *warphwmon_attrs[] = {
+	&dev_attr_turbo_level.attr,
+	NULL
+};
+ATTRIBUTE_GROUPS(warphwmon);
+
+static int __init warphwmon_init(void)
+{
+	struct zorro_dev *z;
+	WarpHwmon *wh;
+
+	z = zorro_find_device(ZORRO_PROD_CSLAB_WARP_CTRL, NULL);
+	if (!z)
+		return -ENODEV;
+
+	wh = kzalloc(sizeof(*wh), GFP_KERNEL);
+	if (!wh)
+		return -ENOMEM;
+	wh->ctrlBase = (void __iomem *)z->resource.start;
+	wh->mregs = (WarpRegs_mclk *)((u32)wh->ctrlBase + WARP_REGS_MCLK_OFFSET);
+	wh->interval = msecs_to_jiffies(clamp_val(update_ms, 100, 60000));
+	mutex_init(&wh->lock);
+
+	wh->hwmonDev = hwmon_device_register_with_info(&z->dev, DRV_NAME, wh,
+						       &warphwmon_chip_info,
+						       warphwmon_groups);
+	if (IS_ERR(wh->hwmonDev)) {
+		int rc = PTR_ERR(wh->hwmonDev);
+
+		kfree(wh);
+		return rc;
+	}
+	warphwmon = wh;
+	return 0;
+}
+
+static void __exit warphwmon_exit(void)
+{
+	hwmon_device_unregister(warphwmon->hwmonDev);
+	kfree(warphwmon);
+}
+
+module_init(warphwmon_init);
+module_exit(warphwmon_exit);
+
+MODULE_AUTHOR("Andrzej Rogozynski");
+MODULE_DESCRIPTION("csWarp board sensors");
+MODULE_LICENSE("GPL v2");
@@ -0,0 +1,290 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  drivers/input/mouse/amiwarpmouse.c -- csWarp USB HID mouse
+ *
+ *      Copyright (C) 2024 Andrzej Rogozynski
+ *
+ *  A USB mouse on the Warp is normally fed by the ARM into the Amiga
+ *  mouse port (amimouse), which loses the wheel and extra buttons.
+ *  While this input device is open the ARM pushes the HID reports into
+ *  a ring in DDR instead and raises DPREG_CR_IF_HID, so motion, buttons
+ *  and wheel reach evdev straight from the interrupt, without polling.
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of this archive for
+ *  more details.
+ */
+
+#include <linux/dma-mapping.h>
+#include <linux/input.h>
+#include <linux/interrupt.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/zorro.h>
+
+#include <asm/amigaints.h>
+#include <asm/cswarpamicomm.h>
+
+#define DRV_NAME	"amiwarpmouse"
+
+typedef struct {
+	void __iomem *ctrlBase;
+	struct device *dmaDev;
+	struct input_dev *input;
+
+	HidMouseRing *ring;
+	dma_addr_t ringDma;
+} WarpMouse;
+
+static WarpMouse *warpmouse;
+
+// resolution given before init (module parameter), 0: left to the ARM
+static unsigned int warpmouse_res;
+
+static const unsigned short warpmouse_buttons[] = {
+	BTN_LEFT, BTN_RIGHT, BTN_MIDDLE, BTN_SIDE, BTN_EXTRA
+};
+
+// ############################################################################
+// resolution, HID counts are scaled by the ARM (256 = 1.0)
+// ############################################################################
+
+static void warpmouse_res_send(WarpMouse *wm, unsigned int res)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(wm->ctrlBase);
+	ulong irqFlags;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdSetHIDMouseRes;
+	cmd->hidMouseRes.hidMouseRes = res;
+	cswarpSendMsgToArm(wm->ctrlBase, false);
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+}
+
+static int warpmouse_res_set(const char *val, const struct kernel_param *kp)
+{
+	unsigned int res;
+	int rc;
+
+	rc = kstrtouint(val, 0, &res);
+	if (rc)
+		return rc;
+	if (res == 0 || res > U16_MAX)
+		return -EINVAL;
+
+	// before init it is sent once the device is set up
+	warpmouse_res = res;
+	if (warpmouse)
+		warpmouse_res_send(warpmouse, res);
+	return 0;
+}
+
+static int warpmouse_res_get(char *buffer, const struct kernel_param *kp)
+{
+	volatile DprCmdFrame __iomem *cmd;
+	volatile DprRplFrame __iomem *rpl;
+	ulong irqFlags;
+	int res = -EIO;
+
+	if (!warpmouse)
+		return warpmouse_res ? sprintf(buffer, "%u\n", warpmouse_res) : -ENODEV;
+
+	cmd = cswarpCmdFrame(warpmouse->ctrlBase);
+	rpl = cswarpRplFrame(warpmouse->ctrlBase);
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdGetHIDMouseRes;
+	cswarpSendMsgToArm(warpmouse->ctrlBase, true);
+	if (rpl->header.rpl == dprplGetHIDMouseRes)
+		res = rpl->hidMouseRes.hidMouseRes;
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	return res < 0 ? res : sprintf(buffer, "%d\n", res);
+}
+
+static const struct kernel_param_ops warpmouse_res_ops = {
+	.set	= warpmouse_res_set,
+	.get	= warpmouse_res_get,
+};
+module_param_cb(resolution, &warpmouse_res_ops, NULL, 0644);
+MODULE_PARM_DESC(resolution, "USB mouse resolution multiplier, 256 = 1.0 (kept by the ARM)");
+
+// ############################################################################
+// reports
+// ############################################################################
+
+static irqreturn_t warpmouse_interrupt(int irq, void *data)
+{
+	WarpMouse *wm = data;
+	volatile u32 __iomem *dp_reg_cr = cswarpDpRegCR(wm->ctrlBase);
+	struct input_dev *dev = wm->input;
+	uint16_t rd, wr;
+	int i;
+
+	if ((*dp_reg_cr & DPREG_CR_IF_HID) == 0)
+		return IRQ_NONE;
+
+	*dp_reg_cr = DPREG_CR_CLR | DPREG_CR_IF_HID;
+
+	rd = wm->ring->readIdx;
+	wr = READ_ONCE(wm->ring->writeIdx);
+	while (rd != wr && wr < HID_MOUSE_RING) {
+		HidMouseReport *r = &wm->ring->report[rd];
+
+		input_report_rel(dev, REL_X, r->dx);
+		input_report_rel(dev, REL_Y, r->dy);
+		input_report_rel(dev, REL_WHEEL, r->wheel);
+		input_report_rel(dev, REL_HWHEEL, r->hwheel);
+		for (i = 0; i < ARRAY_SIZE(warpmouse_buttons); i++)
+			input_report_key(dev, warpmouse_buttons[i], r->buttons & BIT(i));
+		input_sync(dev);
+
+		rd = (rd + 1) % HID_MOUSE_RING;
+	}
+	// tells the ARM the slots are free again
+	WRITE_ONCE(wm->ring->readIdx, rd);
+
+	return IRQ_HANDLED;
+}
+
+static int warpmouse_open(struct input_dev *dev)
+{
+	WarpMouse *wm = input_get_drvdata(dev);
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(wm->ctrlBase);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(wm->ctrlBase);
+	ulong irqFlags;
+	bool ok;
+
+	memset(wm->ring, 0, sizeof(*wm->ring));
+	*cswarpDpRegCR(wm->ctrlBase) = DPREG_CR_CLR | DPREG_CR_IF_HID;
+	*cswarpDpRegCR(wm->ctrlBase) = DPREG_CR_SET | DPREG_CR_IE_HID;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdHIDMouseStart;
+	cmd->hidMouseStart.ringDdrAddr = wm->ringDma;
+	cswarpSendMsgToArm(wm->ctrlBase, true);
+	ok = rpl->header.rpl == dprplHIDMouseStatus && rpl->hidMouseStatus.success;
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	if (!ok) {
+		*cswarpDpRegCR(wm->ctrlBase) = DPREG_CR_CLR | DPREG_CR_IE_HID;
+		return -EIO;
+	}
+	return 0;
+}
+
+// the mouse goes back to the Amiga port
+static void warpmouse_close(struct input_dev *dev)
+{
+	WarpMouse *wm = input_get_drvdata(dev);
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(wm->ctrlBase);
+	ulong irqFlags;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdHIDMouseStop;
+	cswarpSendMsgToArm(wm->ctrlBase, true);
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	*cswarpDpRegCR(wm->ctrlBase) = DPREG_CR_CLR | DPREG_CR_IE_HID;
+}
+
+// ############################################################################
+// init
+// ############################################################################
+
+static int __init warpmouse_init(void)
+{
+	struct zorro_dev *z, *ddr;
+	struct input_dev *dev;
+	WarpMouse *wm;
+	int i, rc;
+
+	z = zorro_find_device(ZORRO_PROD_CSLAB_WARP_CTRL, NULL);
+	if (!z)
+		return -ENODEV;
+	if (dma_set_mask_and_coherent(&z->dev, DMA_BIT_MASK(32)))
+		return -ENODEV;
+
+	wm = kzalloc(sizeof(*wm), GFP_KERNEL);
+	if (!wm)
+		return -ENOMEM;
+	wm->ctrlBase = (void __iomem *)z->resource.start;
+	wm->dmaDev = &z->dev;
+
+	rc = -ENOMEM;
+	wm->ring = dma_alloc_coherent(wm->dmaDev, sizeof(HidMouseRing), &wm->ringDma,
+				      GFP_KERNEL);
+	if (!wm->ring)
+		goto err_free;
+	// the ARM writes the ring, fail without DDR3 or out of its reach
+	ddr = zorro_find_device(ZORRO_PROD_CSLAB_WARP_DDR3, NULL);
+	if (!ddr || wm->ringDma < ddr->resource.start ||
+	    wm->ringDma + sizeof(HidMouseRing) - 1 > ddr->resource.end) {
+		rc = -ENODEV;
+		goto err_ring;
+	}
+
+	rc = -ENOMEM;
+	dev = input_allocate_device();
+	if (!dev)
+		goto err_ring;
+	wm->input = dev;
+
+	dev->name = "csWarp USB mouse";
+	dev->phys = "amiwarp/input0";
+	dev->id.bustype = BUS_AMIGA;
+	dev->id.vendor = 0x0001;
+	dev->id.product = 0x0003;
+	dev->id.version = 0x0100;
+	dev->dev.parent = &z->dev;
+	dev->open = warpmouse_open;
+	dev->close = warpmouse_close;
+
+	input_set_capability(dev, EV_REL, REL_X);
+	input_set_capability(dev, EV_REL, REL_Y);
+	input_set_capability(dev, EV_REL, REL_WHEEL);
+	input_set_capability(dev, EV_REL, REL_HWHEEL);
+	for (i = 0; i < ARRAY_SIZE(warpmouse_buttons); i++)
+		input_set_capability(dev, EV_KEY, warpmouse_buttons[i]);
+	input_set_drvdata(dev, wm);
+
+	rc = request_irq(IRQ_AMIGA_PORTS, warpmouse_interrupt, IRQF_SHARED, DRV_NAME, wm);
+	if (rc)
+		goto err_input;
+
+	rc = input_register_device(dev);
+	if (rc)
+		goto err_irq;
+
+	if (warpmouse_res)
+		warpmouse_res_send(wm, warpmouse_res);
+	warpmouse = wm;
+	return 0;
+
+err_irq:
+	free_irq(IRQ_AMIGA_PORTS, wm);
+err_input:
+	input_free_device(dev);
+err_ring:
+	dma_free_coherent(wm->dmaDev, sizeof(HidMouseRing), wm->ring, wm->ringDma);
+err_free:
+	kfree(wm);
+	return rc;
+}
+
+static void __exit warpmouse_exit(void)
+{
+	WarpMouse *wm = warpmouse;
+
+	warpmouse = NULL;
+	input_unregister_device(wm->input);
+	free_irq(IRQ_AMIGA_PORTS, wm);
+	dma_free_coherent(wm->dmaDev, sizeof(HidMouseRing), wm->ring, wm->ringDma);
+	kfree(wm);
+}
+
+module_init(warpmouse_init);
+module_exit(warpmouse_exit);
+
+MODULE_AUTHOR("Andrzej Rogozynski");
+MODULE_DESCRIPTION("csWarp USB HID mouse");
+MODULE_LICENSE("GPL v2");
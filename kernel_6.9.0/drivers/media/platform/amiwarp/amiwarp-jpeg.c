@@ -0,0 +1,644 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  drivers/media/platform/amiwarp/amiwarp-jpeg.c -- csWarp ARM JPEG decoder
+ *
+ *      Copyright (C) 2024 Andrzej Rogozynski
+ *
+ *  The ARM decodes JPEG in a fraction of the time the 68060 needs. This
+ *  is a V4L2 mem2mem device: JPEG buffers are queued on the OUTPUT
+ *  queue, RGB565 (big endian) or XRGB8888 frames come back on CAPTURE.
+ *  The CAPTURE format sets the frame size, the ARM scales each image
+ *  down to fit (aspect kept, centered on black), which is what an image
+ *  viewer wants for a given screen.
+ *
+ *  Buffers are dma-contig and moved by ARM DMA. One job runs on the ARM
+ *  at a time, its end is signalled with DPREG_CR_IF_JPEG.
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of this archive for
+ *  more details.
+ */
+
+#include <linux/dma-mapping.h>
+#include <linux/interrupt.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/zorro.h>
+#include <media/v4l2-device.h>
+#include <media/v4l2-ioctl.h>
+#include <media/v4l2-mem2mem.h>
+#include <media/videobuf2-dma-contig.h>
+
+#include <asm/amigaints.h>
+#include <asm/cswarpamicomm.h>
+
+#define DRV_NAME	"amiwarp-jpeg"
+
+#define WARPJPEG_MIN_DIM	16
+#define WARPJPEG_MAX_DIM	2048
+#define WARPJPEG_DEF_SRC_SIZE	(2 * 1024 * 1024)
+#define WARPJPEG_MAX_SRC_SIZE	(16 * 1024 * 1024)
+#define WARPJPEG_TIMEOUT	msecs_to_jiffies(3000)
+
+typedef struct {
+	u32 fourcc;
+	uint8_t bitsPerPixel;
+} WarpJpegFmt;
+
+static const WarpJpegFmt warpjpeg_cap_fmts[] = {
+	{ V4L2_PIX_FMT_RGB565X,	16 },
+	{ V4L2_PIX_FMT_XRGB32,	32 },
+};
+
+typedef struct WarpJpegCtx WarpJpegCtx;
+
+typedef struct {
+	struct v4l2_device v4l2Dev;
+	struct video_device vfd;
+	struct v4l2_m2m_dev *m2mDev;
+	struct mutex mutex;		// vfd and vb2 queues
+
+	void __iomem *ctrlBase;
+	struct device *dmaDev;
+
+	// job on the ARM
+	WarpJpegCtx *runCtx;
+	uint32_t jobId;
+	struct work_struct resultWork;
+	struct delayed_work timeoutWork;
+} WarpJpegDev;
+
+struct WarpJpegCtx {
+	struct v4l2_fh fh;
+	WarpJpegDev *dev;
+	struct v4l2_pix_format outFmt;	// JPEG
+	struct v4l2_pix_format capFmt;	// RGB
+};
+
+// Warp DDR3 as seen by the 68k, NULL if not autoconfigured (nothing is reachable)
+static struct resource *warpjpeg_ddr;
+
+static WarpJpegDev *warpjpeg_dev;
+
+static inline WarpJpegCtx *warpjpeg_fh_ctx(struct file *file)
+{
+	return container_of(file->private_data, WarpJpegCtx, fh);
+}
+
+static const WarpJpegFmt *warpjpeg_find_fmt(u32 fourcc)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(warpjpeg_cap_fmts); i++)
+		if (warpjpeg_cap_fmts[i].fourcc == fourcc)
+			return &warpjpeg_cap_fmts[i];
+	return NULL;
+}
+
+static bool warpjpeg_ddr_ok(dma_addr_t addr, unsigned int len)
+{
+	return warpjpeg_ddr && addr >= warpjpeg_ddr->start &&
+	       addr + len - 1 <= warpjpeg_ddr->end;
+}
+
+// ############################################################################
+// jobs
+// ############################################################################
+
+static void warpjpeg_job_done(WarpJpegCtx *ctx, enum vb2_buffer_state state)
+{
+	struct vb2_v4l2_buffer *src, *dst;
+
+	src = v4l2_m2m_src_buf_remove(ctx->fh.m2m_ctx);
+	dst = v4l2_m2m_dst_buf_remove(ctx->fh.m2m_ctx);
+
+	v4l2_m2m_buf_copy_metadata(src, dst, true);
+	vb2_set_plane_payload(&dst->vb2_buf, 0,
+			      state == VB2_BUF_STATE_DONE ? ctx->capFmt.sizeimage : 0);
+	v4l2_m2m_buf_done(src, state);
+	v4l2_m2m_buf_done(dst, state);
+	v4l2_m2m_job_finish(ctx->dev->m2mDev, ctx->fh.m2m_ctx);
+}
+
+static void warpjpeg_device_run(void *priv)
+{
+	WarpJpegCtx *ctx = priv;
+	WarpJpegDev *dev = ctx->dev;
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(dev->ctrlBase);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(dev->ctrlBase);
+	const WarpJpegFmt *fmt = warpjpeg_find_fmt(ctx->capFmt.pixelformat);
+	struct vb2_v4l2_buffer *src, *dst;
+	dma_addr_t srcDma, dstDma;
+	unsigned int srcLen;
+	ulong irqFlags;
+	bool ok;
+
+	src = v4l2_m2m_next_src_buf(ctx->fh.m2m_ctx);
+	dst = v4l2_m2m_next_dst_buf(ctx->fh.m2m_ctx);
+	srcDma = vb2_dma_contig_plane_dma_addr(&src->vb2_buf, 0);
+	dstDma = vb2_dma_contig_plane_dma_addr(&dst->vb2_buf, 0);
+	srcLen = vb2_get_plane_payload(&src->vb2_buf, 0);
+
+	if (!warpjpeg_ddr_ok(srcDma, srcLen) ||
+	    !warpjpeg_ddr_ok(dstDma, ctx->capFmt.sizeimage)) {
+		v4l2_err(&dev->v4l2Dev, "buffer out of ARM reach\n");
+		warpjpeg_job_done(ctx, VB2_BUF_STATE_ERROR);
+		return;
+	}
+
+	// the interrupt may come before the reply is read
+	WRITE_ONCE(dev->runCtx, ctx);
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdJpegDecode;
+	cmd->jpegDecode.jobId = ++dev->jobId;
+	cmd->jpegDecode.srcDdrAddr = srcDma;
+	cmd->jpegDecode.srcLen = srcLen;
+	cmd->jpegDecode.dstAddr = dstDma;
+	cmd->jpegDecode.dstStride = ctx->capFmt.bytesperline;
+	cmd->jpegDecode.dstWidth = ctx->capFmt.width;
+	cmd->jpegDecode.dstHeight = ctx->capFmt.height;
+	cmd->jpegDecode.bitsPerPixel = fmt->bitsPerPixel;
+	cmd->jpegDecode.flags = 0;
+	cswarpSendMsgToArm(dev->ctrlBase, true);
+	ok = rpl->header.rpl == dprplJpegStatus && rpl->jpegStatus.success;
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	if (!ok) {
+		if (xchg(&dev->runCtx, NULL))
+			warpjpeg_job_done(ctx, VB2_BUF_STATE_ERROR);
+		return;
+	}
+	schedule_delayed_work(&dev->timeoutWork, WARPJPEG_TIMEOUT);
+}
+
+static void warpjpeg_result_work(struct work_struct *work)
+{
+	WarpJpegDev *dev = container_of(work, WarpJpegDev, resultWork);
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(dev->ctrlBase);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(dev->ctrlBase);
+	bool done = false, success = false;
+	WarpJpegCtx *ctx;
+	ulong irqFlags;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdJpegGetResult;
+	cswarpSendMsgToArm(dev->ctrlBase, true);
+	if (rpl->header.rpl == dprplJpegResult && !rpl->jpegResult.busy &&
+	    rpl->jpegResult.jobId == dev->jobId) {
+		done = true;
+		success = rpl->jpegResult.success;
+	}
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	if (!done)
+		return;
+	ctx = xchg(&dev->runCtx, NULL);
+	if (!ctx)
+		return;
+	cancel_delayed_work(&dev->timeoutWork);
+	warpjpeg_job_done(ctx, success ? VB2_BUF_STATE_DONE : VB2_BUF_STATE_ERROR);
+}
+
+/**
+ * @brief stop an overdue job, its buffers are only returned once the ARM let go
+ */
+static void warpjpeg_timeout_work(struct work_struct *work)
+{
+	WarpJpegDev *dev = container_of(to_delayed_work(work), WarpJpegDev, timeoutWork);
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(dev->ctrlBase);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(dev->ctrlBase);
+	bool answered, stopped;
+	WarpJpegCtx *ctx;
+	ulong irqFlags;
+
+	if (!READ_ONCE(dev->runCtx))
+		return;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdJpegAbort;
+	cmd->jpegAbort.jobId = dev->jobId;
+	cswarpSendMsgToArm(dev->ctrlBase, true);
+	answered = rpl->header.rpl == dprplJpegStatus;
+	stopped = answered && rpl->jpegStatus.success;
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	if (!answered) {
+		v4l2_warn(&dev->v4l2Dev, "decode timeout, ARM did not stop the job\n");
+		schedule_delayed_work(&dev->timeoutWork, WARPJPEG_TIMEOUT);
+		return;
+	}
+	if (!stopped) {
+		// the job has just ended, fetch its result
+		schedule_work(&dev->resultWork);
+		return;
+	}
+
+	ctx = xchg(&dev->runCtx, NULL);
+	if (!ctx)
+		return;
+	v4l2_warn(&dev->v4l2Dev, "decode timeout, job stopped\n");
+	warpjpeg_job_done(ctx, VB2_BUF_STATE_ERROR);
+}
+
+static irqreturn_t warpjpeg_interrupt(int irq, void *data)
+{
+	WarpJpegDev *dev = data;
+	volatile u32 __iomem *dp_reg_cr = cswarpDpRegCR(dev->ctrlBase);
+
+	if ((*dp_reg_cr & DPREG_CR_IF_JPEG) == 0)
+		return IRQ_NONE;
+
+	*dp_reg_cr = DPREG_CR_CLR | DPREG_CR_IF_JPEG;
+	schedule_work(&dev->resultWork);
+	return IRQ_HANDLED;
+}
+
+static const struct v4l2_m2m_ops warpjpeg_m2m_ops = {
+	.device_run	= warpjpeg_device_run,
+};
+
+// ############################################################################
+// vb2 queues
+// ############################################################################
+
+static struct v4l2_pix_format *warpjpeg_queue_fmt(WarpJpegCtx *ctx,
+						  enum v4l2_buf_type type)
+{
+	return V4L2_TYPE_IS_OUTPUT(type) ? &ctx->outFmt : &ctx->capFmt;
+}
+
+static int warpjpeg_queue_setup(struct vb2_queue *vq, unsigned int *nbuffers,
+				unsigned int *nplanes, unsigned int sizes[],
+				struct device *alloc_devs[])
+{
+	WarpJpegCtx *ctx = vb2_get_drv_priv(vq);
+	struct v4l2_pix_format *pix = warpjpeg_queue_fmt(ctx, vq->type);
+
+	if (*nplanes)
+		return *nplanes != 1 || sizes[0] < pix->sizeimage ? -EINVAL : 0;
+
+	*nplanes = 1;
+	sizes[0] = pix->sizeimage;
+	return 0;
+}
+
+static int warpjpeg_buf_prepare(struct vb2_buffer *vb)
+{
+	WarpJpegCtx *ctx = vb2_get_drv_priv(vb->vb2_queue);
+	struct v4l2_pix_format *pix = warpjpeg_queue_fmt(ctx, vb->type);
+
+	if (V4L2_TYPE_IS_OUTPUT(vb->type))
+		return vb2_get_plane_payload(vb, 0) ? 0 : -EINVAL;
+
+	if (vb2_plane_size(vb, 0) < pix->sizeimage)
+		return -EINVAL;
+	vb2_set_plane_payload(vb, 0, pix->sizeimage);
+	return 0;
+}
+
+static void warpjpeg_buf_queue(struct vb2_buffer *vb)
+{
+	WarpJpegCtx *ctx = vb2_get_drv_priv(vb->vb2_queue);
+
+	v4l2_m2m_buf_queue(ctx->fh.m2m_ctx, to_vb2_v4l2_buffer(vb));
+}
+
+static void warpjpeg_stop_streaming(struct vb2_queue *vq)
+{
+	WarpJpegCtx *ctx = vb2_get_drv_priv(vq);
+	struct vb2_v4l2_buffer *vbuf;
+
+	for (;;) {
+		if (V4L2_TYPE_IS_OUTPUT(vq->type))
+			vbuf = v4l2_m2m_src_buf_remove(ctx->fh.m2m_ctx);
+		else
+			vbuf = v4l2_m2m_dst_buf_remove(ctx->fh.m2m_ctx);
+		if (!vbuf)
+			break;
+		v4l2_m2m_buf_done(vbuf, VB2_BUF_STATE_ERROR);
+	}
+}
+
+static const struct vb2_ops warpjpeg_qops = {
+	.queue_setup	= warpjpeg_queue_setup,
+	.buf_prepare	= warpjpeg_buf_prepare,
+	.buf_queue	= warpjpeg_buf_queue,
+	.stop_streaming	= warpjpeg_stop_streaming,
+	.wait_prepare	= vb2_ops_wait_prepare,
+	.wait_finish	= vb2_ops_wait_finish,
+};
+
+static int warpjpeg_queue_init(void *priv, struct vb2_queue *srcVq,
+			       struct vb2_queue *dstVq)
+{
+	WarpJpegCtx *ctx = priv;
+	int rc;
+
+	srcVq->type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+	srcVq->io_modes = VB2_MMAP | VB2_DMABUF;
+	srcVq->drv_priv = ctx;
+	srcVq->buf_struct_size = sizeof(struct v4l2_m2m_buffer);
+	srcVq->ops = &warpjpeg_qops;
+	srcVq->mem_ops = &vb2_dma_contig_memops;
+	srcVq->timestamp_flags = V4L2_BUF_FLAG_TIMESTAMP_COPY;
+	srcVq->lock = &ctx->dev->mutex;
+	srcVq->dev = ctx->dev->dmaDev;
+	rc = vb2_queue_init(srcVq);
+	if (rc)
+		return rc;
+
+	dstVq->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	dstVq->io_modes = VB2_MMAP | VB2_DMABUF;
+	dstVq->drv_priv = ctx;
+	dstVq->buf_struct_size = sizeof(struct v4l2_m2m_buffer);
+	dstVq->ops = &warpjpeg_qops;
+	dstVq->mem_ops = &vb2_dma_contig_memops;
+	dstVq->timestamp_flags = V4L2_BUF_FLAG_TIMESTAMP_COPY;
+	dstVq->lock = &ctx->dev->mutex;
+	dstVq->dev = ctx->dev->dmaDev;
+	return vb2_queue_init(dstVq);
+}
+
+// ############################################################################
+// ioctls
+// ############################################################################
+
+static int warpjpeg_querycap(struct file *file, void *priv,
+			     struct v4l2_capability *cap)
+{
+	strscpy(cap->driver, DRV_NAME, sizeof(cap->driver));
+	strscpy(cap->card, "csWarp ARM JPEG decoder", sizeof(cap->card));
+	snprintf(cap->bus_info, sizeof(cap->bus_info), "platform:%s", DRV_NAME);
+	return 0;
+}
+
+static int warpjpeg_enum_fmt_cap(struct file *file, void *priv,
+				 struct v4l2_fmtdesc *f)
+{
+	if (f->index >= ARRAY_SIZE(warpjpeg_cap_fmts))
+		return -EINVAL;
+	f->pixelformat = warpjpeg_cap_fmts[f->index].fourcc;
+	return 0;
+}
+
+static int warpjpeg_enum_fmt_out(struct file *file, void *priv,
+				 struct v4l2_fmtdesc *f)
+{
+	if (f->index)
+		return -EINVAL;
+	f->pixelformat = V4L2_PIX_FMT_JPEG;
+	f->flags = V4L2_FMT_FLAG_COMPRESSED;
+	return 0;
+}
+
+static int warpjpeg_g_fmt(struct file *file, void *priv, struct v4l2_format *f)
+{
+	WarpJpegCtx *ctx = warpjpeg_fh_ctx(file);
+
+	f->fmt.pix = *warpjpeg_queue_fmt(ctx, f->type);
+	return 0;
+}
+
+static int warpjpeg_try_fmt_cap(struct file *file, void *priv, struct v4l2_format *f)
+{
+	struct v4l2_pix_format *pix = &f->fmt.pix;
+	const WarpJpegFmt *fmt = warpjpeg_find_fmt(pix->pixelformat);
+
+	if (!fmt)
+		fmt = &warpjpeg_cap_fmts[0];
+	pix->pixelformat = fmt->fourcc;
+	pix->width = clamp_t(u32, pix->width, WARPJPEG_MIN_DIM, WARPJPEG_MAX_DIM);
+	pix->height = clamp_t(u32, pix->height, WARPJPEG_MIN_DIM, WARPJPEG_MAX_DIM);
+	pix->bytesperline = pix->width * fmt->bitsPerPixel / 8;
+	pix->sizeimage = pix->bytesperline * pix->height;
+	pix->field = V4L2_FIELD_NONE;
+	pix->colorspace = V4L2_COLORSPACE_SRGB;
+	return 0;
+}
+
+static int warpjpeg_try_fmt_out(struct file *file, void *priv, struct v4l2_format *f)
+{
+	struct v4l2_pix_format *pix = &f->fmt.pix;
+
+	pix->pixelformat = V4L2_PIX_FMT_JPEG;
+	pix->bytesperline = 0;
+	if (!pix->sizeimage)
+		pix->sizeimage = WARPJPEG_DEF_SRC_SIZE;
+	pix->sizeimage = clamp_t(u32, pix->sizeimage, PAGE_SIZE, WARPJPEG_MAX_SRC_SIZE);
+	pix->field = V4L2_FIELD_NONE;
+	pix->colorspace = V4L2_COLORSPACE_JPEG;
+	return 0;
+}
+
+static int warpjpeg_s_fmt(struct file *file, struct v4l2_format *f,
+			  int (*try)(struct file *, void *, struct v4l2_format *))
+{
+	WarpJpegCtx *ctx = warpjpeg_fh_ctx(file);
+	struct vb2_queue *vq = v4l2_m2m_get_vq(ctx->fh.m2m_ctx, f->type);
+
+	if (vb2_is_busy(vq))
+		return -EBUSY;
+	try(file, NULL, f);
+	*warpjpeg_queue_fmt(ctx, f->type) = f->fmt.pix;
+	return 0;
+}
+
+static int warpjpeg_s_fmt_cap(struct file *file, void *priv, struct v4l2_format *f)
+{
+	return warpjpeg_s_fmt(file, f, warpjpeg_try_fmt_cap);
+}
+
+static int warpjpeg_s_fmt_out(struct file *file, void *priv, struct v4l2_format *f)
+{
+	return warpjpeg_s_fmt(file, f, warpjpeg_try_fmt_out);
+}
+
+static const struct v4l2_ioctl_ops warpjpeg_ioctl_ops = {
+	.vidioc_querycap		= warpjpeg_querycap,
+
+	.vidioc_enum_fmt_vid_cap	= warpjpeg_enum_fmt_cap,
+	.vidioc_g_fmt_vid_cap		= warpjpeg_g_fmt,
+	.vidioc_try_fmt_vid_cap		= warpjpeg_try_fmt_cap,
+	.vidioc_s_fmt_vid_cap		= warpjpeg_s_fmt_cap,
+
+	.vidioc_enum_fmt_vid_out	= warpjpeg_enum_fmt_out,
+	.vidioc_g_fmt_vid_out		= warpjpeg_g_fmt,
+	.vidioc_try_fmt_vid_out		= warpjpeg_try_fmt_out,
+	.vidioc_s_fmt_vid_out		= warpjpeg_s_fmt_out,
+
+	.vidioc_reqbufs			= v4l2_m2m_ioctl_reqbufs,
+	.vidioc_querybuf		= v4l2_m2m_ioctl_querybuf,
+	.vidioc_qbuf			= v4l2_m2m_ioctl_qbuf,
+	.vidioc_dqbuf			= v4l2_m2m_ioctl_dqbuf,
+	.vidioc_prepare_buf		= v4l2_m2m_ioctl_prepare_buf,
+	.vidioc_create_bufs		= v4l2_m2m_ioctl_create_bufs,
+	.vidioc_expbuf			= v4l2_m2m_ioctl_expbuf,
+	.vidioc_streamon		= v4l2_m2m_ioctl_streamon,
+	.vidioc_streamoff		= v4l2_m2m_ioctl_streamoff,
+};
+
+// ############################################################################
+// file operations
+// ############################################################################
+
+static int warpjpeg_open(struct file *file)
+{
+	WarpJpegDev *dev = video_drvdata(file);
+	struct v4l2_format f = { };
+	WarpJpegCtx *ctx;
+	int rc = 0;
+
+	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+	ctx->dev = dev;
+
+	v4l2_fh_init(&ctx->fh, video_devdata(file));
+	file->private_data = &ctx->fh;
+
+	// 640x480 RGB565, 2 MB JPEGs
+	f.fmt.pix.width = 640;
+	f.fmt.pix.height = 480;
+	warpjpeg_try_fmt_cap(file, NULL, &f);
+	ctx->capFmt = f.fmt.pix;
+	memset(&f, 0, sizeof(f));
+	warpjpeg_try_fmt_out(file, NULL, &f);
+	ctx->outFmt = f.fmt.pix;
+
+	mutex_lock(&dev->mutex);
+	ctx->fh.m2m_ctx = v4l2_m2m_ctx_init(dev->m2mDev, ctx, warpjpeg_queue_init);
+	mutex_unlock(&dev->mutex);
+	if (IS_ERR(ctx->fh.m2m_ctx)) {
+		rc = PTR_ERR(ctx->fh.m2m_ctx);
+		v4l2_fh_exit(&ctx->fh);
+		kfree(ctx);
+		return rc;
+	}
+
+	v4l2_fh_add(&ctx->fh);
+	return 0;
+}
+
+static int warpjpeg_release(struct file *file)
+{
+	WarpJpegCtx *ctx = warpjpeg_fh_ctx(file);
+	WarpJpegDev *dev = ctx->dev;
+
+	v4l2_fh_del(&ctx->fh);
+	v4l2_fh_exit(&ctx->fh);
+	mutex_lock(&dev->mutex);
+	v4l2_m2m_ctx_release(ctx->fh.m2m_ctx);
+	mutex_unlock(&dev->mutex);
+	kfree(ctx);
+	return 0;
+}
+
+static const struct v4l2_file_operations warpjpeg_fops = {
+	.owner		= THIS_MODULE,
+	.open		= warpjpeg_open,
+	.release	= warpjpeg_release,
+	.poll		= v4l2_m2m_fop_poll,
+	.unlocked_ioctl	= video_ioctl2,
+	.mmap		= v4l2_m2m_fop_mmap,
+};
+
+// ############################################################################
+// init
+// ############################################################################
+
+static int __init warpjpeg_init(void)
+{
+	struct zorro_dev *z, *ddr;
+	WarpJpegDev *dev;
+	int rc;
+
+	z = zorro_find_device(ZORRO_PROD_CSLAB_WARP_CTRL, NULL);
+	if (!z)
+		return -ENODEV;
+	if (dma_set_mask_and_coherent(&z->dev, DMA_BIT_MASK(32)))
+		return -ENODEV;
+	ddr = zorro_find_device(ZORRO_PROD_CSLAB_WARP_DDR3, NULL);
+	if (ddr)
+		warpjpeg_ddr = &ddr->resource;
+
+	dev = kzalloc(sizeof(*dev), GFP_KERNEL);
+	if (!dev)
+		return -ENOMEM;
+	dev->ctrlBase = (void __iomem *)z->resource.start;
+	dev->dmaDev = &z->dev;
+	mutex_init(&dev->mutex);
+	INIT_WORK(&dev->resultWork, warpjpeg_result_work);
+	INIT_DELAYED_WORK(&dev->timeoutWork, warpjpeg_timeout_work);
+
+	rc = v4l2_device_register(&z->dev, &dev->v4l2Dev);
+	if (rc)
+		goto out_free;
+
+	dev->m2mDev = v4l2_m2m_init(&warpjpeg_m2m_ops);
+	if (IS_ERR(dev->m2mDev)) {
+		rc = PTR_ERR(dev->m2mDev);
+		goto out_v4l2;
+	}
+
+	rc = request_irq(IRQ_AMIGA_PORTS, warpjpeg_interrupt, IRQF_SHARED, DRV_NAME, dev);
+	if (rc)
+		goto out_m2m;
+	*cswarpDpRegCR(dev->ctrlBase) = DPREG_CR_CLR | DPREG_CR_IF_JPEG;
+	*cswarpDpRegCR(dev->ctrlBase) = DPREG_CR_SET | DPREG_CR_IE_JPEG;
+
+	strscpy(dev->vfd.name, DRV_NAME, sizeof(dev->vfd.name));
+	dev->vfd.fops = &warpjpeg_fops;
+	dev->vfd.ioctl_ops = &warpjpeg_ioctl_ops;
+	dev->vfd.release = video_device_release_empty;
+	dev->vfd.lock = &dev->mutex;
+	dev->vfd.v4l2_dev = &dev->v4l2Dev;
+	dev->vfd.vfl_dir = VFL_DIR_M2M;
+	dev->vfd.device_caps = V4L2_CAP_VIDEO_M2M | V4L2_CAP_STREAMING;
+	video_set_drvdata(&dev->vfd, dev);
+
+	rc = video_register_device(&dev->vfd, VFL_TYPE_VIDEO, -1);
+	if (rc)
+		goto out_irq;
+
+	warpjpeg_dev = dev;
+	v4l2_info(&dev->v4l2Dev, "JPEG decoder at /dev/%s\n",
+		  video_device_node_name(&dev->vfd));
+	return 0;
+
+out_irq:
+	*cswarpDpRegCR(dev->ctrlBase) = DPREG_CR_CLR | DPREG_CR_IE_JPEG;
+	free_irq(IRQ_AMIGA_PORTS, dev);
+out_m2m:
+	v4l2_m2m_release(dev->m2mDev);
+out_v4l2:
+	v4l2_device_unregister(&dev->v4l2Dev);
+out_free:
+	kfree(dev);
+	return rc;
+}
+
+static void __exit warpjpeg_exit(void)
+{
+	WarpJpegDev *dev = warpjpeg_dev;
+
+	video_unregister_device(&dev->vfd);
+	*cswarpDpRegCR(dev->ctrlBase) = DPREG_CR_CLR | DPREG_CR_IE_JPEG;
+	free_irq(IRQ_AMIGA_PORTS, dev);
+	cancel_work_sync(&dev->resultWork);
+	cancel_delayed_work_sync(&dev->timeoutWork);
+	v4l2_m2m_release(dev->m2mDev);
+	v4l2_device_unregister(&dev->v4l2Dev);
+	kfree(dev);
+}
+
+module_init(warpjpeg_init);
+module_exit(warpjpeg_exit);
+
+MODULE_AUTHOR("Andrzej Rogozynski");
+MODULE_DESCRIPTION("csWarp ARM JPEG decoder");
+MODULE_LICENSE("GPL v2");
@@ -22,10 +22,23 @@
 #include <linux/etherdevice.h>
 #include <linux/ethtool.h>
 #include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/miscdevice.h>
+#include <linux/dma-mapping.h>
+#include <linux/poll.h>
+#include <linux/ip.h>
+#include <uapi/linux/amiwarpnet.h>
+#include <net/flow_offload.h>
+#include <net/pkt_cls.h>
+#include <net/busy_poll.h>
+#include <net/tcp.h>
 
 #include <asm/amigaints.h>
+#include <asm/unaligned.h>
 #include <asm/cswarpdefs.h>
 #include <asm/cswarpamicommdata.h>
+#include <asm/cswarpamicomm.h>
 
 #define DRV_NAME	"amiwarpnet"
 #define DRV_VERSION	"2024-06-12"
@@ -34,19 +47,74 @@
 #define TX_TIMEOUT (2 * HZ)
 #define TMR_POLL_INTERVAL (100 * HZ / 1000)
 
+/* ethtool self-test (ARM loopback) parameters */
+#define SELFTEST_FRAMES		256
+#define SELFTEST_RX_TRIES	1000
+#define SELFTEST_ETHERTYPE	0x88b5	/* IEEE local experimental */
+
+static uint capture_ring_kb = 256;
+module_param(capture_ring_kb, uint, 0444);
+MODULE_PARM_DESC(capture_ring_kb, "ARM capture ring size in KB (default 256)");
+
+/* size of the ARM flow offload table */
+#define FLOW_TABLE_SIZE		64
+
+typedef struct {
+	unsigned long cookie;
+	bool used;
+	u32 packets;
+	u32 bytes;
+} WarpNetFlow;
+
 typedef struct {
     void __iomem *ctrlBase;
 	struct timer_list pollTimer;
-	spinlock_t dpram_lock;
 
 	struct napi_struct napi;
 	struct net_device *ndev;
 	bool promisc;
 	u32 msg_enable;
+
+	// ARM-side capture ring (/dev/warpcap)
+	struct miscdevice capDev;
+	struct mutex capLock;
+	wait_queue_head_t capWait;
+	unsigned long capOpen;
+	void *capRing;
+	dma_addr_t capRingDma;
+	u32 capRingSize;
+	bool capRunning;
+	struct warpcap_filter capFilter;
+	struct resource *ddr;	// Warp DDR3, the only memory ARM DMA reaches
+
+	// flows offloaded to ARM (index == ARM flowId)
+	struct mutex flowLock;
+	WarpNetFlow flows[FLOW_TABLE_SIZE];
 } WarpNetPriv;
 
 static const char bcast_addr[ETH_ALEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
 
+static LIST_HEAD(warpnet_tc_block_cb_list);
+static LIST_HEAD(warpnet_ft_block_cb_list);
+
+// frame sizes measured by the loopback self-test
+static const uint selftest_sizes[] = { 60, 128, 512, 1024, ETH_MTU_AND_HDR_SIZE };
+
+static const char selftest_strings[][ETH_GSTRING_LEN] = {
+	"ARM loopback     (offline)",
+	"  60 byte pkt/s  (offline)",
+	"  60 byte KB/s   (offline)",
+	" 128 byte pkt/s  (offline)",
+	" 128 byte KB/s   (offline)",
+	" 512 byte pkt/s  (offline)",
+	" 512 byte KB/s   (offline)",
+	"1024 byte pkt/s  (offline)",
+	"1024 byte KB/s   (offline)",
+	"1514 byte pkt/s  (offline)",
+	"1514 byte KB/s   (offline)",
+};
+#define SELFTEST_LEN	ARRAY_SIZE(selftest_strings)
+
 // ############################################################################
 // Warp HW functions
 // ############################################################################
@@ -56,15 +124,14 @@ static void cleanupIrqAndFlags(WarpNetPriv *priv)
 		(volatile u32*)((u32)priv->ctrlBase | WARP_OFFSET_DPREG_CR);
 
 	// clear all IRQs and flags (ARM <-> 68k comm)
+	// ETHST belongs to /dev/warpcap and does not follow the netdev state
 	*dp_reg_cr = DPREG_CR_CLR | 
 				 DPREG_CR_MP_68K | DPREG_CR_MP_ARM |
 				 DPREG_CR_MR_68K | DPREG_CR_MR_ARM |
 				 DPREG_CR_IE_68K | 
 				 DPREG_CR_IE_ETHRX | 
-				 DPREG_CR_IE_ETHST | 
 				 DPREG_CR_IE_ETHTX |
 				 DPREG_CR_IF_ETHRX | 
-				 DPREG_CR_IF_ETHST | 
 				 DPREG_CR_IF_ETHTX;
 }
 
@@ -81,10 +148,19 @@ static irqreturn_t warpnet_irq(int irq, void *ndev_instance)
 		*dp_reg_cr = DPREG_CR_CLR | DPREG_CR_IF_ETHRX;
 		// eth frame received
 		if (napi_schedule_prep(&priv->napi)) {
+			// rx irq stays masked until napi (or busy polling socket)
+			// has drained the ARM rx queue
+			*dp_reg_cr = DPREG_CR_CLR | DPREG_CR_IE_ETHRX;
 			__napi_schedule(&priv->napi);
 		}		
 		res = IRQ_HANDLED;
 	}
+	if(*dp_reg_cr & DPREG_CR_IF_ETHST) {
+		*dp_reg_cr = DPREG_CR_CLR | DPREG_CR_IF_ETHST;
+		// ARM has put new frames into capture ring
+		wake_up_interruptible(&priv->capWait);
+		res = IRQ_HANDLED;
+	}
 
 	return res;
 }
@@ -99,25 +175,7 @@ static irqreturn_t warpnet_irq(int irq, void *ndev_instance)
  */
 static WarpAmiCommStatus sendMsgToArm(WarpNetPriv *priv, bool waitForReply)
 {
-  volatile u32 __iomem *dp_reg_cr = 
-  		(volatile u32*)((u32)priv->ctrlBase | WARP_OFFSET_DPREG_CR);
-  
-  // send irq to ARM
-  *dp_reg_cr = DPREG_CR_SET | DPREG_CR_MP_ARM | DPREG_CR_IE_ARM;
-
-  // wait for ARM has processed the message
-  while((*dp_reg_cr & DPREG_CR_MR_ARM) == 0);
-  // clear flag
-  *dp_reg_cr = DPREG_CR_CLR | DPREG_CR_MR_ARM | DPREG_CR_IE_ARM;
-
-  if(waitForReply) {
-    // wait for ARM reply
-	while((*dp_reg_cr & DPREG_CR_MP_68K) == 0);
-	// clear flag
-	*dp_reg_cr = DPREG_CR_CLR | DPREG_CR_MP_68K;
-  }
-
-  return wacOK;
+  return cswarpSendMsgToArm(priv->ctrlBase, waitForReply);
 }
 
 static WarpAmiCommStatus ethGetMacAddress(WarpNetPriv *priv, char *mac)
@@ -128,21 +186,671 @@ static WarpAmiCommStatus ethGetMacAddress(WarpNetPriv *priv, char *mac)
 		(volatile DprRplFrame*)cmd;
 	ulong irqFlags;
 
-	spin_lock_irqsave(&priv->dpram_lock, irqFlags);
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
 
 	cmd->header.cmd = dpcmdEthGetMACAddr;
 	sendMsgToArm(priv, true);
 
 	if(rpl->header.rpl != dprplEthMACAddr) {
-		spin_unlock_irqrestore(&priv->dpram_lock, irqFlags);
+		spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
 		return wacCOMERR;
 	}
 	memcpy(mac, (void*)rpl->ethMAC.mac, ETH_ALEN);
-	spin_unlock_irqrestore(&priv->dpram_lock, irqFlags);
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	return wacOK;
+}
+
+static WarpAmiCommStatus ethSetLoopback(WarpNetPriv *priv, bool enable)
+{
+	volatile DprCmdFrame __iomem *cmd = 
+		(volatile DprCmdFrame*)((u32)priv->ctrlBase | WARP_OFFSET_DPRAM);
+	volatile DprRplFrame __iomem *rpl = 
+		(volatile DprRplFrame*)cmd;
+	WarpAmiCommStatus status;
+	ulong irqFlags;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdEthSetLoopback;
+	cmd->ethLoopback.enable = enable ? 1 : 0;
+	status = sendMsgToArm(priv, true);
+	if(status == wacOK && rpl->header.rpl != dprplEthLoopbackStatus)
+		status = wacCOMERR;
+	else if(status == wacOK && !rpl->ethLoopbackStatus.success)
+		status = wacBUFFERR;
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	return status;
+}
+
+/**
+ * @brief send frames through ARM loopback and wait for each of them
+ *        to come back on rx (ping-pong, one frame in flight)
+ * @param priv WarpNetPriv data
+ * @param frame test frame (dst/src MAC and ethertype already set)
+ * @param size frame size
+ * @param elapsed_ns time spent for SELFTEST_FRAMES round trips
+ * @return 0 if all frames came back unchanged
+ */
+static int ethLoopbackRun(WarpNetPriv *priv, u8 *frame, uint size, u64 *elapsed_ns)
+{
+	volatile DprCmdFrame __iomem *cmd = 
+		(volatile DprCmdFrame*)((u32)priv->ctrlBase | WARP_OFFSET_DPRAM);
+	volatile DprRplFrame __iomem *rpl = 
+		(volatile DprRplFrame*)cmd;
+	ulong irqFlags;
+	u64 start;
+	uint i, tries;
+
+	start = ktime_get_ns();
+	for(i = 0; i < SELFTEST_FRAMES; i++) {
+		bool received = false;
+
+		// sequence number right after the ethertype
+		put_unaligned_be32(i, &frame[ETH_HLEN]);
+
+		spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+		cmd->header.cmd = dpcmdEthTransmit;
+		cmd->ethSend.pktSize = size;
+		memcpy((void*)cmd->ethSend.packet, frame, size);
+		sendMsgToArm(priv, false);
+		spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+		for(tries = 0; tries < SELFTEST_RX_TRIES && !received; tries++) {
+			uint16_t rx_len;
+
+			spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+			cmd->header.cmd = dpcmdEthReceive;
+			sendMsgToArm(priv, true);
+			if(rpl->header.rpl != dprplEthReceive) {
+				spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+				return -EIO;
+			}
+			rx_len = rpl->ethRecv.pktSize;
+			// anything else than our frame (late wire traffic) is dropped
+			received = (rx_len == size) &&
+				(memcmp((void*)rpl->ethRecv.packet, frame, size) == 0);
+			spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+			if(rx_len == 0)
+				udelay(10);
+		}
+		if(!received)
+			return -ETIMEDOUT;
+	}
+	*elapsed_ns = ktime_get_ns() - start;
+
+	return 0;
+}
+
+// ############################################################################
+// ARM capture ring (/dev/warpcap)
+// ############################################################################
+
+static WarpAmiCommStatus ethCaptureStart(WarpNetPriv *priv)
+{
+	volatile DprCmdFrame __iomem *cmd = 
+		(volatile DprCmdFrame*)((u32)priv->ctrlBase | WARP_OFFSET_DPRAM);
+	ulong irqFlags;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdEthCaptureStart;
+	cmd->ethCapture.ringDdrAddr = priv->capRingDma;
+	cmd->ethCapture.ringSize = priv->capRingSize - WARPCAP_RING_DATA_OFFSET;
+	cmd->ethCapture.etherType = priv->capFilter.ethertype;
+	cmd->ethCapture.ipProto = priv->capFilter.ip_proto;
+	cmd->ethCapture.port = priv->capFilter.port;
+	cmd->ethCapture.snapLen = priv->capFilter.snaplen;
+	sendMsgToArm(priv, false);
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
 
 	return wacOK;
 }
 
+static WarpAmiCommStatus ethCaptureStop(WarpNetPriv *priv)
+{
+	volatile DprCmdFrame __iomem *cmd = 
+		(volatile DprCmdFrame*)((u32)priv->ctrlBase | WARP_OFFSET_DPRAM);
+	ulong irqFlags;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdEthCaptureStop;
+	// wait for reply, ARM must not touch the ring anymore
+	sendMsgToArm(priv, true);
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	return wacOK;
+}
+
+/**
+ * @brief read ring header written by ARM (bypassing 68060 data cache)
+ */
+static void capReadRingHdr(WarpNetPriv *priv, struct warpcap_ring_hdr *hdr)
+{
+	dma_sync_single_for_cpu(priv->ndev->dev.parent, priv->capRingDma,
+				sizeof(*hdr), DMA_FROM_DEVICE);
+	memcpy(hdr, priv->capRing, sizeof(*hdr));
+}
+
+static int warpcap_open(struct inode *inode, struct file *file)
+{
+	WarpNetPriv *priv = container_of(file->private_data, WarpNetPriv, capDev);
+	struct device *dev = priv->ndev->dev.parent;
+	struct warpcap_ring_hdr *hdr;
+
+	if (test_and_set_bit(0, &priv->capOpen))
+		return -EBUSY;
+
+	priv->capRingSize = PAGE_ALIGN(capture_ring_kb * 1024);
+	priv->capRing = (void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO,
+						  get_order(priv->capRingSize));
+	if (!priv->capRing) {
+		clear_bit(0, &priv->capOpen);
+		return -ENOMEM;
+	}
+	hdr = priv->capRing;
+	hdr->size = priv->capRingSize - WARPCAP_RING_DATA_OFFSET;
+
+	// ARM writes straight into these pages
+	priv->capRingDma = dma_map_single(dev, priv->capRing, priv->capRingSize,
+					  DMA_BIDIRECTIONAL);
+	if (dma_mapping_error(dev, priv->capRingDma)) {
+		free_pages((ulong)priv->capRing, get_order(priv->capRingSize));
+		priv->capRing = NULL;
+		clear_bit(0, &priv->capOpen);
+		return -ENOMEM;
+	}
+	if (!priv->ddr || priv->capRingDma < priv->ddr->start ||
+	    priv->capRingDma + priv->capRingSize - 1 > priv->ddr->end) {
+		netif_err(priv, drv, priv->ndev, "capture ring out of ARM reach\n");
+		dma_unmap_single(dev, priv->capRingDma, priv->capRingSize,
+				 DMA_BIDIRECTIONAL);
+		free_pages((ulong)priv->capRing, get_order(priv->capRingSize));
+		priv->capRing = NULL;
+		clear_bit(0, &priv->capOpen);
+		return -ENODEV;
+	}
+	memset(&priv->capFilter, 0, sizeof(priv->capFilter));
+
+	return 0;
+}
+
+static void warpcap_stop(WarpNetPriv *priv)
+{
+	volatile u32 __iomem *dp_reg_cr = 
+		(volatile u32*)((u32)priv->ctrlBase | WARP_OFFSET_DPREG_CR);
+
+	if (!priv->capRunning)
+		return;
+
+	*dp_reg_cr = DPREG_CR_CLR | DPREG_CR_IE_ETHST;
+	ethCaptureStop(priv);
+	priv->capRunning = false;
+	wake_up_interruptible(&priv->capWait);
+}
+
+static int warpcap_release(struct inode *inode, struct file *file)
+{
+	WarpNetPriv *priv = container_of(file->private_data, WarpNetPriv, capDev);
+
+	mutex_lock(&priv->capLock);
+	warpcap_stop(priv);
+	mutex_unlock(&priv->capLock);
+
+	dma_unmap_single(priv->ndev->dev.parent, priv->capRingDma,
+			 priv->capRingSize, DMA_BIDIRECTIONAL);
+	free_pages((ulong)priv->capRing, get_order(priv->capRingSize));
+	priv->capRing = NULL;
+	clear_bit(0, &priv->capOpen);
+
+	return 0;
+}
+
+static long warpcap_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+	WarpNetPriv *priv = container_of(file->private_data, WarpNetPriv, capDev);
+	void __user *argp = (void __user *)arg;
+	volatile u32 __iomem *dp_reg_cr = 
+		(volatile u32*)((u32)priv->ctrlBase | WARP_OFFSET_DPREG_CR);
+	struct warpcap_filter filter;
+	u32 size;
+	int ret = 0;
+
+	mutex_lock(&priv->capLock);
+	switch (cmd) {
+	case WARPCAP_SET_FILTER:
+		if (copy_from_user(&filter, argp, sizeof(filter))) {
+			ret = -EFAULT;
+			break;
+		}
+		if (filter.snaplen > ETH_MTU_AND_HDR_SIZE)
+			filter.snaplen = ETH_MTU_AND_HDR_SIZE;
+		priv->capFilter = filter;
+		// new filter is pushed down at once when capture is running
+		if (priv->capRunning)
+			ethCaptureStart(priv);
+		break;
+	case WARPCAP_START:
+		if (priv->capRunning)
+			break;
+		priv->capRunning = true;
+		*dp_reg_cr = DPREG_CR_CLR | DPREG_CR_IF_ETHST;
+		*dp_reg_cr = DPREG_CR_SET | DPREG_CR_IE_ETHST;
+		ethCaptureStart(priv);
+		// safety net wakeups also while the interface is down
+		if (!timer_pending(&priv->pollTimer))
+			mod_timer(&priv->pollTimer, jiffies + TMR_POLL_INTERVAL);
+		netif_info(priv, drv, priv->ndev,
+			   "capture started (type 0x%04x proto %u port %u snaplen %u)\n",
+			   priv->capFilter.ethertype, priv->capFilter.ip_proto,
+			   priv->capFilter.port, priv->capFilter.snaplen);
+		break;
+	case WARPCAP_STOP:
+		warpcap_stop(priv);
+		break;
+	case WARPCAP_GET_RING_SIZE:
+		size = priv->capRingSize;
+		if (copy_to_user(argp, &size, sizeof(size)))
+			ret = -EFAULT;
+		break;
+	default:
+		ret = -ENOTTY;
+		break;
+	}
+	mutex_unlock(&priv->capLock);
+
+	return ret;
+}
+
+static int warpcap_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	WarpNetPriv *priv = container_of(file->private_data, WarpNetPriv, capDev);
+	ulong size = vma->vm_end - vma->vm_start;
+
+	if (vma->vm_pgoff != 0 || size > priv->capRingSize)
+		return -EINVAL;
+
+	// ring is shared with ARM DMA, reader must not see stale cache lines
+	vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+	return remap_pfn_range(vma, vma->vm_start,
+			       virt_to_phys(priv->capRing) >> PAGE_SHIFT,
+			       size, vma->vm_page_prot);
+}
+
+static __poll_t warpcap_poll(struct file *file, poll_table *wait)
+{
+	WarpNetPriv *priv = container_of(file->private_data, WarpNetPriv, capDev);
+	struct warpcap_ring_hdr hdr;
+
+	poll_wait(file, &priv->capWait, wait);
+
+	capReadRingHdr(priv, &hdr);
+	if (hdr.head != hdr.tail)
+		return EPOLLIN | EPOLLRDNORM;
+	if (!priv->capRunning)
+		return EPOLLHUP;
+	return 0;
+}
+
+static const struct file_operations warpcap_fops = {
+	.owner		= THIS_MODULE,
+	.open		= warpcap_open,
+	.release	= warpcap_release,
+	.unlocked_ioctl	= warpcap_ioctl,
+	.mmap		= warpcap_mmap,
+	.poll		= warpcap_poll,
+	.llseek		= noop_llseek,
+};
+
+// ############################################################################
+// flow offload (tc flower / nf_flowtable)
+// ############################################################################
+
+static WarpAmiCommStatus ethFlowAdd(WarpNetPriv *priv, const DprCmdEthFlowAdd *entry)
+{
+	volatile DprCmdFrame __iomem *cmd = 
+		(volatile DprCmdFrame*)((u32)priv->ctrlBase | WARP_OFFSET_DPRAM);
+	volatile DprRplFrame __iomem *rpl = 
+		(volatile DprRplFrame*)cmd;
+	WarpAmiCommStatus status = wacOK;
+	ulong irqFlags;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	memcpy((void*)&cmd->ethFlowAdd, entry, sizeof(*entry));
+	cmd->header.cmd = dpcmdEthFlowAdd;
+	sendMsgToArm(priv, true);
+	if(rpl->header.rpl != dprplEthFlowStatus)
+		status = wacCOMERR;
+	else if(!rpl->ethFlowStatus.success)
+		status = wacBUFFERR;
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	return status;
+}
+
+static WarpAmiCommStatus ethFlowDel(WarpNetPriv *priv, u32 flowId)
+{
+	volatile DprCmdFrame __iomem *cmd = 
+		(volatile DprCmdFrame*)((u32)priv->ctrlBase | WARP_OFFSET_DPRAM);
+	volatile DprRplFrame __iomem *rpl = 
+		(volatile DprRplFrame*)cmd;
+	WarpAmiCommStatus status = wacOK;
+	ulong irqFlags;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdEthFlowDel;
+	cmd->ethFlowId.flowId = flowId;
+	sendMsgToArm(priv, true);
+	if(rpl->header.rpl != dprplEthFlowStatus)
+		status = wacCOMERR;
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	return status;
+}
+
+static WarpAmiCommStatus ethFlowGetStats(WarpNetPriv *priv, u32 flowId,
+					 u32 *packets, u32 *bytes, u32 *idleMs)
+{
+	volatile DprCmdFrame __iomem *cmd = 
+		(volatile DprCmdFrame*)((u32)priv->ctrlBase | WARP_OFFSET_DPRAM);
+	volatile DprRplFrame __iomem *rpl = 
+		(volatile DprRplFrame*)cmd;
+	ulong irqFlags;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdEthFlowStats;
+	cmd->ethFlowId.flowId = flowId;
+	sendMsgToArm(priv, true);
+	if(rpl->header.rpl != dprplEthFlowStats) {
+		spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+		return wacCOMERR;
+	}
+	*packets = rpl->ethFlowStats.packets;
+	*bytes = rpl->ethFlowStats.bytes;
+	*idleMs = rpl->ethFlowStats.idleMs;
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	return wacOK;
+}
+
+static int flowFind(WarpNetPriv *priv, unsigned long cookie)
+{
+	int i;
+
+	for (i = 0; i < FLOW_TABLE_SIZE; i++) {
+		if (priv->flows[i].used && priv->flows[i].cookie == cookie)
+			return i;
+	}
+	return -1;
+}
+
+// apply one 32-bit pedit style rewrite: word = (word & mask) | val
+static void flowMangleWord(u8 *buf, u32 offset, u32 mask, u32 val)
+{
+	u32 word = get_unaligned_be32(buf + offset);
+
+	put_unaligned_be32((word & mask) | val, buf + offset);
+}
+
+static int flowApplyMangle(const struct flow_action_entry *act,
+			   DprCmdEthFlowAdd *entry, u8 *eth)
+{
+	u32 offset = act->mangle.offset;
+	u32 mask = act->mangle.mask;
+	u32 val = act->mangle.val;
+	u8 l4[4];
+
+	switch (act->mangle.htype) {
+	case FLOW_ACT_MANGLE_HDR_TYPE_ETH:
+		// dst + src MAC, rewritten in 32-bit words at 0, 4, 8
+		if (offset > 2 * ETH_ALEN - 4)
+			return -EOPNOTSUPP;
+		flowMangleWord(eth, offset, mask, val);
+		return 0;
+	case FLOW_ACT_MANGLE_HDR_TYPE_IP4:
+		if (offset == offsetof(struct iphdr, saddr))
+			entry->natSrcAddr = (entry->natSrcAddr & mask) | val;
+		else if (offset == offsetof(struct iphdr, daddr))
+			entry->natDstAddr = (entry->natDstAddr & mask) | val;
+		else
+			return -EOPNOTSUPP;
+		return 0;
+	case FLOW_ACT_MANGLE_HDR_TYPE_TCP:
+	case FLOW_ACT_MANGLE_HDR_TYPE_UDP:
+		// source and destination port share the first word
+		if (offset != 0)
+			return -EOPNOTSUPP;
+		put_unaligned_be16(entry->natSrcPort, &l4[0]);
+		put_unaligned_be16(entry->natDstPort, &l4[2]);
+		flowMangleWord(l4, 0, mask, val);
+		entry->natSrcPort = get_unaligned_be16(&l4[0]);
+		entry->natDstPort = get_unaligned_be16(&l4[2]);
+		return 0;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+#define FLOW_KEYS_SUPPORTED	(BIT_ULL(FLOW_DISSECTOR_KEY_META) |		\
+				 BIT_ULL(FLOW_DISSECTOR_KEY_CONTROL) |		\
+				 BIT_ULL(FLOW_DISSECTOR_KEY_BASIC) |		\
+				 BIT_ULL(FLOW_DISSECTOR_KEY_IPV4_ADDRS) |	\
+				 BIT_ULL(FLOW_DISSECTOR_KEY_PORTS) |		\
+				 BIT_ULL(FLOW_DISSECTOR_KEY_TCP))
+
+/**
+ * @brief translate flow rule into ARM flow table entry.
+ *        Only exact 5-tuple matches of IPv4 TCP/UDP flows which come in
+ *        and leave through this interface can be handled by the ARM.
+ *        The ARM has no path to other interfaces (PLIP, SLIP, ...), so
+ *        redirects to them are refused. Everything else stays in the
+ *        68k software path.
+ */
+static int flowParseRule(WarpNetPriv *priv, struct flow_cls_offload *f,
+			 DprCmdEthFlowAdd *entry)
+{
+	struct flow_rule *rule = flow_cls_offload_flow_rule(f);
+	struct flow_action_entry *act;
+	struct flow_match_control control;
+	struct flow_match_basic basic;
+	struct flow_match_ipv4_addrs addrs;
+	struct flow_match_ports ports;
+	u8 eth[2 * ETH_ALEN];
+	bool redirected = false;
+	int i;
+
+	// any other key would be silently ignored by the ARM
+	if (rule->match.dissector->used_keys & ~FLOW_KEYS_SUPPORTED)
+		return -EOPNOTSUPP;
+	if (!flow_rule_match_key(rule, FLOW_DISSECTOR_KEY_CONTROL) ||
+	    !flow_rule_match_key(rule, FLOW_DISSECTOR_KEY_BASIC) ||
+	    !flow_rule_match_key(rule, FLOW_DISSECTOR_KEY_IPV4_ADDRS) ||
+	    !flow_rule_match_key(rule, FLOW_DISSECTOR_KEY_PORTS))
+		return -EOPNOTSUPP;
+
+	if (flow_rule_match_key(rule, FLOW_DISSECTOR_KEY_META)) {
+		struct flow_match_meta meta;
+
+		flow_rule_match_meta(rule, &meta);
+		if (meta.mask->ingress_ifindex &&
+		    meta.key->ingress_ifindex != priv->ndev->ifindex)
+			return -EOPNOTSUPP;
+	}
+
+	flow_rule_match_control(rule, &control);
+	if (control.key->addr_type != FLOW_DISSECTOR_KEY_IPV4_ADDRS ||
+	    control.mask->flags)
+		return -EOPNOTSUPP;
+
+	flow_rule_match_basic(rule, &basic);
+	if (basic.mask->ip_proto != 0xff ||
+	    (basic.key->ip_proto != IPPROTO_TCP &&
+	     basic.key->ip_proto != IPPROTO_UDP))
+		return -EOPNOTSUPP;
+
+	// ARM flow table matches exact addresses and ports only
+	flow_rule_match_ipv4_addrs(rule, &addrs);
+	flow_rule_match_ports(rule, &ports);
+	if (addrs.mask->src != htonl(~0) || addrs.mask->dst != htonl(~0) ||
+	    ports.mask->src != htons(~0) || ports.mask->dst != htons(~0))
+		return -EOPNOTSUPP;
+
+	// nf_flowtable keeps FIN/RST packets out of the flow, the ARM
+	// always passes those up to the 68k
+	if (flow_rule_match_key(rule, FLOW_DISSECTOR_KEY_TCP)) {
+		struct flow_match_tcp tcp;
+
+		flow_rule_match_tcp(rule, &tcp);
+		if (basic.key->ip_proto != IPPROTO_TCP ||
+		    (tcp.mask->flags & ~cpu_to_be16(TCPHDR_FIN | TCPHDR_RST)) ||
+		    (tcp.key->flags & tcp.mask->flags))
+			return -EOPNOTSUPP;
+	}
+
+	memset(entry, 0, sizeof(*entry));
+	entry->ipProto = basic.key->ip_proto;
+	entry->srcAddr = entry->natSrcAddr = be32_to_cpu(addrs.key->src);
+	entry->dstAddr = entry->natDstAddr = be32_to_cpu(addrs.key->dst);
+	entry->srcPort = entry->natSrcPort = be16_to_cpu(ports.key->src);
+	entry->dstPort = entry->natDstPort = be16_to_cpu(ports.key->dst);
+
+	memset(eth, 0, sizeof(eth));
+	memcpy(eth + ETH_ALEN, priv->ndev->dev_addr, ETH_ALEN);
+
+	flow_action_for_each(i, act, &rule->action) {
+		switch (act->id) {
+		case FLOW_ACTION_MANGLE:
+			if (flowApplyMangle(act, entry, eth))
+				return -EOPNOTSUPP;
+			break;
+		case FLOW_ACTION_REDIRECT:
+			// ARM can only emit on its own link, forwarding
+			// to another interface stays in software
+			if (act->dev != priv->ndev)
+				return -EOPNOTSUPP;
+			redirected = true;
+			break;
+		case FLOW_ACTION_CSUM:
+			// ARM always fixes up checksums after rewrite
+			break;
+		default:
+			return -EOPNOTSUPP;
+		}
+	}
+	if (!redirected)
+		return -EOPNOTSUPP;
+
+	memcpy(entry->ethDst, eth, ETH_ALEN);
+	memcpy(entry->ethSrc, eth + ETH_ALEN, ETH_ALEN);
+
+	return 0;
+}
+
+static int warpnet_flow_replace(WarpNetPriv *priv, struct flow_cls_offload *f)
+{
+	DprCmdEthFlowAdd entry;
+	u32 srcAddr, dstAddr;
+	int idx, ret;
+
+	if (flowFind(priv, f->cookie) >= 0)
+		return -EEXIST;
+
+	for (idx = 0; idx < FLOW_TABLE_SIZE; idx++) {
+		if (!priv->flows[idx].used)
+			break;
+	}
+	if (idx == FLOW_TABLE_SIZE)
+		return -ENOSPC;
+
+	ret = flowParseRule(priv, f, &entry);
+	if (ret)
+		return ret;
+
+	entry.flowId = idx;
+	if (ethFlowAdd(priv, &entry) != wacOK)
+		return -EIO;
+
+	priv->flows[idx].cookie = f->cookie;
+	priv->flows[idx].used = true;
+	priv->flows[idx].packets = 0;
+	priv->flows[idx].bytes = 0;
+
+	srcAddr = entry.srcAddr;
+	dstAddr = entry.dstAddr;
+	netif_dbg(priv, hw, priv->ndev, "flow %d offloaded: %pI4h:%u -> %pI4h:%u (proto %u)\n",
+		  idx, &srcAddr, entry.srcPort, &dstAddr, entry.dstPort,
+		  entry.ipProto);
+	return 0;
+}
+
+static int warpnet_flow_destroy(WarpNetPriv *priv, struct flow_cls_offload *f)
+{
+	int idx = flowFind(priv, f->cookie);
+
+	if (idx < 0)
+		return -ENOENT;
+
+	ethFlowDel(priv, idx);
+	priv->flows[idx].used = false;
+	return 0;
+}
+
+static int warpnet_flow_stats(WarpNetPriv *priv, struct flow_cls_offload *f)
+{
+	int idx = flowFind(priv, f->cookie);
+	WarpNetFlow *flow;
+	u32 packets, bytes, idleMs;
+
+	if (idx < 0)
+		return -ENOENT;
+
+	if (ethFlowGetStats(priv, idx, &packets, &bytes, &idleMs) != wacOK)
+		return -EIO;
+
+	// ARM counters are cumulative, the stack wants deltas
+	flow = &priv->flows[idx];
+	flow_stats_update(&f->stats, bytes - flow->bytes, packets - flow->packets, 0,
+			  jiffies - msecs_to_jiffies(idleMs),
+			  FLOW_ACTION_HW_STATS_DELAYED);
+	flow->packets = packets;
+	flow->bytes = bytes;
+
+	return 0;
+}
+
+static int warpnet_setup_tc_block_cb(enum tc_setup_type type, void *type_data,
+				     void *cb_priv)
+{
+	WarpNetPriv *priv = cb_priv;
+	struct flow_cls_offload *f = type_data;
+	int ret;
+
+	if (type != TC_SETUP_CLSFLOWER)
+		return -EOPNOTSUPP;
+
+	if (!(priv->ndev->features & NETIF_F_HW_TC))
+		return -EOPNOTSUPP;
+
+	mutex_lock(&priv->flowLock);
+	switch (f->command) {
+	case FLOW_CLS_REPLACE:
+		ret = warpnet_flow_replace(priv, f);
+		break;
+	case FLOW_CLS_DESTROY:
+		ret = warpnet_flow_destroy(priv, f);
+		break;
+	case FLOW_CLS_STATS:
+		ret = warpnet_flow_stats(priv, f);
+		break;
+	default:
+		ret = -EOPNOTSUPP;
+		break;
+	}
+	mutex_unlock(&priv->flowLock);
+
+	return ret;
+}
+
 // ############################################################################
 // ethtool functions
 // ############################################################################
@@ -175,6 +883,103 @@ static u32 warpnet_get_link(struct net_device *ndev)
 	return 1;
 }
 
+static int warpnet_get_sset_count(struct net_device *ndev, int sset)
+{
+	switch (sset) {
+	case ETH_SS_TEST:
+		return SELFTEST_LEN;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static void warpnet_get_strings(struct net_device *ndev, u32 sset, u8 *data)
+{
+	if (sset == ETH_SS_TEST)
+		memcpy(data, selftest_strings, sizeof(selftest_strings));
+}
+
+/**
+ * @brief ethtool -t: measure the 68k <-> ARM mailbox path alone.
+ *        ARM is switched to loopback mode, so frames never leave the board.
+ *        Results: data[0] pass/fail, then pkt/s and KB/s for each frame size.
+ */
+static void warpnet_self_test(struct net_device *ndev,
+			      struct ethtool_test *test, u64 *data)
+{
+	WarpNetPriv *priv = netdev_priv(ndev);
+	volatile u32 __iomem *dp_reg_cr = 
+		(volatile u32*)((u32)priv->ctrlBase | WARP_OFFSET_DPREG_CR);
+	bool running = netif_running(ndev);
+	u8 *frame;
+	int i, ret = 0;
+
+	memset(data, 0, sizeof(u64) * SELFTEST_LEN);
+
+	if (!(test->flags & ETH_TEST_FL_OFFLINE))
+		return;
+
+	frame = kmalloc(ETH_MTU_AND_HDR_SIZE, GFP_KERNEL);
+	if (!frame) {
+		test->flags |= ETH_TEST_FL_FAILED;
+		data[0] = 1;
+		return;
+	}
+
+	// take the rx path away from napi and the stack for the test time
+	if (running) {
+		netif_tx_disable(ndev);
+		del_timer_sync(&priv->pollTimer);
+		*dp_reg_cr = DPREG_CR_CLR | DPREG_CR_IE_ETHRX;
+		napi_disable(&priv->napi);
+	}
+	if (ethSetLoopback(priv, true) != wacOK) {
+		netdev_err(ndev, "ARM refused loopback mode\n");
+		ret = -EIO;
+		goto restore;
+	}
+
+	memcpy(frame, ndev->dev_addr, ETH_ALEN);
+	memcpy(frame + ETH_ALEN, ndev->dev_addr, ETH_ALEN);
+	put_unaligned_be16(SELFTEST_ETHERTYPE, &frame[2 * ETH_ALEN]);
+	for (i = ETH_HLEN; i < ETH_MTU_AND_HDR_SIZE; i++)
+		frame[i] = (u8)(i * 7);
+
+	for (i = 0; i < ARRAY_SIZE(selftest_sizes); i++) {
+		uint size = selftest_sizes[i];
+		u64 ns = 0;
+
+		ret = ethLoopbackRun(priv, frame, size, &ns);
+		if (ret) {
+			netdev_err(ndev, "loopback self-test failed at %u byte frames (%d)\n",
+				   size, ret);
+			break;
+		}
+		if (ns == 0)
+			ns = 1;
+		data[1 + 2 * i] = div64_u64((u64)SELFTEST_FRAMES * NSEC_PER_SEC, ns);
+		data[2 + 2 * i] = div64_u64((u64)SELFTEST_FRAMES * size * NSEC_PER_SEC,
+					    ns * 1000);
+		netif_info(priv, hw, ndev, "loopback %u byte: %llu pkt/s, %llu KB/s\n",
+			   size, data[1 + 2 * i], data[2 + 2 * i]);
+	}
+
+restore:
+	ethSetLoopback(priv, (ndev->features & NETIF_F_LOOPBACK) != 0);
+	if (running) {
+		napi_enable(&priv->napi);
+		*dp_reg_cr = DPREG_CR_SET | DPREG_CR_IE_ETHRX;
+		mod_timer(&priv->pollTimer, jiffies + TMR_POLL_INTERVAL);
+		netif_wake_queue(ndev);
+	}
+	kfree(frame);
+
+	if (ret) {
+		test->flags |= ETH_TEST_FL_FAILED;
+		data[0] = 1;
+	}
+}
+
 
 // ############################################################################
 // netdev functions
@@ -211,6 +1016,9 @@ static int warpnet_close(struct net_device *ndev)
 	del_timer_sync(&priv->pollTimer);
 
 	cleanupIrqAndFlags(priv);
+	// keep waking capture readers
+	if (priv->capRunning)
+		mod_timer(&priv->pollTimer, jiffies + TMR_POLL_INTERVAL);
 
 	netif_info(priv, ifdown, ndev, "shutting down\n");
 	netif_carrier_off(ndev);
@@ -228,13 +1036,13 @@ static netdev_tx_t warpnet_start_xmit(struct sk_buff *skb,
 	uint tx_len = skb->len;
 	ulong irqFlags;
 
-	spin_lock_irqsave(&priv->dpram_lock, irqFlags);
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
 
 	cmd->header.cmd = dpcmdEthTransmit;
 	cmd->ethSend.pktSize = tx_len;
 	memcpy((void*)cmd->ethSend.packet, skb->data, tx_len);
 	sendMsgToArm(priv, false);	
-	spin_unlock_irqrestore(&priv->dpram_lock, irqFlags);
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
 
 	dev_kfree_skb(skb);
 
@@ -268,6 +1076,56 @@ static void warpnet_set_rx_mode(struct net_device *ndev)
 	}
 }
 
+static int warpnet_set_features(struct net_device *ndev,
+				netdev_features_t features)
+{
+	WarpNetPriv *priv = netdev_priv(ndev);
+	netdev_features_t changed = ndev->features ^ features;
+
+	if ((changed & NETIF_F_HW_TC) && !(features & NETIF_F_HW_TC)) {
+		int i;
+
+		for (i = 0; i < FLOW_TABLE_SIZE; i++) {
+			if (priv->flows[i].used) {
+				netdev_err(ndev, "Can't disable HW TC offload, flows are active\n");
+				return -EBUSY;
+			}
+		}
+	}
+
+	if (changed & NETIF_F_LOOPBACK) {
+		bool enable = (features & NETIF_F_LOOPBACK) != 0;
+
+		if (ethSetLoopback(priv, enable) != wacOK)
+			return -EIO;
+		netif_info(priv, hw, ndev, "ARM loopback %s\n",
+			   enable ? "enabled" : "disabled");
+	}
+	return 0;
+}
+
+static int warpnet_setup_tc(struct net_device *ndev, enum tc_setup_type type,
+			    void *type_data)
+{
+	WarpNetPriv *priv = netdev_priv(ndev);
+
+	switch (type) {
+	case TC_SETUP_BLOCK:
+		return flow_block_cb_setup_simple(type_data,
+						  &warpnet_tc_block_cb_list,
+						  warpnet_setup_tc_block_cb,
+						  priv, priv, true);
+	case TC_SETUP_FT:
+		// nf_flowtable hardware offload ('flags offload' in nft)
+		return flow_block_cb_setup_simple(type_data,
+						  &warpnet_ft_block_cb_list,
+						  warpnet_setup_tc_block_cb,
+						  priv, priv, false);
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
 static int warpnet_set_macaddr(struct net_device *ndev, void *addr)
 {
 	netdev_warn(ndev, "MAC setting is not supported!\n");
@@ -288,20 +1146,20 @@ static int warpnet_napi_poll(struct napi_struct *napi, int budget)
 
 	for(rx_count = 0; rx_count < budget; rx_count++)
 	{
-		spin_lock_irqsave(&priv->dpram_lock, irqFlags);
+		spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
 		
 		cmd->header.cmd = dpcmdEthReceive;
 		sendMsgToArm(priv, true);
 
 		if(unlikely(rpl->header.rpl != dprplEthReceive)) 
 		{
-			spin_unlock_irqrestore(&priv->dpram_lock, irqFlags);
+			spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
 			netdev_err(ndev, "warpnet_napi_poll: error, wrong reply header!\n");
 			break;
 		}
 		uint16_t rx_len = rpl->ethRecv.pktSize;
 		if(rx_len == 0) {
-			spin_unlock_irqrestore(&priv->dpram_lock, irqFlags);
+			spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
 			break;
 		}
 		if(!priv->promisc && 
@@ -309,21 +1167,29 @@ static int warpnet_napi_poll(struct napi_struct *napi, int budget)
 			(memcmp((void*)rpl->ethRecv.packet, bcast_addr, ETH_ALEN) != 0))
 		{
 			// not promiciuous mode and dst MAC is not ours
-			spin_unlock_irqrestore(&priv->dpram_lock, irqFlags);
+			spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
 			break;			
 		}
 		skb = netdev_alloc_skb(ndev, rx_len);
 		skb_put_data(skb, (void*)rpl->ethRecv.packet, rx_len);
-		spin_unlock_irqrestore(&priv->dpram_lock, irqFlags);
+		spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
 		skb->protocol = eth_type_trans(skb, ndev);
+		// let SO_BUSY_POLL / net.core.busy_read sockets find this napi
+		skb_mark_napi_id(skb, napi);
 		netif_receive_skb(skb);
 
 		ndev->stats.rx_packets++;
 		ndev->stats.rx_bytes += rx_len;
 	}
 
-	if(rx_count < budget) {
-		napi_complete_done(napi, rx_count);
+	// napi_complete_done() returns false while a busy polling socket
+	// owns this napi instance - keep rx irq masked then, the socket
+	// will call us again (with BUSY_POLL_BUDGET) until it is done
+	if(rx_count < budget && napi_complete_done(napi, rx_count)) {
+		volatile u32 __iomem *dp_reg_cr = 
+			(volatile u32*)((u32)priv->ctrlBase | WARP_OFFSET_DPREG_CR);
+
+		*dp_reg_cr = DPREG_CR_SET | DPREG_CR_IE_ETHRX;
 	}
     return rx_count;
 }
@@ -333,6 +1199,9 @@ static const struct ethtool_ops warpnet_ethtool_ops = {
 	.get_msglevel		= warpnet_get_msglevel,
 	.set_msglevel		= warpnet_set_msglevel,
 	.get_link		    = warpnet_get_link,
+	.get_sset_count		= warpnet_get_sset_count,
+	.get_strings		= warpnet_get_strings,
+	.self_test		    = warpnet_self_test,
 };
 
 const struct net_device_ops warpnet_netdev_ops = {
@@ -344,14 +1213,24 @@ const struct net_device_ops warpnet_netdev_ops = {
 	.ndo_set_rx_mode	= warpnet_set_rx_mode,
 	.ndo_validate_addr	= eth_validate_addr,
 	.ndo_set_mac_address = warpnet_set_macaddr,
+	.ndo_set_features	= warpnet_set_features,
+	.ndo_setup_tc		= warpnet_setup_tc,
 };
 
 static void pollTimerCallback(struct timer_list *t)
 {
 	WarpNetPriv *priv = container_of(t, WarpNetPriv, pollTimer);
 
-	napi_schedule(&priv->napi);
-	mod_timer(&priv->pollTimer, jiffies + TMR_POLL_INTERVAL);
+	bool running = netif_running(priv->ndev);
+
+	// safety net only, napi_schedule() is a no-op while napi
+	// is already scheduled or busy polled from a socket
+	if (running)
+		napi_schedule(&priv->napi);
+	if (priv->capRunning)
+		wake_up_interruptible(&priv->capWait);
+	if (running || priv->capRunning)
+		mod_timer(&priv->pollTimer, jiffies + TMR_POLL_INTERVAL);
 }
 
 
@@ -382,9 +1261,13 @@ static int warpnet_probe(struct zorro_dev *z, const struct zorro_device_id *id)
     ndev->features |= NETIF_F_VLAN_CHALLENGED;
 	// no checksum offloading
 	ndev->features &= ~(NETIF_F_HW_CSUM | NETIF_F_IP_CSUM | NETIF_F_IPV6_CSUM | NETIF_F_RXCSUM);
+	// ARM loopback (ethtool -K <dev> loopback on)
+	ndev->hw_features |= NETIF_F_LOOPBACK;
+	// forwarded flows handled by ARM (tc flower / nf_flowtable offload)
+	ndev->hw_features |= NETIF_F_HW_TC;
 
 	// Find Warp-CTRL Zorro device (card control registers)
-	struct zorro_dev *zWarpCtrl = NULL;
+	struct zorro_dev *zWarpCtrl = NULL, *zDdr;
 	zWarpCtrl = zorro_find_device(ZORRO_PROD_CSLAB_WARP_CTRL, zWarpCtrl);
 	if(zWarpCtrl == NULL) {
 		dev_err(&z->dev, "amiwarpnet: Can't find Warp-CTRL zorro card! \n");
@@ -395,15 +1278,21 @@ static int warpnet_probe(struct zorro_dev *z, const struct zorro_device_id *id)
     priv->ctrlBase = (void*)zorro_resource_start(zWarpCtrl);
     priv->ndev = ndev;
 	priv->promisc = false;
-
+	mutex_init(&priv->capLock);
+	init_waitqueue_head(&priv->capWait);
+	mutex_init(&priv->flowLock);
+	zDdr = zorro_find_device(ZORRO_PROD_CSLAB_WARP_DDR3, NULL);
+	if (zDdr)
+		priv->ddr = &zDdr->resource;
+
+    // weight 8 == BUSY_POLL_BUDGET, so a busy polling socket never
+    // holds the dpram mailbox longer than a regular napi round
     netif_napi_add_weight(ndev, &priv->napi, warpnet_napi_poll, 8);
     register_netdev(ndev);
 
 	// clear all IRQs and flags (ARM <-> 68k comm)
 	cleanupIrqAndFlags(priv);
-
-	// init dpram access critial section
-	spin_lock_init(&priv->dpram_lock);
+	*cswarpDpRegCR(priv->ctrlBase) = DPREG_CR_CLR | DPREG_CR_IE_ETHST | DPREG_CR_IF_ETHST;
 
 	int ri = request_irq(ndev->irq, warpnet_irq, IRQF_SHARED, DRV_NAME, ndev);
 	if(ri) {
@@ -429,6 +1318,14 @@ static int warpnet_probe(struct zorro_dev *z, const struct zorro_device_id *id)
 	// setup polling timer
 	timer_setup(&priv->pollTimer, pollTimerCallback, 0);
 
+	// ARM capture ring char device
+	priv->capDev.minor = MISC_DYNAMIC_MINOR;
+	priv->capDev.name = "warpcap";
+	priv->capDev.fops = &warpcap_fops;
+	priv->capDev.parent = &z->dev;
+	if (misc_register(&priv->capDev))
+		netdev_warn(ndev, "Can't register /dev/warpcap, ARM capture disabled\n");
+
 	netdev_info(ndev, "device probe ok");
     return 0;
 
@@ -15,12 +15,18 @@
 #include <linux/mm.h>
 #include <linux/vmalloc.h>
 #include <linux/delay.h>
+#include <linux/dma-mapping.h>
 #include <linux/interrupt.h>
+#include <linux/mutex.h>
 #include <linux/platform_device.h>
 #include <linux/zorro.h>
 
 #include <linux/fb.h>
 #include <linux/init.h>
+#include <linux/uaccess.h>
+#include <uapi/linux/amiwarpfb.h>
+
+#include <asm/cswarpamicomm.h>
 
 #include "amiwarpfb.h"
 
@@ -28,6 +34,10 @@
 #define DEF_MODE 	1
 #define DEF_DEPTH 	16
 
+#define JPEG_TIMEOUT	msecs_to_jiffies(3000)
+// job ids of the fb, the amiwarp-jpeg m2m driver counts from 1
+#define JPEG_JOB_ID_FB	0x80000000
+
 //#define IMAGE_BLIT_SUPPORT
 
 static u_long videomemorysize = VIDEOMEMSIZE;
@@ -104,6 +114,7 @@ static int warpfb_pan_display(struct fb_var_screeninfo *var,
 			   				  struct fb_info *info);
 static void warpfb_fillrect(struct fb_info *info, const struct fb_fillrect *rect);
 static void warpfb_copyarea(struct fb_info *info, const struct fb_copyarea *region);
+static int warpfb_ioctl(struct fb_info *info, unsigned int cmd, unsigned long arg);
 
 #ifdef IMAGE_BLIT_SUPPORT
 static void warpfb_imageblt(struct fb_info *info, const struct fb_image *img);
@@ -118,6 +129,7 @@ static const struct fb_ops warpfb_ops = {
 	.fb_pan_display	= warpfb_pan_display,
 	.fb_fillrect	= warpfb_fillrect,
 	.fb_copyarea	= warpfb_copyarea,
+	.fb_ioctl		= warpfb_ioctl,
 #ifdef IMAGE_BLIT_SUPPORT
 	.fb_imageblit	= warpfb_imageblt,
 #else
@@ -687,7 +699,7 @@ static int warpfb_pan_display(struct fb_var_screeninfo *var,
 	u32 xWordOffsetRounded = (((var->xoffset * bppix) + 8) >> 4);
 
 	// add xy offsets
-	u32 dispWordOffset = (((u32)info->var.xoffset * bpr) >> 4) + xWordOffsetRounded;
+	u32 dispWordOffset = (((u32)info->var.yoffset * bpr) >> 4) + xWordOffsetRounded;
 
 	// set screen display start offset
 	par->mregs->disp_addr = dispWordOffset;
@@ -828,6 +840,206 @@ static void warpfb_imageblt(struct fb_info *info, const struct fb_image *img)
 }
 #endif
 
+/**
+ * @brief JPEG source buffer, allocated on first use, must be reachable by ARM DMA
+ * @param info framebuffer info
+ * @return 0 or negative error
+*/
+static int warpfb_jpeg_buf(struct fb_info *info)
+{
+	WarpFBPrivData *par = (WarpFBPrivData*)info->par;
+	struct zorro_dev *zWarpDDR;
+
+	if (par->jpeg_buf)
+		return 0;
+	zWarpDDR = zorro_find_device(ZORRO_PROD_CSLAB_WARP_DDR3, NULL);
+	if (!zWarpDDR)
+		return -EOPNOTSUPP;
+
+	par->jpeg_buf = dma_alloc_coherent(par->dma_dev, WARPFB_JPEG_MAX_SIZE,
+					   &par->jpeg_dma, GFP_KERNEL);
+	if (!par->jpeg_buf)
+		return -ENOMEM;
+	if (par->jpeg_dma < zorro_resource_start(zWarpDDR) ||
+	    par->jpeg_dma + WARPFB_JPEG_MAX_SIZE - 1 > zorro_resource_end(zWarpDDR)) {
+		fb_warn(info, "JPEG buffer out of ARM reach\n");
+		dma_free_coherent(par->dma_dev, WARPFB_JPEG_MAX_SIZE,
+				  par->jpeg_buf, par->jpeg_dma);
+		par->jpeg_buf = NULL;
+		return -EOPNOTSUPP;
+	}
+	return 0;
+}
+
+/**
+ * @brief free the JPEG source buffer
+ * @param par driver private data
+ * @return none
+*/
+static void warpfb_jpeg_free(WarpFBPrivData *par)
+{
+	if (par->jpeg_buf)
+		dma_free_coherent(par->dma_dev, WARPFB_JPEG_MAX_SIZE,
+				  par->jpeg_buf, par->jpeg_dma);
+	par->jpeg_buf = NULL;
+}
+
+/**
+ * @brief stop an overdue JPEG job
+ * @param par driver private data
+ * @return 1 stopped, 0 the job has just ended, -EIO the ARM did not answer
+*/
+static int warpfb_jpeg_abort(WarpFBPrivData *par)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(par->regs_base);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(par->regs_base);
+	ulong irqFlags;
+	int retval = -EIO;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdJpegAbort;
+	cmd->jpegAbort.jobId = JPEG_JOB_ID_FB | par->jpeg_job_id;
+	cswarpSendMsgToArm(par->regs_base, true);
+	if (rpl->header.rpl == dprplJpegStatus)
+		retval = rpl->jpegStatus.success ? 1 : 0;
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	return retval;
+}
+
+/**
+ * @brief let the ARM decode a JPEG/MJPEG frame directly into VRAM
+ * @param info framebuffer info
+ * @param dec decode request, img_width/img_height are filled in
+ * @return 0 or negative error
+*/
+static int warpfb_jpeg_decode(struct fb_info *info, struct warpfb_jpeg_decode *dec)
+{
+	WarpFBPrivData *par = (WarpFBPrivData*)info->par;
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(par->regs_base);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(par->regs_base);
+	u32 bpp = info->var.bits_per_pixel;
+	u32 width = dec->width ? dec->width : info->var.xres;
+	u32 height = dec->height ? dec->height : info->var.yres;
+	u32 stride = dec->dst_stride ? dec->dst_stride : info->fix.line_length;
+	unsigned long timeout;
+	bool ok, busy;
+	ulong irqFlags;
+	int retval = 0;
+
+	if (!par->dma_dev || (bpp != 16 && bpp != 32))
+		return -EOPNOTSUPP;
+	if (dec->src_len == 0 || dec->src_len > WARPFB_JPEG_MAX_SIZE ||
+	    (dec->dst_offset & 3) || stride < width * (bpp >> 3) ||
+	    dec->dst_offset >= info->fix.smem_len ||
+	    (u64)stride * height > info->fix.smem_len - dec->dst_offset)
+		return -EINVAL;
+
+	mutex_lock(&par->jpeg_lock);
+
+	retval = warpfb_jpeg_buf(info);
+	if (retval)
+		goto out;
+	if (copy_from_user(par->jpeg_buf, u64_to_user_ptr(dec->src), dec->src_len)) {
+		retval = -EFAULT;
+		goto out;
+	}
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdJpegDecode;
+	cmd->jpegDecode.jobId = JPEG_JOB_ID_FB | ++par->jpeg_job_id;
+	cmd->jpegDecode.srcDdrAddr = par->jpeg_dma;
+	cmd->jpegDecode.srcLen = dec->src_len;
+	cmd->jpegDecode.dstAddr = dec->dst_offset;
+	cmd->jpegDecode.dstStride = stride;
+	cmd->jpegDecode.dstWidth = width;
+	cmd->jpegDecode.dstHeight = height;
+	cmd->jpegDecode.bitsPerPixel = bpp;
+	cmd->jpegDecode.flags = JPEG_FLAG_DST_VRAM |
+		((dec->flags & WARPFB_JPEG_MJPEG) ? JPEG_FLAG_MJPEG : 0);
+	cswarpSendMsgToArm(par->regs_base, true);
+	ok = rpl->header.rpl == dprplJpegStatus && rpl->jpegStatus.success;
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	// engine busy with an amiwarp-jpeg job or old firmware
+	if (!ok) {
+		retval = -EBUSY;
+		goto out;
+	}
+
+	// an MJPEG frame takes a few ms, poll rather than share the JPEG irq
+	timeout = jiffies + JPEG_TIMEOUT;
+	for (;;) {
+		spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+		cmd->header.cmd = dpcmdJpegGetResult;
+		cswarpSendMsgToArm(par->regs_base, true);
+		busy = rpl->header.rpl != dprplJpegResult || rpl->jpegResult.busy ||
+		       rpl->jpegResult.jobId != (JPEG_JOB_ID_FB | par->jpeg_job_id);
+		ok = rpl->jpegResult.success;
+		dec->img_width = rpl->jpegResult.imgWidth;
+		dec->img_height = rpl->jpegResult.imgHeight;
+		spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+		if (!busy) {
+			retval = ok ? 0 : -EIO;
+			break;
+		}
+		if (time_after(jiffies, timeout)) {
+			retval = warpfb_jpeg_abort(par);
+			// ended just now, fetch its result
+			if (retval == 0)
+				continue;
+			fb_warn(info, "JPEG decode timeout\n");
+			if (retval < 0) {
+				// the ARM may still read the buffer, leave it to it
+				fb_warn(info, "ARM did not stop the job, JPEG buffer abandoned\n");
+				par->jpeg_buf = NULL;
+			}
+			retval = -ETIMEDOUT;
+			break;
+		}
+		usleep_range(1000, 2000);
+	}
+out:
+	mutex_unlock(&par->jpeg_lock);
+	return retval;
+}
+
+static int warpfb_ioctl(struct fb_info *info, unsigned int cmd, unsigned long arg)
+{
+	void __user *argp = (void __user *)arg;
+	struct warpfb_jpeg_decode dec;
+	int retval;
+
+	switch (cmd) {
+	case WARPFB_JPEG_DECODE:
+		if (copy_from_user(&dec, argp, sizeof(dec)))
+			return -EFAULT;
+		retval = warpfb_jpeg_decode(info, &dec);
+		if (retval == 0 && copy_to_user(argp, &dec, sizeof(dec)))
+			retval = -EFAULT;
+		return retval;
+	}
+	return -ENOTTY;
+}
+
+/**
+ * @brief set up JPEG decoding, the source buffer is allocated on first use
+ * @param info framebuffer info
+ * @param zWarpCtrl Warp-CTRL Zorro device
+ * @return none, WARPFB_JPEG_DECODE fails without DMA
+*/
+static void warpfb_jpeg_init(struct fb_info *info, struct zorro_dev *zWarpCtrl)
+{
+	WarpFBPrivData *par = (WarpFBPrivData*)info->par;
+
+	mutex_init(&par->jpeg_lock);
+
+	if (dma_set_mask_and_coherent(&zWarpCtrl->dev, DMA_BIT_MASK(32)))
+		return;
+	par->dma_dev = &zWarpCtrl->dev;
+}
+
 static int __init warpfb_setup(char *options)
 {
 	char *this_opt;
@@ -942,6 +1154,8 @@ static int warpfb_probe(struct zorro_dev *z, const struct zorro_device_id *id)
 	info->pseudo_palette = par->pseudo_col;
 	info->screen_base = ioremap_wt((ulong)par->vram_base, par->vram_size);
 
+	warpfb_jpeg_init(info, zWarpCtrl);
+
 	retval = fb_alloc_cmap(&info->cmap, 256, 0);
 	if (retval < 0)
 		goto err1;
@@ -955,8 +1169,10 @@ static int warpfb_probe(struct zorro_dev *z, const struct zorro_device_id *id)
 	fb_info(info, "csWarp frame buffer device, %ldK of video memory at vram_phys_addr: 0x%08lx\n",
 		videomemorysize >> 10, (ulong)par->vram_base);
 
+	zorro_set_drvdata(z, info);
 	return 0;
 err2:
+	warpfb_jpeg_free(par);
 	fb_dealloc_cmap(&info->cmap);
 err1:
 	framebuffer_release(info);
@@ -964,6 +1180,21 @@ err:
 	return retval;
 }
 
+static void warpfb_remove(struct zorro_dev *z)
+{
+	struct fb_info *info = zorro_get_drvdata(z);
+	WarpFBPrivData *par = (WarpFBPrivData*)info->par;
+
+	unregister_framebuffer(info);
+	warpfb_jpeg_free(par);
+	fb_dealloc_cmap(&info->cmap);
+	iounmap(info->screen_base);
+	device_remove_file(&z->dev, &dev_attr_stat_hw_pan_calls);
+	device_remove_file(&z->dev, &dev_attr_stat_hw_copy_calls);
+	device_remove_file(&z->dev, &dev_attr_stat_hw_fill_calls);
+	framebuffer_release(info);
+}
+
 static const struct zorro_device_id warpvid_devices[] = {
 	{ ZORRO_PROD_CSLAB_WARP_VRAM },
 	{ 0 }
@@ -974,6 +1205,7 @@ static struct zorro_driver warpfb_driver = {
 	.name		= "amiwarpfb",
 	.id_table	= warpvid_devices,
 	.probe		= warpfb_probe,
+	.remove		= warpfb_remove,
 };
 
 static int __init warpfb_init(void)
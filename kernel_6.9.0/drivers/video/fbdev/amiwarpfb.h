@@ -13,6 +13,12 @@ typedef struct {
   WarpRegs_mclk *mregs;
   WarpRegs_bclk *bregs;
   uint32_t      *clut;
+  // ARM JPEG decode to VRAM (WARPFB_JPEG_DECODE)
+  struct device *dma_dev;
+  struct mutex  jpeg_lock;
+  void          *jpeg_buf;
+  dma_addr_t    jpeg_dma;
+  uint32_t      jpeg_job_id;
 } WarpFBPrivData;
 
 
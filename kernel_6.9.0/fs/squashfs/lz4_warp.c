@@ -0,0 +1,205 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  fs/squashfs/lz4_warp.c -- squashfs lz4 through the crypto acomp API
+ *
+ *      Copyright (C) 2024 Andrzej Rogozynski
+ *
+ *  Replaces lz4_wrapper.c with SQUASHFS_LZ4_WARP. Blocks are decompressed
+ *  by an asynchronous "lz4" acomp request, on the csWarp that is
+ *  lz4-warp-acomp: the ARM decompresses by DMA while the reader sleeps,
+ *  and requests of parallel decompressors (SQUASHFS_DECOMP_MULTI) are
+ *  handed over in one dpcmdCompBatch. Without the Warp the crypto API
+ *  picks the generic lz4.
+ *
+ *  The ARM needs linear buffers, they are kmalloc'ed. For block sizes
+ *  kmalloc cannot serve, the stream falls back to vmalloc and the lz4
+ *  library, as lz4_wrapper.c does.
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of this archive for
+ *  more details.
+ */
+
+#include <crypto/acompress.h>
+#include <linux/bio.h>
+#include <linux/lz4.h>
+#include <linux/mm.h>
+#include <linux/scatterlist.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+#include "squashfs_fs.h"
+#include "squashfs_fs_sb.h"
+#include "squashfs.h"
+#include "decompressor.h"
+#include "page_actor.h"
+
+#define LZ4_LEGACY	1
+
+struct lz4_comp_opts {
+	__le32 version;
+	__le32 flags;
+};
+
+struct squashfs_lz4_warp {
+	void *input;
+	void *output;
+	struct crypto_acomp *tfm;	// NULL: vmalloc'ed buffers, lz4 library
+	struct acomp_req *req;
+};
+
+static void *lz4_warp_comp_opts(struct squashfs_sb_info *msblk,
+				void *buff, int len)
+{
+	struct lz4_comp_opts *comp_opts = buff;
+
+	/* LZ4 compressed filesystems always have compression options */
+	if (comp_opts == NULL || len < sizeof(*comp_opts))
+		return ERR_PTR(-EIO);
+
+	if (le32_to_cpu(comp_opts->version) != LZ4_LEGACY) {
+		ERROR("Unknown LZ4 version\n");
+		return ERR_PTR(-EINVAL);
+	}
+
+	return NULL;
+}
+
+static void lz4_warp_free(void *strm)
+{
+	struct squashfs_lz4_warp *stream = strm;
+
+	if (!stream)
+		return;
+	if (stream->tfm) {
+		acomp_request_free(stream->req);
+		crypto_free_acomp(stream->tfm);
+		kfree(stream->input);
+		kfree(stream->output);
+	} else {
+		vfree(stream->input);
+		vfree(stream->output);
+	}
+	kfree(stream);
+}
+
+/**
+ * @brief linear buffers and an acomp request, vmalloc'ed buffers if
+ *        that fails
+ */
+static void *lz4_warp_init(struct squashfs_sb_info *msblk, void *buff)
+{
+	int block_size = max_t(int, msblk->block_size, SQUASHFS_METADATA_SIZE);
+	struct squashfs_lz4_warp *stream;
+
+	stream = kzalloc(sizeof(*stream), GFP_KERNEL);
+	if (!stream)
+		return ERR_PTR(-ENOMEM);
+
+	stream->input = kmalloc(block_size, GFP_KERNEL | __GFP_NOWARN);
+	stream->output = kmalloc(block_size, GFP_KERNEL | __GFP_NOWARN);
+	stream->tfm = crypto_alloc_acomp("lz4", 0, 0);
+	if (IS_ERR(stream->tfm))
+		stream->tfm = NULL;
+	if (stream->tfm)
+		stream->req = acomp_request_alloc(stream->tfm);
+	if (stream->input && stream->output && stream->req)
+		return stream;
+
+	if (stream->req)
+		acomp_request_free(stream->req);
+	if (stream->tfm)
+		crypto_free_acomp(stream->tfm);
+	kfree(stream->input);
+	kfree(stream->output);
+	stream->tfm = NULL;
+	stream->req = NULL;
+
+	stream->input = vmalloc(block_size);
+	stream->output = vmalloc(block_size);
+	if (stream->input && stream->output)
+		return stream;
+
+	lz4_warp_free(stream);
+	ERROR("Failed to allocate lz4 workspace\n");
+	return ERR_PTR(-ENOMEM);
+}
+
+/**
+ * @brief decompress input into output, sleeps until the request is done
+ * @return bytes produced, -EIO
+ */
+static int lz4_warp_run(struct squashfs_lz4_warp *stream, int length, int room)
+{
+	struct scatterlist src, dst;
+	DECLARE_CRYPTO_WAIT(wait);
+	int res;
+
+	if (!stream->tfm) {
+		res = LZ4_decompress_safe(stream->input, stream->output, length, room);
+		return res < 0 ? -EIO : res;
+	}
+
+	sg_init_one(&src, stream->input, length);
+	sg_init_one(&dst, stream->output, room);
+	acomp_request_set_params(stream->req, &src, &dst, length, room);
+	acomp_request_set_callback(stream->req, CRYPTO_TFM_REQ_MAY_SLEEP |
+				   CRYPTO_TFM_REQ_MAY_BACKLOG, crypto_req_done, &wait);
+	res = crypto_wait_req(crypto_acomp_decompress(stream->req), &wait);
+	return res ? -EIO : stream->req->dlen;
+}
+
+static int lz4_warp_uncompress(struct squashfs_sb_info *msblk, void *strm,
+			       struct bio *bio, int offset, int length,
+			       struct squashfs_page_actor *output)
+{
+	struct bvec_iter_all iter_all = {};
+	struct bio_vec *bvec = bvec_init_iter_all(&iter_all);
+	struct squashfs_lz4_warp *stream = strm;
+	void *buff = stream->input, *data;
+	int bytes = length, res;
+
+	while (bio_next_segment(bio, &iter_all)) {
+		int avail = min(bytes, ((int)bvec->bv_len) - offset);
+
+		data = bvec_virt(bvec);
+		memcpy(buff, data + offset, avail);
+		buff += avail;
+		bytes -= avail;
+		offset = 0;
+	}
+
+	res = lz4_warp_run(stream, length, output->length);
+	if (res < 0)
+		return res;
+
+	bytes = res;
+	data = squashfs_first_page(output);
+	buff = stream->output;
+	while (data) {
+		if (bytes <= PAGE_SIZE) {
+			if (!IS_ERR(data))
+				memcpy(data, buff, bytes);
+			break;
+		}
+		if (!IS_ERR(data))
+			memcpy(data, buff, PAGE_SIZE);
+		buff += PAGE_SIZE;
+		bytes -= PAGE_SIZE;
+		data = squashfs_next_page(output);
+	}
+	squashfs_finish_page(output);
+
+	return res;
+}
+
+const struct squashfs_decompressor squashfs_lz4_comp_ops = {
+	.init = lz4_warp_init,
+	.comp_opts = lz4_warp_comp_opts,
+	.free = lz4_warp_free,
+	.decompress = lz4_warp_uncompress,
+	.id = LZ4_COMPRESSION,
+	.name = "lz4",
+	.alloc_buffer = 0,
+	.supported = 1
+};
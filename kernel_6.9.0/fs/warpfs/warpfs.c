@@ -0,0 +1,921 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  fs/warpfs/warpfs.c -- read-only access to the csWarp ARM SD card
+ *
+ *      Copyright (C) 2024 Andrzej Rogozynski
+ *
+ *  The FAT/exFAT volume on the Warp SD card is owned by the ARM (the
+ *  Amiga side uses it too), so instead of mounting the block device
+ *  the ARM is asked for directory listings and file data:
+ *
+ *    dpcmdFsReadDirBatch  many packed entries per mailbox round trip
+ *    dpcmdFsStat          single entry, for lookups missing the cache
+ *    dpcmdFsRead          file data by ARM DMA straight into page cache
+ *                         folios in DDR3, WARPFS_READ_CHUNK per command
+ *
+ *  Every directory inode keeps the last complete listing. Lookups are
+ *  answered from it (including negative ones) and dentries are trusted
+ *  for attr_timeout seconds before they are checked again, the volume
+ *  may change under us. Names are case insensitive like on FAT, inodes
+ *  are found again by their ARM path.
+ *
+ *  mount -t warpfs [-o attr_timeout=<s>] 0: /mnt/warp
+ *
+ *  The mount source is the ARM path of the directory to mount.
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of this archive for
+ *  more details.
+ */
+
+#include <linux/ctype.h>
+#include <linux/dma-mapping.h>
+#include <linux/fs.h>
+#include <linux/fs_context.h>
+#include <linux/fs_parser.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/pagemap.h>
+#include <linux/slab.h>
+#include <linux/statfs.h>
+#include <linux/stringhash.h>
+#include <linux/time64.h>
+#include <linux/zorro.h>
+
+#include <asm/cswarpamicomm.h>
+
+#define WARPFS_MAGIC		0x57415250	/* "WARP" */
+#define WARPFS_DEF_TIMEOUT	5		/* attr_timeout, seconds */
+
+// bytes per dpcmdFsRead, bounds the time spent in the mailbox with IRQs off
+#define WARPFS_READ_CHUNK	8192
+
+typedef struct {
+	struct list_head list;
+	unsigned int cnt;
+	unsigned int bytes;
+	uint8_t data[];			// FsDirEnt records as sent by ARM
+} WarpFsDirBuf;
+
+typedef struct {
+	char *path;			// ARM path, kmalloc'ed
+	// directories: cached listing
+	struct mutex dirMutex;
+	struct list_head dirBufs;
+	unsigned long dirStamp;		// jiffies of last complete listing
+	bool dirValid;
+	struct inode vfs_inode;
+} WarpFsInode;
+
+typedef struct {
+	unsigned long attrTimeout;	// jiffies
+} WarpFsSb;
+
+// iget5_locked key, inodes are identified by their ARM path
+typedef struct {
+	char *path;			// handed to the inode by warpfs_iget_set
+	bool dir;
+} WarpFsIgetKey;
+
+static void __iomem *warpfs_ctrl;
+static struct device *warpfs_dmadev;
+// Warp DDR3 as seen by the 68k, the only memory the ARM reaches
+static struct resource *warpfs_ddr;
+static struct kmem_cache *warpfs_inode_cachep;
+
+static const struct inode_operations warpfs_dir_iops;
+static const struct file_operations warpfs_dir_fops;
+static const struct file_operations warpfs_file_fops;
+static const struct address_space_operations warpfs_aops;
+
+static inline WarpFsInode *WARPFS_I(struct inode *inode)
+{
+	return container_of(inode, WarpFsInode, vfs_inode);
+}
+
+static inline WarpFsSb *WARPFS_SB(struct super_block *sb)
+{
+	return sb->s_fs_info;
+}
+
+// ############################################################################
+// ARM communication
+// ############################################################################
+
+static void warpfs_put_path(volatile char __iomem *dst, const char *path)
+{
+	char buf[AMICOMM_PATH_LEN] = { };
+
+	strscpy(buf, path, sizeof(buf));
+	memcpy((void*)dst, buf, sizeof(buf));
+}
+
+static int warpfs_arm_stat(const char *path, DprRplFsStat *st)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(warpfs_ctrl);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(warpfs_ctrl);
+	ulong irqFlags;
+	int rc = -ENOENT;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdFsStat;
+	warpfs_put_path(cmd->fsStat.path, path);
+	cswarpSendMsgToArm(warpfs_ctrl, true);
+	if (rpl->header.rpl == dprplFsStat && rpl->fsStat.success) {
+		memcpy(st, (void*)&rpl->fsStat, sizeof(*st));
+		rc = 0;
+	}
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	return rc;
+}
+
+/**
+ * @brief fetch one batch of directory entries
+ * @return new buffer, NULL at end of directory or ERR_PTR
+ */
+static WarpFsDirBuf *warpfs_arm_readdir(const char *path, uint32_t *cookie, bool *eof)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(warpfs_ctrl);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(warpfs_ctrl);
+	WarpFsDirBuf *buf;
+	unsigned int i, off = 0;
+	ulong irqFlags;
+
+	buf = kmalloc(sizeof(*buf) + FS_DIRBATCH_BYTES, GFP_KERNEL);
+	if (!buf)
+		return ERR_PTR(-ENOMEM);
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdFsReadDirBatch;
+	cmd->fsReadDirBatch.cookie = *cookie;
+	warpfs_put_path(cmd->fsReadDirBatch.path, path);
+	cswarpSendMsgToArm(warpfs_ctrl, true);
+	if (rpl->header.rpl != dprplFsDirBatch || !rpl->fsDirBatch.success) {
+		spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+		kfree(buf);
+		return ERR_PTR(-EIO);
+	}
+	buf->cnt = rpl->fsDirBatch.cnt;
+	*cookie = rpl->fsDirBatch.nextCookie;
+	*eof = rpl->fsDirBatch.eof;
+	memcpy(buf->data, (void*)rpl->fsDirBatch.data, FS_DIRBATCH_BYTES);
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	// validate records, they are walked without checks later
+	for (i = 0; i < buf->cnt; i++) {
+		FsDirEnt *ent = (FsDirEnt *)(buf->data + off);
+
+		if (off + sizeof(*ent) > FS_DIRBATCH_BYTES ||
+		    off + sizeof(*ent) + ALIGN(ent->nameLen + 1, 2) > FS_DIRBATCH_BYTES) {
+			kfree(buf);
+			return ERR_PTR(-EIO);
+		}
+		if (ent->name[ent->nameLen] != 0) {
+			kfree(buf);
+			return ERR_PTR(-EIO);
+		}
+		off += sizeof(*ent) + ALIGN(ent->nameLen + 1, 2);
+	}
+	buf->bytes = off;
+
+	if (!buf->cnt) {
+		kfree(buf);
+		return NULL;
+	}
+	return buf;
+}
+
+#define for_each_dirent(ent, buf, i)						\
+	for ((i) = 0, (ent) = (FsDirEnt *)(buf)->data; (i) < (buf)->cnt;	\
+	     (i)++, (ent) = (FsDirEnt *)((uint8_t *)(ent) + sizeof(FsDirEnt) +	\
+					 ALIGN((ent)->nameLen + 1, 2)))
+
+static bool warpfs_dot(const FsDirEnt *ent)
+{
+	return (ent->nameLen == 1 && ent->name[0] == '.') ||
+	       (ent->nameLen == 2 && ent->name[0] == '.' && ent->name[1] == '.');
+}
+
+// ############################################################################
+// inodes
+// ############################################################################
+
+static void warpfs_fat_time(uint16_t date, uint16_t time, struct timespec64 *ts)
+{
+	ts->tv_nsec = 0;
+	if (!date) {
+		ts->tv_sec = 0;
+		return;
+	}
+	ts->tv_sec = mktime64(1980 + (date >> 9), (date >> 5) & 0xf, date & 0x1f,
+			      time >> 11, (time >> 5) & 0x3f, (time & 0x1f) * 2);
+}
+
+static char *warpfs_child_path(struct inode *dir, const struct qstr *name)
+{
+	const char *dirPath = WARPFS_I(dir)->path;
+	size_t len = strlen(dirPath);
+	bool sep = len && dirPath[len - 1] != '/' && dirPath[len - 1] != ':';
+	char *path;
+
+	if (len + sep + name->len >= AMICOMM_PATH_LEN)
+		return ERR_PTR(-ENAMETOOLONG);
+
+	path = kmalloc(len + sep + name->len + 1, GFP_KERNEL);
+	if (!path)
+		return ERR_PTR(-ENOMEM);
+	sprintf(path, "%s%s%.*s", dirPath, sep ? "/" : "", name->len, name->name);
+	return path;
+}
+
+static unsigned long warpfs_hash_nocase(const void *salt, const char *name,
+					unsigned int len)
+{
+	unsigned long hash = init_name_hash(salt);
+
+	while (len--)
+		hash = partial_name_hash(tolower(*name++), hash);
+	return end_name_hash(hash);
+}
+
+static ino_t warpfs_ino(const char *path)
+{
+	// stable over lookups and readdir and for any case, 1 is the root
+	return warpfs_hash_nocase(NULL, path, strlen(path)) | 2;
+}
+
+static void warpfs_set_attr(struct inode *inode, uint32_t size,
+			    uint16_t date, uint16_t time)
+{
+	struct timespec64 ts;
+
+	warpfs_fat_time(date, time, &ts);
+	inode_set_mtime_to_ts(inode, ts);
+	inode_set_atime_to_ts(inode, ts);
+	inode_set_ctime_to_ts(inode, ts);
+	if (!S_ISDIR(inode->i_mode)) {
+		i_size_write(inode, size);
+		inode->i_blocks = DIV_ROUND_UP(size, 512);
+	}
+}
+
+static void warpfs_init_inode(struct inode *inode, uint8_t attr)
+{
+	if (attr & FS_ATTR_DIR) {
+		inode->i_mode = S_IFDIR | 0555;
+		inode->i_op = &warpfs_dir_iops;
+		inode->i_fop = &warpfs_dir_fops;
+		set_nlink(inode, 2);
+	} else {
+		inode->i_mode = S_IFREG | 0444;
+		inode->i_fop = &warpfs_file_fops;
+		inode->i_mapping->a_ops = &warpfs_aops;
+	}
+}
+
+static int warpfs_iget_test(struct inode *inode, void *data)
+{
+	WarpFsIgetKey *key = data;
+
+	// an entry changed between file and directory gets a new inode
+	return !!S_ISDIR(inode->i_mode) == key->dir &&
+	       strcasecmp(WARPFS_I(inode)->path, key->path) == 0;
+}
+
+static int warpfs_iget_set(struct inode *inode, void *data)
+{
+	WarpFsIgetKey *key = data;
+
+	WARPFS_I(inode)->path = key->path;
+	key->path = NULL;
+	inode->i_ino = warpfs_ino(WARPFS_I(inode)->path);
+	// i_mode is tested before warpfs_init_inode runs
+	inode->i_mode = key->dir ? S_IFDIR : S_IFREG;
+	return 0;
+}
+
+/**
+ * @brief inode for an entry, cached by ARM path, takes over path
+ */
+static struct inode *warpfs_iget(struct super_block *sb, char *path,
+				 uint8_t attr, uint32_t size,
+				 uint16_t date, uint16_t time)
+{
+	WarpFsIgetKey key = { .path = path, .dir = attr & FS_ATTR_DIR };
+	struct inode *inode;
+	loff_t oldSize;
+	time64_t oldMtime;
+
+	inode = iget5_locked(sb, warpfs_ino(path), warpfs_iget_test,
+			     warpfs_iget_set, &key);
+	kfree(key.path);
+	if (!inode)
+		return ERR_PTR(-ENOMEM);
+
+	if (inode->i_state & I_NEW) {
+		warpfs_init_inode(inode, attr);
+		warpfs_set_attr(inode, size, date, time);
+		unlock_new_inode(inode);
+		return inode;
+	}
+
+	// known inode, drop cached data if the file changed on the volume
+	oldSize = i_size_read(inode);
+	oldMtime = inode_get_mtime_sec(inode);
+	warpfs_set_attr(inode, size, date, time);
+	if (!S_ISDIR(inode->i_mode) &&
+	    (oldSize != size || oldMtime != inode_get_mtime_sec(inode)))
+		invalidate_mapping_pages(inode->i_mapping, 0, -1);
+	return inode;
+}
+
+static struct inode *warpfs_alloc_inode(struct super_block *sb)
+{
+	WarpFsInode *wi = alloc_inode_sb(sb, warpfs_inode_cachep, GFP_KERNEL);
+
+	if (!wi)
+		return NULL;
+	wi->path = NULL;
+	mutex_init(&wi->dirMutex);
+	INIT_LIST_HEAD(&wi->dirBufs);
+	wi->dirValid = false;
+	return &wi->vfs_inode;
+}
+
+static void warpfs_dir_drop(WarpFsInode *wi)
+{
+	WarpFsDirBuf *buf, *tmp;
+
+	list_for_each_entry_safe(buf, tmp, &wi->dirBufs, list) {
+		list_del(&buf->list);
+		kfree(buf);
+	}
+	wi->dirValid = false;
+}
+
+static void warpfs_free_inode(struct inode *inode)
+{
+	WarpFsInode *wi = WARPFS_I(inode);
+
+	warpfs_dir_drop(wi);
+	kfree(wi->path);
+	kmem_cache_free(warpfs_inode_cachep, wi);
+}
+
+// ############################################################################
+// directories
+// ############################################################################
+
+/**
+ * @brief make sure the directory listing cache is complete and fresh
+ *        (dirMutex held)
+ */
+static int warpfs_dir_fill(struct inode *dir)
+{
+	WarpFsInode *wi = WARPFS_I(dir);
+	unsigned long timeout = WARPFS_SB(dir->i_sb)->attrTimeout;
+	WarpFsDirBuf *buf;
+	uint32_t cookie = 0;
+	bool eof = false;
+
+	if (wi->dirValid && time_before(jiffies, wi->dirStamp + timeout))
+		return 0;
+
+	warpfs_dir_drop(wi);
+	while (!eof) {
+		buf = warpfs_arm_readdir(wi->path, &cookie, &eof);
+		if (IS_ERR(buf)) {
+			warpfs_dir_drop(wi);
+			return PTR_ERR(buf);
+		}
+		if (!buf)
+			break;
+		list_add_tail(&buf->list, &wi->dirBufs);
+		cond_resched();
+	}
+	wi->dirStamp = jiffies;
+	wi->dirValid = true;
+	return 0;
+}
+
+static int warpfs_readdir(struct file *file, struct dir_context *ctx)
+{
+	struct inode *dir = file_inode(file);
+	WarpFsInode *wi = WARPFS_I(dir);
+	WarpFsDirBuf *buf;
+	FsDirEnt *ent;
+	loff_t pos = 2;
+	unsigned int i;
+	int rc;
+
+	if (!dir_emit_dots(file, ctx))
+		return 0;
+
+	mutex_lock(&wi->dirMutex);
+	// refresh only when starting over, keeps positions stable
+	if (ctx->pos == 2 || !wi->dirValid) {
+		rc = warpfs_dir_fill(dir);
+		if (rc)
+			goto out;
+	}
+
+	list_for_each_entry(buf, &wi->dirBufs, list) {
+		for_each_dirent(ent, buf, i) {
+			struct qstr name = QSTR_INIT(ent->name, ent->nameLen);
+			char *path;
+
+			if (warpfs_dot(ent))
+				continue;
+			if (pos++ < ctx->pos)
+				continue;
+
+			path = warpfs_child_path(dir, &name);
+			if (IS_ERR(path))
+				continue;
+			rc = dir_emit(ctx, ent->name, ent->nameLen, warpfs_ino(path),
+				      (ent->attr & FS_ATTR_DIR) ? DT_DIR : DT_REG);
+			kfree(path);
+			if (!rc)
+				goto out;
+			ctx->pos = pos;
+		}
+	}
+	rc = 0;
+out:
+	mutex_unlock(&wi->dirMutex);
+	return rc;
+}
+
+/**
+ * @brief look name up in the cached listing
+ * @return 1 found (*found filled), 0 not there, -EAGAIN no fresh listing
+ */
+static int warpfs_dir_find(struct inode *dir, const struct qstr *name,
+			   FsDirEnt *found)
+{
+	WarpFsInode *wi = WARPFS_I(dir);
+	unsigned long timeout = WARPFS_SB(dir->i_sb)->attrTimeout;
+	WarpFsDirBuf *buf;
+	FsDirEnt *ent;
+	unsigned int i;
+	int rc = 0;
+
+	mutex_lock(&wi->dirMutex);
+	if (!wi->dirValid || time_after(jiffies, wi->dirStamp + timeout)) {
+		rc = -EAGAIN;
+		goto out;
+	}
+	list_for_each_entry(buf, &wi->dirBufs, list) {
+		for_each_dirent(ent, buf, i) {
+			// FAT is case insensitive
+			if (ent->nameLen == name->len &&
+			    strncasecmp(ent->name, name->name, name->len) == 0) {
+				*found = *ent;
+				rc = 1;
+				goto out;
+			}
+		}
+	}
+out:
+	mutex_unlock(&wi->dirMutex);
+	return rc;
+}
+
+static struct dentry *warpfs_lookup(struct inode *dir, struct dentry *dentry,
+				    unsigned int flags)
+{
+	struct inode *inode = NULL;
+	DprRplFsStat st;
+	FsDirEnt ent;
+	char *path;
+	int rc;
+
+	path = warpfs_child_path(dir, &dentry->d_name);
+	if (IS_ERR(path))
+		return ERR_CAST(path);
+
+	rc = warpfs_dir_find(dir, &dentry->d_name, &ent);
+	if (rc == -EAGAIN) {
+		rc = 0;
+		if (warpfs_arm_stat(path, &st) == 0) {
+			ent.attr = st.attr;
+			ent.size = st.size;
+			ent.date = st.date;
+			ent.time = st.time;
+			rc = 1;
+		}
+	}
+
+	if (rc > 0) {
+		inode = warpfs_iget(dir->i_sb, path, ent.attr, ent.size,
+				    ent.date, ent.time);
+		if (IS_ERR(inode))
+			return ERR_CAST(inode);
+	} else {
+		kfree(path);
+	}
+
+	dentry->d_time = jiffies;
+	return d_splice_alias(inode, dentry);
+}
+
+static int warpfs_d_revalidate(struct dentry *dentry, unsigned int flags)
+{
+	unsigned long timeout = WARPFS_SB(dentry->d_sb)->attrTimeout;
+	struct inode *inode;
+	DprRplFsStat st;
+	struct timespec64 ts;
+
+	if (time_before(jiffies, dentry->d_time + timeout))
+		return 1;
+	if (flags & LOOKUP_RCU)
+		return -ECHILD;
+
+	// negative dentries are simply looked up again
+	inode = d_inode(dentry);
+	if (!inode || warpfs_arm_stat(WARPFS_I(inode)->path, &st))
+		return 0;
+
+	warpfs_fat_time(st.date, st.time, &ts);
+	if (!!(st.attr & FS_ATTR_DIR) != !!S_ISDIR(inode->i_mode) ||
+	    (!S_ISDIR(inode->i_mode) && st.size != i_size_read(inode)) ||
+	    ts.tv_sec != inode_get_mtime_sec(inode))
+		return 0;
+
+	dentry->d_time = jiffies;
+	return 1;
+}
+
+// FAT names are case insensitive
+static int warpfs_d_hash(const struct dentry *dentry, struct qstr *name)
+{
+	name->hash = warpfs_hash_nocase(dentry, name->name, name->len);
+	return 0;
+}
+
+static int warpfs_d_compare(const struct dentry *dentry, unsigned int len,
+			    const char *str, const struct qstr *name)
+{
+	return len != name->len || strncasecmp(str, name->name, len) != 0;
+}
+
+static const struct dentry_operations warpfs_dops = {
+	.d_revalidate	= warpfs_d_revalidate,
+	.d_hash		= warpfs_d_hash,
+	.d_compare	= warpfs_d_compare,
+};
+
+static const struct inode_operations warpfs_dir_iops = {
+	.lookup		= warpfs_lookup,
+};
+
+static const struct file_operations warpfs_dir_fops = {
+	.llseek		= generic_file_llseek,
+	.read		= generic_read_dir,
+	.iterate_shared	= warpfs_readdir,
+};
+
+// ############################################################################
+// file data
+// ############################################################################
+
+static bool warpfs_ddr_ok(dma_addr_t addr, size_t len)
+{
+	return addr >= warpfs_ddr->start && addr + len - 1 <= warpfs_ddr->end;
+}
+
+/**
+ * @brief one dpcmdFsRead of at most WARPFS_READ_CHUNK bytes
+ * @param bytes bytes read, < len at end of file
+ */
+static int warpfs_arm_read(const char *path, loff_t pos, uint32_t len,
+			   dma_addr_t sgDma, unsigned int sgCnt, uint32_t *bytes)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(warpfs_ctrl);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(warpfs_ctrl);
+	ulong irqFlags;
+	int rc = 0;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdFsRead;
+	cmd->fsRead.offset = pos;
+	cmd->fsRead.len = len;
+	cmd->fsRead.sgDdrAddr = sgDma;
+	cmd->fsRead.sgCnt = sgCnt;
+	warpfs_put_path(cmd->fsRead.path, path);
+	cswarpSendMsgToArm(warpfs_ctrl, true);
+	if (rpl->header.rpl == dprplFsRead && rpl->fsRead.success)
+		*bytes = min(rpl->fsRead.bytes, len);
+	else
+		rc = -EIO;
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	return rc;
+}
+
+/**
+ * @brief read consecutive folios of a file by ARM DMA, unlocks the folios
+ */
+static int warpfs_read_folios(struct inode *inode, struct folio **folios,
+			      unsigned int cnt)
+{
+	loff_t pos = folio_pos(folios[0]);
+	dma_addr_t addr[FS_MAX_SG], sgDma;
+	uint32_t bytes = 0;
+	unsigned int i, first, mapped = 0;
+	DiskSgEntry *sg;
+	int rc = 0;
+
+	sg = kmalloc_array(FS_MAX_SG, sizeof(*sg), GFP_NOFS);
+	if (!sg) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < cnt; i++) {
+		addr[i] = dma_map_page(warpfs_dmadev, folio_page(folios[i], 0), 0,
+				       folio_size(folios[i]), DMA_FROM_DEVICE);
+		if (dma_mapping_error(warpfs_dmadev, addr[i])) {
+			rc = -EIO;
+			goto out_unmap;
+		}
+		mapped++;
+		if (!warpfs_ddr_ok(addr[i], folio_size(folios[i]))) {
+			pr_warn_ratelimited("warpfs: page cache outside DDR3\n");
+			rc = -EIO;
+			goto out_unmap;
+		}
+		sg[i].dmaDdrAddr = addr[i];
+		sg[i].len = folio_size(folios[i]);
+	}
+	sgDma = dma_map_single(warpfs_dmadev, sg, cnt * sizeof(*sg), DMA_TO_DEVICE);
+	if (dma_mapping_error(warpfs_dmadev, sgDma)) {
+		rc = -EIO;
+		goto out_unmap;
+	}
+	if (!warpfs_ddr_ok(sgDma, cnt * sizeof(*sg))) {
+		rc = -EIO;
+		goto out_unmap_sg;
+	}
+
+	for (first = 0; first < cnt; first = i) {
+		uint32_t len = 0, got;
+
+		for (i = first; i < cnt; i++) {
+			if (i > first && len + sg[i].len > WARPFS_READ_CHUNK)
+				break;
+			len += sg[i].len;
+		}
+		rc = warpfs_arm_read(WARPFS_I(inode)->path, pos + bytes, len,
+				     sgDma + first * sizeof(*sg), i - first, &got);
+		if (rc)
+			break;
+		bytes += got;
+		// end of file
+		if (got < len)
+			break;
+	}
+
+out_unmap_sg:
+	dma_unmap_single(warpfs_dmadev, sgDma, cnt * sizeof(*sg), DMA_TO_DEVICE);
+out_unmap:
+	for (i = 0; i < mapped; i++)
+		dma_unmap_page(warpfs_dmadev, addr[i], folio_size(folios[i]),
+			       DMA_FROM_DEVICE);
+	kfree(sg);
+out:
+	for (i = 0; i < cnt; i++) {
+		struct folio *folio = folios[i];
+		loff_t fpos = folio_pos(folio) - pos;
+
+		if (rc == 0) {
+			// beyond end of file
+			if (fpos + folio_size(folio) > bytes)
+				folio_zero_segment(folio, max_t(loff_t, bytes - fpos, 0),
+						   folio_size(folio));
+			folio_mark_uptodate(folio);
+		}
+		folio_unlock(folio);
+	}
+	return rc;
+}
+
+static int warpfs_read_folio(struct file *file, struct folio *folio)
+{
+	return warpfs_read_folios(folio->mapping->host, &folio, 1);
+}
+
+static void warpfs_readahead(struct readahead_control *rac)
+{
+	struct folio *folios[FS_MAX_SG];
+	struct folio *folio;
+	unsigned int cnt = 0;
+
+	// readahead batches are consecutive in the file
+	while ((folio = readahead_folio(rac))) {
+		folios[cnt++] = folio;
+		if (cnt == FS_MAX_SG) {
+			warpfs_read_folios(rac->mapping->host, folios, cnt);
+			cnt = 0;
+		}
+	}
+	if (cnt)
+		warpfs_read_folios(rac->mapping->host, folios, cnt);
+}
+
+static const struct address_space_operations warpfs_aops = {
+	.read_folio	= warpfs_read_folio,
+	.readahead	= warpfs_readahead,
+};
+
+static const struct file_operations warpfs_file_fops = {
+	.llseek		= generic_file_llseek,
+	.read_iter	= generic_file_read_iter,
+	.mmap		= generic_file_readonly_mmap,
+	.splice_read	= filemap_splice_read,
+};
+
+// ############################################################################
+// super block
+// ############################################################################
+
+static int warpfs_statfs(struct dentry *dentry, struct kstatfs *buf)
+{
+	buf->f_type = WARPFS_MAGIC;
+	buf->f_bsize = PAGE_SIZE;
+	buf->f_namelen = AMICOMM_PATH_LEN - 1;
+	return 0;
+}
+
+static const struct super_operations warpfs_sops = {
+	.alloc_inode	= warpfs_alloc_inode,
+	.free_inode	= warpfs_free_inode,
+	.statfs		= warpfs_statfs,
+};
+
+static int warpfs_fill_super(struct super_block *sb, struct fs_context *fc)
+{
+	WarpFsSb *sbi = fc->s_fs_info;
+	struct inode *root;
+	char *path;
+
+	sb->s_magic = WARPFS_MAGIC;
+	sb->s_op = &warpfs_sops;
+	sb->s_d_op = &warpfs_dops;
+	sb->s_flags |= SB_RDONLY | SB_NOATIME;
+	sb->s_maxbytes = 0xffffffff;	// 32-bit sizes in the protocol
+	sb->s_blocksize = PAGE_SIZE;
+	sb->s_blocksize_bits = PAGE_SHIFT;
+	sb->s_time_gran = 2 * NSEC_PER_SEC;
+	sb->s_fs_info = sbi;
+	fc->s_fs_info = NULL;
+
+	path = kstrdup(fc->source ?: "0:", GFP_KERNEL);
+	if (!path)
+		return -ENOMEM;
+	root = new_inode(sb);
+	if (!root) {
+		kfree(path);
+		return -ENOMEM;
+	}
+	WARPFS_I(root)->path = path;
+	root->i_ino = 1;
+	warpfs_init_inode(root, FS_ATTR_DIR);
+	warpfs_set_attr(root, 0, 0, 0);
+
+	sb->s_root = d_make_root(root);
+	if (!sb->s_root)
+		return -ENOMEM;
+	return 0;
+}
+
+enum { Opt_attr_timeout };
+
+static const struct fs_parameter_spec warpfs_fs_parameters[] = {
+	fsparam_u32("attr_timeout", Opt_attr_timeout),
+	{}
+};
+
+static int warpfs_parse_param(struct fs_context *fc, struct fs_parameter *param)
+{
+	WarpFsSb *sbi = fc->s_fs_info;
+	struct fs_parse_result result;
+	int opt;
+
+	opt = fs_parse(fc, warpfs_fs_parameters, param, &result);
+	if (opt < 0)
+		return opt;
+
+	switch (opt) {
+	case Opt_attr_timeout:
+		sbi->attrTimeout = result.uint_32 * HZ;
+		break;
+	}
+	return 0;
+}
+
+static int warpfs_get_tree(struct fs_context *fc)
+{
+	if (fc->source && strlen(fc->source) >= AMICOMM_PATH_LEN)
+		return invalf(fc, "warpfs: path too long");
+	return get_tree_nodev(fc, warpfs_fill_super);
+}
+
+static void warpfs_free_fc(struct fs_context *fc)
+{
+	kfree(fc->s_fs_info);
+}
+
+static const struct fs_context_operations warpfs_context_ops = {
+	.parse_param	= warpfs_parse_param,
+	.get_tree	= warpfs_get_tree,
+	.free		= warpfs_free_fc,
+};
+
+// put_super only runs once s_root is set, this also frees sbi after a
+// failed fill_super
+static void warpfs_kill_sb(struct super_block *sb)
+{
+	WarpFsSb *sbi = WARPFS_SB(sb);
+
+	kill_anon_super(sb);
+	kfree(sbi);
+}
+
+static int warpfs_init_fs_context(struct fs_context *fc)
+{
+	WarpFsSb *sbi;
+
+	if (!warpfs_ctrl)
+		return -ENODEV;
+
+	sbi = kzalloc(sizeof(*sbi), GFP_KERNEL);
+	if (!sbi)
+		return -ENOMEM;
+	sbi->attrTimeout = WARPFS_DEF_TIMEOUT * HZ;
+
+	fc->s_fs_info = sbi;
+	fc->ops = &warpfs_context_ops;
+	return 0;
+}
+
+static struct file_system_type warpfs_type = {
+	.owner			= THIS_MODULE,
+	.name			= "warpfs",
+	.init_fs_context	= warpfs_init_fs_context,
+	.parameters		= warpfs_fs_parameters,
+	.kill_sb		= warpfs_kill_sb,
+};
+MODULE_ALIAS_FS("warpfs");
+
+static void warpfs_inode_init_once(void *data)
+{
+	WarpFsInode *wi = data;
+
+	inode_init_once(&wi->vfs_inode);
+}
+
+static int __init warpfs_init(void)
+{
+	struct zorro_dev *z, *ddr;
+	int rc;
+
+	z = zorro_find_device(ZORRO_PROD_CSLAB_WARP_CTRL, NULL);
+	if (!z)
+		return -ENODEV;
+	// file data is always moved by ARM DMA, which only reaches DDR3
+	ddr = zorro_find_device(ZORRO_PROD_CSLAB_WARP_DDR3, NULL);
+	if (!ddr || dma_set_mask_and_coherent(&z->dev, DMA_BIT_MASK(32)))
+		return -ENODEV;
+	warpfs_ddr = &ddr->resource;
+	warpfs_ctrl = (void __iomem *)z->resource.start;
+	warpfs_dmadev = &z->dev;
+
+	warpfs_inode_cachep = kmem_cache_create("warpfs_inode_cache",
+						sizeof(WarpFsInode), 0,
+						SLAB_RECLAIM_ACCOUNT | SLAB_ACCOUNT,
+						warpfs_inode_init_once);
+	if (!warpfs_inode_cachep)
+		return -ENOMEM;
+
+	rc = register_filesystem(&warpfs_type);
+	if (rc)
+		kmem_cache_destroy(warpfs_inode_cachep);
+	return rc;
+}
+
+static void __exit warpfs_exit(void)
+{
+	unregister_filesystem(&warpfs_type);
+	rcu_barrier();
+	kmem_cache_destroy(warpfs_inode_cachep);
+}
+
+module_init(warpfs_init);
+module_exit(warpfs_exit);
+
+MODULE_AUTHOR("Andrzej Rogozynski");
+MODULE_DESCRIPTION("csWarp ARM SD card filesystem");
+MODULE_LICENSE("GPL v2");
@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ *  include/uapi/linux/amiwarpdisk.h -- Amiga / csWarp ARM disk interface
+ *
+ *      Copyright (C) 2024 Andrzej Rogozynski
+ */
+
+#ifndef _UAPI_LINUX_AMIWARPDISK_H
+#define _UAPI_LINUX_AMIWARPDISK_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/*
+ * Image files on the ARM filesystem exported as block devices
+ * /dev/warpimg0 .. /dev/warpimg3, controlled through /dev/warpdisk-ctl.
+ * Paths are given as seen by the ARM, e.g. "0:/images/rootfs.img".
+ */
+
+#define WARPDISK_IMG_SLOTS	4
+#define WARPDISK_IMG_PATH_LEN	128
+
+/* flags */
+#define WARPDISK_IMG_RDONLY	0x01	/* attach read-only / is read-only */
+#define WARPDISK_IMG_ATTACHED	0x02	/* WARPDISK_IMG_STATUS only */
+
+struct warpdisk_img {
+	__u32	slot;			/* 0 .. WARPDISK_IMG_SLOTS-1 */
+	__u32	flags;
+	__u64	blocks;			/* 512 byte blocks, set by kernel */
+	char	path[WARPDISK_IMG_PATH_LEN];
+};
+
+/* 0xE7 is shared by the csWarp drivers, see ioctl-number.rst */
+#define WARPDISK_IOC_MAGIC	0xE7
+#define WARPDISK_IMG_ATTACH	_IOWR(WARPDISK_IOC_MAGIC, 0x10, struct warpdisk_img)
+#define WARPDISK_IMG_DETACH	_IOW(WARPDISK_IOC_MAGIC, 0x11, __u32)
+#define WARPDISK_IMG_STATUS	_IOWR(WARPDISK_IOC_MAGIC, 0x12, struct warpdisk_img)
+
+#endif /* _UAPI_LINUX_AMIWARPDISK_H */
@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ *  include/uapi/linux/amiwarpfb.h -- Amiga / csWarp frame buffer interface
+ *
+ *      Copyright (C) 2024 Andrzej Rogozynski
+ */
+
+#ifndef _UAPI_LINUX_AMIWARPFB_H
+#define _UAPI_LINUX_AMIWARPFB_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/*
+ * Decode a JPEG or MJPEG frame on the ARM straight into video memory.
+ * The destination is given as an offset into the framebuffer memory
+ * (fix.smem_start), normally an offscreen area below the visible screen
+ * which is then shown with FBIOPAN_DISPLAY or copied with the blitter.
+ * Pixels are written in the current screen depth (16 or 32 bpp); the
+ * image is scaled down to fit width x height, aspect kept, centered on
+ * black. The call returns when the frame is in VRAM.
+ */
+
+#define WARPFB_JPEG_MAX_SIZE	(2 * 1024 * 1024)
+
+/* flags */
+#define WARPFB_JPEG_MJPEG	0x01	/* frame may lack Huffman tables */
+
+struct warpfb_jpeg_decode {
+	__u64	src;			/* user pointer to the JPEG data */
+	__u32	src_len;		/* <= WARPFB_JPEG_MAX_SIZE */
+	__u32	dst_offset;		/* into video memory, 4 byte aligned */
+	__u32	dst_stride;		/* bytes per line, 0 = fix.line_length */
+	__u16	width;			/* 0 = var.xres */
+	__u16	height;			/* 0 = var.yres */
+	__u32	flags;
+	__u16	img_width;		/* decoded image before scaling, set by kernel */
+	__u16	img_height;
+};
+
+/* 0xE7 is shared by the csWarp drivers, see ioctl-number.rst */
+#define WARPFB_IOC_MAGIC	0xE7
+#define WARPFB_JPEG_DECODE	_IOWR(WARPFB_IOC_MAGIC, 0x20, struct warpfb_jpeg_decode)
+
+#endif /* _UAPI_LINUX_AMIWARPFB_H */
@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ *  include/uapi/linux/amiwarpnet.h -- Amiga / csWarp network driver interface
+ *
+ *      Copyright (C) 2024 Andrzej Rogozynski
+ */
+
+#ifndef _UAPI_LINUX_AMIWARPNET_H
+#define _UAPI_LINUX_AMIWARPNET_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/*
+ * ARM-side packet capture (/dev/warpcap)
+ *
+ * The ARM matches rx/tx frames against the filter and writes truncated
+ * copies into a ring, which is mmap()ed by the reader:
+ *
+ *   offset 0                         struct warpcap_ring_hdr
+ *   offset WARPCAP_RING_DATA_OFFSET  records (struct warpcap_rec + data)
+ *
+ * 'head' is advanced by the ARM, 'tail' by the reader. Both are byte
+ * offsets into the data area. Records are 4-byte aligned, a record
+ * with caplen == WARPCAP_REC_WRAP means "continue at data offset 0".
+ * poll() reports EPOLLIN while head != tail.
+ */
+
+/* filter fields set to 0 match everything */
+struct warpcap_filter {
+	__u16	ethertype;	/* e.g. ETH_P_IP */
+	__u8	ip_proto;	/* e.g. IPPROTO_UDP */
+	__u8	reserved;
+	__u16	port;		/* TCP/UDP source or destination port */
+	__u16	snaplen;	/* max. bytes stored per frame */
+};
+
+struct warpcap_ring_hdr {
+	__u32	head;		/* written by ARM */
+	__u32	tail;		/* written by reader */
+	__u32	size;		/* size of the data area */
+	__u32	captured;	/* frames stored */
+	__u32	dropped;	/* frames lost, ring full */
+	__u32	reserved[3];
+};
+
+#define WARPCAP_RING_DATA_OFFSET	64
+#define WARPCAP_REC_WRAP		0xffff
+
+struct warpcap_rec {
+	__u16	caplen;		/* bytes stored in data[] */
+	__u16	len;		/* original frame length */
+	__u32	ts_sec;		/* ARM timestamp */
+	__u32	ts_usec;
+	__u8	data[];
+};
+
+/* 0xE7 is shared by the csWarp drivers, see ioctl-number.rst */
+#define WARPCAP_IOC_MAGIC	0xE7
+#define WARPCAP_SET_FILTER	_IOW(WARPCAP_IOC_MAGIC, 0x01, struct warpcap_filter)
+#define WARPCAP_START		_IO(WARPCAP_IOC_MAGIC, 0x02)
+#define WARPCAP_STOP		_IO(WARPCAP_IOC_MAGIC, 0x03)
+#define WARPCAP_GET_RING_SIZE	_IOR(WARPCAP_IOC_MAGIC, 0x04, __u32)
+
+#endif /* _UAPI_LINUX_AMIWARPNET_H */
@@ -0,0 +1,634 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  sound/drivers/amiwarp.c -- ALSA driver for the csWarp ARM audio
+ *
+ *      Copyright (C) 2024 Andrzej Rogozynski
+ *
+ *  The ARM mixes the Amiga (Paula) audio, its MP3 decoder and a PCM
+ *  stream into the Warp audio output. This card exposes:
+ *
+ *   - PCM playback (S16 big endian), played by ARM DMA from a ring in
+ *     DDR, DPREG_CR_IF_AUDIO signals each period
+ *   - mixer controls for the master, Amiga and MP3 volumes
+ *   - a compress offload device for MP3, decoded by the ARM
+ *
+ *  The ARM keeps the stream positions in a status block in DDR, so the
+ *  pointer callbacks don't need the mailbox.
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of this archive for
+ *  more details.
+ */
+
+#include <linux/dma-mapping.h>
+#include <linux/interrupt.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/spinlock.h>
+#include <linux/zorro.h>
+#include <sound/compress_driver.h>
+#include <sound/control.h>
+#include <sound/core.h>
+#include <sound/initval.h>
+#include <sound/pcm.h>
+
+#include <asm/amigaints.h>
+#include <asm/cswarpamicomm.h>
+
+#define DRV_NAME	"snd-amiwarp"
+
+#define PCM_BUFFER_MAX	(64 * 1024)
+#define MP3_BUFFER_SIZE	(128 * 1024)
+
+static int index = SNDRV_DEFAULT_IDX1;
+module_param(index, int, 0444);
+MODULE_PARM_DESC(index, "Index value for csWarp audio");
+
+static char *id = SNDRV_DEFAULT_STR1;
+module_param(id, charp, 0444);
+MODULE_PARM_DESC(id, "ID string for csWarp audio");
+
+typedef struct {
+	struct snd_card *card;
+	void __iomem *ctrlBase;
+	struct device *dmaDev;
+
+	// AUD_STREAMS status blocks, written by the ARM
+	AudioStreamStatus *status;
+	dma_addr_t statusDma;
+
+	struct snd_pcm_substream *pcmSubstream;
+	struct snd_compr_stream *mp3Stream;
+	struct snd_dma_buffer mp3Buf;
+	struct snd_compr compr;
+
+	// status[].hwPtr at the last interrupt, tells which stream moved
+	uint32_t lastHwPtr[AUD_STREAMS];
+
+	// volumes in percent, indexed by AUDVOLMASK_xxx bit
+	uint8_t volume[3];
+} WarpAudio;
+
+// Warp DDR3 as seen by the 68k, NULL if not autoconfigured (nothing is reachable)
+static struct resource *warpaudio_ddr;
+
+static struct snd_card *warpaudio_card;
+
+static bool warpaudio_ddr_ok(dma_addr_t addr, unsigned int len)
+{
+	return warpaudio_ddr && addr >= warpaudio_ddr->start &&
+	       addr + len - 1 <= warpaudio_ddr->end;
+}
+
+// ############################################################################
+// ARM stream commands
+// ############################################################################
+
+/**
+ * @brief open an ARM audio stream on a ring buffer
+ * @param chip card
+ * @param stream AUD_STREAM_xxx
+ * @param channels PCM channels
+ * @param rate PCM sample rate
+ * @param ringDma ring buffer bus address
+ * @param ringSize ring size in bytes
+ * @param periodSize bytes between DPREG_CR_IF_AUDIO interrupts
+ * @return 0 or -EIO
+*/
+static int warpaudio_stream_open(WarpAudio *chip, uint8_t stream, uint8_t channels,
+				 uint32_t rate, dma_addr_t ringDma, uint32_t ringSize,
+				 uint32_t periodSize)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(chip->ctrlBase);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(chip->ctrlBase);
+	ulong irqFlags;
+	bool ok;
+
+	if (!warpaudio_ddr_ok(ringDma, ringSize))
+		return -EIO;
+
+	memset(&chip->status[stream], 0, sizeof(AudioStreamStatus));
+	WRITE_ONCE(chip->lastHwPtr[stream], 0);
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdAudioStreamOpen;
+	cmd->audioStreamOpen.stream = stream;
+	cmd->audioStreamOpen.channels = channels;
+	cmd->audioStreamOpen.sampleRate = rate;
+	cmd->audioStreamOpen.ringDdrAddr = ringDma;
+	cmd->audioStreamOpen.ringSize = ringSize;
+	cmd->audioStreamOpen.periodSize = periodSize;
+	cmd->audioStreamOpen.statusDdrAddr = chip->statusDma + stream * sizeof(AudioStreamStatus);
+	cswarpSendMsgToArm(chip->ctrlBase, true);
+	ok = rpl->header.rpl == dprplAudioStatus && rpl->audioStatus.success;
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	return ok ? 0 : -EIO;
+}
+
+static int warpaudio_stream_ctrl(WarpAudio *chip, uint8_t stream, uint8_t audioCmd)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(chip->ctrlBase);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(chip->ctrlBase);
+	ulong irqFlags;
+	bool ok;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdAudioStreamCtrl;
+	cmd->audioStreamCtrl.stream = stream;
+	cmd->audioStreamCtrl.audioCmd = audioCmd;
+	cswarpSendMsgToArm(chip->ctrlBase, true);
+	ok = rpl->header.rpl == dprplAudioStatus && rpl->audioStatus.success;
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+
+	return ok ? 0 : -EIO;
+}
+
+static void warpaudio_stream_appl(WarpAudio *chip, uint8_t stream, uint32_t applBytes)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(chip->ctrlBase);
+	ulong irqFlags;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdAudioStreamAppl;
+	cmd->audioStreamAppl.stream = stream;
+	cmd->audioStreamAppl.applBytes = applBytes;
+	cswarpSendMsgToArm(chip->ctrlBase, true);
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+}
+
+/**
+ * @brief check whether a stream consumed data since the last interrupt
+ * @param chip card
+ * @param stream AUD_STREAM_xxx
+ * @return true if its hwPtr moved
+*/
+static bool warpaudio_stream_moved(WarpAudio *chip, uint8_t stream)
+{
+	uint32_t hwPtr = READ_ONCE(chip->status[stream].hwPtr);
+
+	if (hwPtr == chip->lastHwPtr[stream])
+		return false;
+	WRITE_ONCE(chip->lastHwPtr[stream], hwPtr);
+	return true;
+}
+
+static irqreturn_t warpaudio_interrupt(int irq, void *data)
+{
+	WarpAudio *chip = data;
+	volatile u32 __iomem *dp_reg_cr = cswarpDpRegCR(chip->ctrlBase);
+	struct snd_pcm_substream *substream;
+	struct snd_compr_stream *cstream;
+
+	if ((*dp_reg_cr & DPREG_CR_IF_AUDIO) == 0)
+		return IRQ_NONE;
+
+	*dp_reg_cr = DPREG_CR_CLR | DPREG_CR_IF_AUDIO;
+
+	// one irq for both streams, only notify the one that moved
+	substream = READ_ONCE(chip->pcmSubstream);
+	if (warpaudio_stream_moved(chip, AUD_STREAM_PCM) && substream)
+		snd_pcm_period_elapsed(substream);
+
+	cstream = READ_ONCE(chip->mp3Stream);
+	if (cstream) {
+		if (cstream->runtime->state == SNDRV_PCM_STATE_DRAINING &&
+		    READ_ONCE(chip->status[AUD_STREAM_MP3].state) == AUD_STATE_DRAINED)
+			snd_compr_drain_notify(cstream);
+		else if (warpaudio_stream_moved(chip, AUD_STREAM_MP3))
+			snd_compr_fragment_elapsed(cstream);
+	}
+	return IRQ_HANDLED;
+}
+
+// ############################################################################
+// PCM
+// ############################################################################
+
+static const struct snd_pcm_hardware warpaudio_pcm_hw = {
+	.info			= SNDRV_PCM_INFO_MMAP | SNDRV_PCM_INFO_MMAP_VALID |
+				  SNDRV_PCM_INFO_INTERLEAVED | SNDRV_PCM_INFO_PAUSE |
+				  SNDRV_PCM_INFO_BLOCK_TRANSFER,
+	.formats		= SNDRV_PCM_FMTBIT_S16_BE,
+	.rates			= SNDRV_PCM_RATE_8000_48000,
+	.rate_min		= 8000,
+	.rate_max		= 48000,
+	.channels_min		= 1,
+	.channels_max		= 2,
+	.buffer_bytes_max	= PCM_BUFFER_MAX,
+	// short periods for low latency, the ARM mixes in small blocks
+	.period_bytes_min	= 256,
+	.period_bytes_max	= PCM_BUFFER_MAX / 2,
+	.periods_min		= 2,
+	.periods_max		= 64,
+};
+
+static int warpaudio_pcm_open(struct snd_pcm_substream *substream)
+{
+	WarpAudio *chip = snd_pcm_substream_chip(substream);
+
+	substream->runtime->hw = warpaudio_pcm_hw;
+	WRITE_ONCE(chip->pcmSubstream, substream);
+	return 0;
+}
+
+static int warpaudio_pcm_close(struct snd_pcm_substream *substream)
+{
+	WarpAudio *chip = snd_pcm_substream_chip(substream);
+
+	WRITE_ONCE(chip->pcmSubstream, NULL);
+	return 0;
+}
+
+static int warpaudio_pcm_prepare(struct snd_pcm_substream *substream)
+{
+	WarpAudio *chip = snd_pcm_substream_chip(substream);
+	struct snd_pcm_runtime *runtime = substream->runtime;
+
+	return warpaudio_stream_open(chip, AUD_STREAM_PCM, runtime->channels,
+				     runtime->rate, runtime->dma_addr,
+				     snd_pcm_lib_buffer_bytes(substream),
+				     snd_pcm_lib_period_bytes(substream));
+}
+
+static int warpaudio_pcm_trigger(struct snd_pcm_substream *substream, int cmd)
+{
+	WarpAudio *chip = snd_pcm_substream_chip(substream);
+
+	switch (cmd) {
+	case SNDRV_PCM_TRIGGER_START:
+	case SNDRV_PCM_TRIGGER_PAUSE_RELEASE:
+	case SNDRV_PCM_TRIGGER_RESUME:
+		return warpaudio_stream_ctrl(chip, AUD_STREAM_PCM, audcmdPlay);
+	case SNDRV_PCM_TRIGGER_PAUSE_PUSH:
+		return warpaudio_stream_ctrl(chip, AUD_STREAM_PCM, audcmdPause);
+	case SNDRV_PCM_TRIGGER_STOP:
+	case SNDRV_PCM_TRIGGER_SUSPEND:
+		return warpaudio_stream_ctrl(chip, AUD_STREAM_PCM, audcmdStop);
+	}
+	return -EINVAL;
+}
+
+static snd_pcm_uframes_t warpaudio_pcm_pointer(struct snd_pcm_substream *substream)
+{
+	WarpAudio *chip = snd_pcm_substream_chip(substream);
+
+	return bytes_to_frames(substream->runtime,
+			       READ_ONCE(chip->status[AUD_STREAM_PCM].hwPtr));
+}
+
+static const struct snd_pcm_ops warpaudio_pcm_ops = {
+	.open		= warpaudio_pcm_open,
+	.close		= warpaudio_pcm_close,
+	.prepare	= warpaudio_pcm_prepare,
+	.trigger	= warpaudio_pcm_trigger,
+	.pointer	= warpaudio_pcm_pointer,
+};
+
+// ############################################################################
+// mixer
+// ############################################################################
+
+static int warpaudio_vol_info(struct snd_kcontrol *kcontrol,
+			      struct snd_ctl_elem_info *uinfo)
+{
+	uinfo->type = SNDRV_CTL_ELEM_TYPE_INTEGER;
+	uinfo->count = 1;
+	uinfo->value.integer.min = 0;
+	uinfo->value.integer.max = AUDVOL_MAX;
+	return 0;
+}
+
+static int warpaudio_vol_get(struct snd_kcontrol *kcontrol,
+			     struct snd_ctl_elem_value *ucontrol)
+{
+	WarpAudio *chip = snd_kcontrol_chip(kcontrol);
+
+	ucontrol->value.integer.value[0] = chip->volume[__ffs(kcontrol->private_value)];
+	return 0;
+}
+
+static int warpaudio_vol_put(struct snd_kcontrol *kcontrol,
+			     struct snd_ctl_elem_value *ucontrol)
+{
+	WarpAudio *chip = snd_kcontrol_chip(kcontrol);
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(chip->ctrlBase);
+	uint8_t mask = kcontrol->private_value;
+	long val = ucontrol->value.integer.value[0];
+	ulong irqFlags;
+
+	if (val < 0 || val > AUDVOL_MAX)
+		return -EINVAL;
+	if (chip->volume[__ffs(mask)] == val)
+		return 0;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	chip->volume[__ffs(mask)] = val;
+	cmd->header.cmd = dpcmdAudioTest;
+	cmd->audioTest.audioCmd = audcmdSetVolumes;
+	cmd->audioTest.volSetMask = mask;
+	cmd->audioTest.mixAmiga = chip->volume[__ffs(AUDVOLMASK_MIX_AMIGA)];
+	cmd->audioTest.mixMp3 = chip->volume[__ffs(AUDVOLMASK_MIX_MP3)];
+	cmd->audioTest.masterVolume = chip->volume[__ffs(AUDVOLMASK_MASTER)];
+	cmd->audioTest.fileName[0] = 0;
+	cswarpSendMsgToArm(chip->ctrlBase, true);
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+	return 1;
+}
+
+/**
+ * @brief read the current volumes from the ARM, kept at AUDVOL_MAX on old firmware
+ * @param chip card
+ * @return none
+*/
+static void warpaudio_vol_read(WarpAudio *chip)
+{
+	volatile DprCmdFrame __iomem *cmd = cswarpCmdFrame(chip->ctrlBase);
+	volatile DprRplFrame __iomem *rpl = cswarpRplFrame(chip->ctrlBase);
+	ulong irqFlags;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(chip->volume); i++)
+		chip->volume[i] = AUDVOL_MAX;
+
+	spin_lock_irqsave(&cswarp_dpram_lock, irqFlags);
+	cmd->header.cmd = dpcmdAudioTest;
+	cmd->audioTest.audioCmd = audcmdGetVolumes;
+	cmd->audioTest.volSetMask = 0;
+	cmd->audioTest.fileName[0] = 0;
+	cswarpSendMsgToArm(chip->ctrlBase, true);
+	if (rpl->header.rpl == dprplAudioVolumes) {
+		chip->volume[__ffs(AUDVOLMASK_MIX_AMIGA)] =
+			min_t(uint8_t, rpl->audioVolumes.mixAmiga, AUDVOL_MAX);
+		chip->volume[__ffs(AUDVOLMASK_MIX_MP3)] =
+			min_t(uint8_t, rpl->audioVolumes.mixMp3, AUDVOL_MAX);
+		chip->volume[__ffs(AUDVOLMASK_MASTER)] =
+			min_t(uint8_t, rpl->audioVolumes.masterVolume, AUDVOL_MAX);
+	}
+	spin_unlock_irqrestore(&cswarp_dpram_lock, irqFlags);
+}
+
+#define WARPAUDIO_VOLUME(xname, mask) {			\
+	.iface = SNDRV_CTL_ELEM_IFACE_MIXER,		\
+	.name = xname,					\
+	.info = warpaudio_vol_info,			\
+	.get = warpaudio_vol_get,			\
+	.put = warpaudio_vol_put,			\
+	.private_value = mask,				\
+}
+
+static const struct snd_kcontrol_new warpaudio_controls[] = {
+	WARPAUDIO_VOLUME("Master Playback Volume", AUDVOLMASK_MASTER),
+	WARPAUDIO_VOLUME("Amiga Playback Volume", AUDVOLMASK_MIX_AMIGA),
+	WARPAUDIO_VOLUME("MP3 Playback Volume", AUDVOLMASK_MIX_MP3),
+};
+
+// ############################################################################
+// MP3 compress offload
+// ############################################################################
+
+static int warpaudio_compr_open(struct snd_compr_stream *stream)
+{
+	WarpAudio *chip = stream->private_data;
+
+	snd_compr_set_runtime_buffer(stream, &chip->mp3Buf);
+	WRITE_ONCE(chip->mp3Stream, stream);
+	return 0;
+}
+
+static int warpaudio_compr_free(struct snd_compr_stream *stream)
+{
+	WarpAudio *chip = stream->private_data;
+
+	warpaudio_stream_ctrl(chip, AUD_STREAM_MP3, audcmdStop);
+	WRITE_ONCE(chip->mp3Stream, NULL);
+	return 0;
+}
+
+static int warpaudio_compr_set_params(struct snd_compr_stream *stream,
+				      struct snd_compr_params *params)
+{
+	WarpAudio *chip = stream->private_data;
+	u64 ringSize = (u64)params->buffer.fragment_size * params->buffer.fragments;
+
+	if (params->codec.id != SND_AUDIOCODEC_MP3 || ringSize > chip->mp3Buf.bytes)
+		return -EINVAL;
+
+	return warpaudio_stream_open(chip, AUD_STREAM_MP3, 0, 0, chip->mp3Buf.addr,
+				     ringSize, params->buffer.fragment_size);
+}
+
+static int warpaudio_compr_trigger(struct snd_compr_stream *stream, int cmd)
+{
+	WarpAudio *chip = stream->private_data;
+
+	switch (cmd) {
+	case SNDRV_PCM_TRIGGER_START:
+	case SNDRV_PCM_TRIGGER_PAUSE_RELEASE:
+		return warpaudio_stream_ctrl(chip, AUD_STREAM_MP3, audcmdPlay);
+	case SNDRV_PCM_TRIGGER_PAUSE_PUSH:
+		return warpaudio_stream_ctrl(chip, AUD_STREAM_MP3, audcmdPause);
+	case SNDRV_PCM_TRIGGER_STOP:
+		return warpaudio_stream_ctrl(chip, AUD_STREAM_MP3, audcmdStop);
+	case SND_COMPR_TRIGGER_DRAIN:
+		return warpaudio_stream_ctrl(chip, AUD_STREAM_MP3, audcmdDrain);
+	}
+	// no gapless playback
+	return -EINVAL;
+}
+
+static int warpaudio_compr_pointer(struct snd_compr_stream *stream,
+				   struct snd_compr_tstamp *tstamp)
+{
+	WarpAudio *chip = stream->private_data;
+	AudioStreamStatus *st = &chip->status[AUD_STREAM_MP3];
+
+	tstamp->byte_offset = READ_ONCE(st->hwPtr);
+	tstamp->copied_total = READ_ONCE(st->consumedBytes);
+	tstamp->pcm_frames = READ_ONCE(st->framesPlayed);
+	tstamp->pcm_io_frames = tstamp->pcm_frames;
+	tstamp->sampling_rate = READ_ONCE(st->sampleRate);
+	return 0;
+}
+
+static int warpaudio_compr_ack(struct snd_compr_stream *stream, size_t bytes)
+{
+	WarpAudio *chip = stream->private_data;
+
+	// the core adds bytes to total_bytes_available after ack
+	warpaudio_stream_appl(chip, AUD_STREAM_MP3,
+			      stream->runtime->total_bytes_available + bytes);
+	return 0;
+}
+
+static int warpaudio_compr_get_caps(struct snd_compr_stream *stream,
+				    struct snd_compr_caps *caps)
+{
+	caps->direction = SND_COMPRESS_PLAYBACK;
+	caps->min_fragment_size = 1024;
+	caps->max_fragment_size = MP3_BUFFER_SIZE / 2;
+	caps->min_fragments = 2;
+	caps->max_fragments = MP3_BUFFER_SIZE / 1024;
+	caps->num_codecs = 1;
+	caps->codecs[0] = SND_AUDIOCODEC_MP3;
+	return 0;
+}
+
+static const u32 warpaudio_mp3_rates[] = {
+	8000, 11025, 12000, 16000, 22050, 24000, 32000, 44100, 48000
+};
+
+static int warpaudio_compr_get_codec_caps(struct snd_compr_stream *stream,
+					  struct snd_compr_codec_caps *codec)
+{
+	struct snd_codec_desc *desc = &codec->descriptor[0];
+
+	if (codec->codec != SND_AUDIOCODEC_MP3)
+		return -EINVAL;
+
+	codec->num_descriptors = 1;
+	desc->max_ch = 2;
+	memcpy(desc->sample_rates, warpaudio_mp3_rates, sizeof(warpaudio_mp3_rates));
+	desc->num_sample_rates = ARRAY_SIZE(warpaudio_mp3_rates);
+	desc->modes = SND_AUDIOCHANMODE_MP3_MONO | SND_AUDIOCHANMODE_MP3_STEREO |
+		      SND_AUDIOCHANMODE_MP3_JOINTSTEREO | SND_AUDIOCHANMODE_MP3_DUAL;
+	return 0;
+}
+
+static const struct snd_compr_ops warpaudio_compr_ops = {
+	.open		= warpaudio_compr_open,
+	.free		= warpaudio_compr_free,
+	.set_params	= warpaudio_compr_set_params,
+	.trigger	= warpaudio_compr_trigger,
+	.pointer	= warpaudio_compr_pointer,
+	.ack		= warpaudio_compr_ack,
+	.get_caps	= warpaudio_compr_get_caps,
+	.get_codec_caps	= warpaudio_compr_get_codec_caps,
+};
+
+// ############################################################################
+// init
+// ############################################################################
+
+static void warpaudio_card_free(struct snd_card *card)
+{
+	WarpAudio *chip = card->private_data;
+
+	if (chip->status) {
+		*cswarpDpRegCR(chip->ctrlBase) = DPREG_CR_CLR | DPREG_CR_IE_AUDIO;
+		free_irq(IRQ_AMIGA_PORTS, chip);
+		dma_free_coherent(chip->dmaDev, AUD_STREAMS * sizeof(AudioStreamStatus),
+				  chip->status, chip->statusDma);
+	}
+	if (chip->mp3Buf.area)
+		snd_dma_free_pages(&chip->mp3Buf);
+}
+
+static int __init warpaudio_init(void)
+{
+	struct zorro_dev *z, *ddr;
+	struct snd_card *card;
+	struct snd_pcm *pcm;
+	WarpAudio *chip;
+	int i, rc;
+
+	z = zorro_find_device(ZORRO_PROD_CSLAB_WARP_CTRL, NULL);
+	if (!z)
+		return -ENODEV;
+	if (dma_set_mask_and_coherent(&z->dev, DMA_BIT_MASK(32)))
+		return -ENODEV;
+	ddr = zorro_find_device(ZORRO_PROD_CSLAB_WARP_DDR3, NULL);
+	if (ddr)
+		warpaudio_ddr = &ddr->resource;
+
+	rc = snd_card_new(&z->dev, index, id, THIS_MODULE, sizeof(WarpAudio), &card);
+	if (rc)
+		return rc;
+	card->private_free = warpaudio_card_free;
+	chip = card->private_data;
+	chip->card = card;
+	chip->ctrlBase = (void __iomem *)z->resource.start;
+	chip->dmaDev = &z->dev;
+	warpaudio_vol_read(chip);
+
+	strscpy(card->driver, "csWarp", sizeof(card->driver));
+	strscpy(card->shortname, "csWarp audio", sizeof(card->shortname));
+	strscpy(card->longname, "csWarp ARM audio with MP3 offload", sizeof(card->longname));
+
+	rc = snd_dma_alloc_pages(SNDRV_DMA_TYPE_DEV, chip->dmaDev, MP3_BUFFER_SIZE,
+				 &chip->mp3Buf);
+	if (rc)
+		goto err;
+	if (!warpaudio_ddr_ok(chip->mp3Buf.addr, MP3_BUFFER_SIZE)) {
+		rc = -ENOMEM;
+		goto err;
+	}
+
+	chip->status = dma_alloc_coherent(chip->dmaDev, AUD_STREAMS * sizeof(AudioStreamStatus),
+					  &chip->statusDma, GFP_KERNEL);
+	if (!chip->status) {
+		rc = -ENOMEM;
+		goto err;
+	}
+	// written by ARM DMA
+	if (!warpaudio_ddr_ok(chip->statusDma, AUD_STREAMS * sizeof(AudioStreamStatus))) {
+		dma_free_coherent(chip->dmaDev, AUD_STREAMS * sizeof(AudioStreamStatus),
+				  chip->status, chip->statusDma);
+		chip->status = NULL;
+		rc = -ENODEV;
+		goto err;
+	}
+	rc = request_irq(IRQ_AMIGA_PORTS, warpaudio_interrupt, IRQF_SHARED, DRV_NAME, chip);
+	if (rc) {
+		dma_free_coherent(chip->dmaDev, AUD_STREAMS * sizeof(AudioStreamStatus),
+				  chip->status, chip->statusDma);
+		chip->status = NULL;
+		goto err;
+	}
+	*cswarpDpRegCR(chip->ctrlBase) = DPREG_CR_CLR | DPREG_CR_IF_AUDIO;
+	*cswarpDpRegCR(chip->ctrlBase) = DPREG_CR_SET | DPREG_CR_IE_AUDIO;
+
+	rc = snd_pcm_new(card, "csWarp PCM", 0, 1, 0, &pcm);
+	if (rc)
+		goto err;
+	pcm->private_data = chip;
+	strscpy(pcm->name, "csWarp PCM", sizeof(pcm->name));
+	snd_pcm_set_ops(pcm, SNDRV_PCM_STREAM_PLAYBACK, &warpaudio_pcm_ops);
+	snd_pcm_set_managed_buffer_all(pcm, SNDRV_DMA_TYPE_DEV, chip->dmaDev,
+				       PCM_BUFFER_MAX, PCM_BUFFER_MAX);
+
+	for (i = 0; i < ARRAY_SIZE(warpaudio_controls); i++) {
+		rc = snd_ctl_add(card, snd_ctl_new1(&warpaudio_controls[i], chip));
+		if (rc)
+			goto err;
+	}
+
+	chip->compr.ops = &warpaudio_compr_ops;
+	chip->compr.private_data = chip;
+	rc = snd_compress_new(card, 1, SND_COMPRESS_PLAYBACK, "csWarp MP3", &chip->compr);
+	if (rc)
+		goto err;
+
+	rc = snd_card_register(card);
+	if (rc)
+		goto err;
+
+	warpaudio_card = card;
+	return 0;
+
+err:
+	snd_card_free(card);
+	return rc;
+}
+
+static void __exit warpaudio_exit(void)
+{
+	snd_card_free(warpaudio_card);
+}
+
+module_init(warpaudio_init);
+module_exit(warpaudio_exit);
+
+MODULE_AUTHOR("Andrzej Rogozynski");
+MODULE_DESCRIPTION("csWarp ARM audio with MP3 offload");
+MODULE_LICENSE("GPL v2");
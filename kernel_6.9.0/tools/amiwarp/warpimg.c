@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * warpimg - attach image files on the csWarp ARM filesystem as
+ *           /dev/warpimgN block devices
+ *
+ *   warpimg attach [-r] <slot> <arm path>
+ *   warpimg detach <slot>
+ *   warpimg list
+ *
+ * Copyright (C) 2024 Andrzej Rogozynski
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <linux/amiwarpdisk.h>
+
+#define CTL_DEV	"/dev/warpdisk-ctl"
+
+static void __attribute__((noreturn)) usage(void)
+{
+	fprintf(stderr,
+		"usage: warpimg attach [-r] <slot> <arm path>\n"
+		"       warpimg detach <slot>\n"
+		"       warpimg list\n");
+	exit(2);
+}
+
+static unsigned int parse_slot(const char *s)
+{
+	char *end;
+	unsigned long slot = strtoul(s, &end, 0);
+
+	if (*s == 0 || *end != 0 || slot >= WARPDISK_IMG_SLOTS) {
+		fprintf(stderr, "warpimg: slot must be 0..%d\n", WARPDISK_IMG_SLOTS - 1);
+		exit(2);
+	}
+	return slot;
+}
+
+static int do_attach(int fd, int argc, char **argv)
+{
+	struct warpdisk_img img;
+	int argi = 0;
+
+	memset(&img, 0, sizeof(img));
+	if (argc > 0 && strcmp(argv[0], "-r") == 0) {
+		img.flags |= WARPDISK_IMG_RDONLY;
+		argi++;
+	}
+	if (argc - argi != 2)
+		usage();
+
+	img.slot = parse_slot(argv[argi]);
+	if (strlen(argv[argi + 1]) >= WARPDISK_IMG_PATH_LEN) {
+		fprintf(stderr, "warpimg: path too long\n");
+		return 1;
+	}
+	strcpy(img.path, argv[argi + 1]);
+
+	if (ioctl(fd, WARPDISK_IMG_ATTACH, &img) < 0) {
+		fprintf(stderr, "warpimg: attach %s: %s\n", img.path, strerror(errno));
+		return 1;
+	}
+	printf("/dev/warpimg%u: %s, %llu MB%s\n", img.slot, img.path,
+	       (unsigned long long)img.blocks >> 11,
+	       img.flags & WARPDISK_IMG_RDONLY ? ", read-only" : "");
+	return 0;
+}
+
+static int do_detach(int fd, int argc, char **argv)
+{
+	__u32 slot;
+
+	if (argc != 1)
+		usage();
+	slot = parse_slot(argv[0]);
+
+	if (ioctl(fd, WARPDISK_IMG_DETACH, &slot) < 0) {
+		fprintf(stderr, "warpimg: detach %u: %s\n", slot, strerror(errno));
+		return 1;
+	}
+	return 0;
+}
+
+static int do_list(int fd)
+{
+	struct warpdisk_img img;
+	unsigned int slot;
+
+	for (slot = 0; slot < WARPDISK_IMG_SLOTS; slot++) {
+		memset(&img, 0, sizeof(img));
+		img.slot = slot;
+		if (ioctl(fd, WARPDISK_IMG_STATUS, &img) < 0) {
+			fprintf(stderr, "warpimg: status %u: %s\n", slot, strerror(errno));
+			return 1;
+		}
+		if (img.flags & WARPDISK_IMG_ATTACHED)
+			printf("warpimg%u: %s, %llu MB%s\n", slot, img.path,
+			       (unsigned long long)img.blocks >> 11,
+			       img.flags & WARPDISK_IMG_RDONLY ? ", read-only" : "");
+		else
+			printf("warpimg%u: -\n", slot);
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int fd, rc;
+
+	if (argc < 2)
+		usage();
+
+	fd = open(CTL_DEV, O_RDWR);
+	if (fd < 0) {
+		fprintf(stderr, "warpimg: %s: %s\n", CTL_DEV, strerror(errno));
+		return 1;
+	}
+
+	if (strcmp(argv[1], "attach") == 0)
+		rc = do_attach(fd, argc - 2, argv + 2);
+	else if (strcmp(argv[1], "detach") == 0)
+		rc = do_detach(fd, argc - 2, argv + 2);
+	else if (strcmp(argv[1], "list") == 0)
+		rc = do_list(fd);
+	else
+		usage();
+
+	close(fd);
+	return rc;
+}
@@ -0,0 +1,310 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * warpjpeg - JPEG viewer for the framebuffer, decoding on the csWarp ARM
+ *            through the amiwarp-jpeg V4L2 mem2mem device
+ *
+ *   warpjpeg [-f <fbdev>] [-t <seconds>] [-v] <file.jpg>...
+ *
+ * Images are scaled to the screen size and depth by the ARM, two are kept
+ * in flight so the next one decodes while the current one is shown.
+ * With -v the ARM writes them straight into the offscreen half of video
+ * memory (WARPFB_JPEG_DECODE) which is then shown by panning.
+ *
+ * Copyright (C) 2024 Andrzej Rogozynski
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <linux/amiwarpfb.h>
+#include <linux/fb.h>
+#include <linux/videodev2.h>
+
+#define DRV_NAME	"amiwarp-jpeg"
+#define NBUFS		2
+
+typedef struct {
+	void *mem;
+	size_t len;
+} Buf;
+
+static Buf outBufs[NBUFS], capBufs[NBUFS];
+
+static void __attribute__((noreturn)) usage(void)
+{
+	fprintf(stderr, "usage: warpjpeg [-f <fbdev>] [-t <seconds>] [-v] <file.jpg>...\n");
+	exit(2);
+}
+
+static void __attribute__((noreturn)) die(const char *what)
+{
+	fprintf(stderr, "warpjpeg: %s: %s\n", what, strerror(errno));
+	exit(1);
+}
+
+static int open_decoder(void)
+{
+	struct v4l2_capability cap;
+	char path[32];
+	int i, fd;
+
+	for (i = 0; i < 64; i++) {
+		snprintf(path, sizeof(path), "/dev/video%d", i);
+		fd = open(path, O_RDWR);
+		if (fd < 0)
+			continue;
+		if (ioctl(fd, VIDIOC_QUERYCAP, &cap) == 0 &&
+		    strcmp((char *)cap.driver, DRV_NAME) == 0)
+			return fd;
+		close(fd);
+	}
+	fprintf(stderr, "warpjpeg: no %s device\n", DRV_NAME);
+	exit(1);
+}
+
+static void setup_queue(int fd, enum v4l2_buf_type type, Buf *bufs)
+{
+	struct v4l2_requestbuffers req;
+	struct v4l2_buffer b;
+	int i;
+
+	memset(&req, 0, sizeof(req));
+	req.count = NBUFS;
+	req.type = type;
+	req.memory = V4L2_MEMORY_MMAP;
+	if (ioctl(fd, VIDIOC_REQBUFS, &req) < 0 || req.count < NBUFS)
+		die("VIDIOC_REQBUFS");
+
+	for (i = 0; i < NBUFS; i++) {
+		memset(&b, 0, sizeof(b));
+		b.type = type;
+		b.memory = V4L2_MEMORY_MMAP;
+		b.index = i;
+		if (ioctl(fd, VIDIOC_QUERYBUF, &b) < 0)
+			die("VIDIOC_QUERYBUF");
+		bufs[i].len = b.length;
+		bufs[i].mem = mmap(NULL, b.length, PROT_READ | PROT_WRITE, MAP_SHARED,
+				   fd, b.m.offset);
+		if (bufs[i].mem == MAP_FAILED)
+			die("mmap");
+	}
+}
+
+static int queue_buf(int fd, enum v4l2_buf_type type, int index, size_t used)
+{
+	struct v4l2_buffer b;
+
+	memset(&b, 0, sizeof(b));
+	b.type = type;
+	b.memory = V4L2_MEMORY_MMAP;
+	b.index = index;
+	b.bytesused = used;
+	return ioctl(fd, VIDIOC_QBUF, &b);
+}
+
+static int dequeue_buf(int fd, enum v4l2_buf_type type, struct v4l2_buffer *b)
+{
+	memset(b, 0, sizeof(*b));
+	b->type = type;
+	b->memory = V4L2_MEMORY_MMAP;
+	return ioctl(fd, VIDIOC_DQBUF, b);
+}
+
+// read a JPEG into an OUTPUT buffer, returns its size or 0
+static size_t load_jpeg(const char *path, Buf *buf)
+{
+	ssize_t len = 0, n;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0) {
+		fprintf(stderr, "warpjpeg: %s: %s\n", path, strerror(errno));
+		return 0;
+	}
+	while ((size_t)len < buf->len &&
+	       (n = read(fd, (char *)buf->mem + len, buf->len - len)) > 0)
+		len += n;
+	if ((size_t)len == buf->len && read(fd, &n, 1) > 0) {
+		fprintf(stderr, "warpjpeg: %s: too large\n", path);
+		len = 0;
+	}
+	close(fd);
+	return len;
+}
+
+// decode into the hidden screen page and pan to it
+static int show_vram(int fbFd, struct fb_var_screeninfo *var,
+		     struct fb_fix_screeninfo *fix, char **files, int cnt,
+		     unsigned int delay)
+{
+	struct warpfb_jpeg_decode dec;
+	static uint8_t jpeg[WARPFB_JPEG_MAX_SIZE];
+	Buf buf = { jpeg, sizeof(jpeg) };
+	int i, page = 1, shown = 0;
+
+	if (var->yres_virtual < 2 * var->yres) {
+		var->yres_virtual = 2 * var->yres;
+		if (ioctl(fbFd, FBIOPUT_VSCREENINFO, var) < 0 ||
+		    ioctl(fbFd, FBIOGET_FSCREENINFO, fix) < 0)
+			die("FBIOPUT_VSCREENINFO");
+	}
+
+	for (i = 0; i < cnt; i++) {
+		memset(&dec, 0, sizeof(dec));
+		dec.src = (uintptr_t)jpeg;
+		dec.src_len = load_jpeg(files[i], &buf);
+		if (!dec.src_len)
+			continue;
+		dec.dst_offset = page * var->yres * fix->line_length;
+		if (ioctl(fbFd, WARPFB_JPEG_DECODE, &dec) < 0) {
+			fprintf(stderr, "warpjpeg: %s: %s\n", files[i], strerror(errno));
+			continue;
+		}
+		if (shown++ && delay)
+			sleep(delay);
+		var->xoffset = 0;
+		var->yoffset = page * var->yres;
+		if (ioctl(fbFd, FBIOPAN_DISPLAY, var) < 0)
+			die("FBIOPAN_DISPLAY");
+		page ^= 1;
+	}
+
+	if (shown && delay)
+		sleep(delay);
+	return shown ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+	const char *fbPath = "/dev/fb0";
+	struct fb_var_screeninfo var;
+	struct fb_fix_screeninfo fix;
+	struct v4l2_format fmt;
+	struct v4l2_buffer b;
+	enum v4l2_buf_type type;
+	unsigned int delay = 3, y, lineLen;
+	off_t maxSize = 0;
+	int opt, fbFd, fd, next, shown = 0, inFlight = 0, outSlot = 0, vram = 0;
+	uint8_t *fbMem;
+	struct stat st;
+
+	while ((opt = getopt(argc, argv, "f:t:v")) != -1) {
+		switch (opt) {
+		case 'f':
+			fbPath = optarg;
+			break;
+		case 't':
+			delay = strtoul(optarg, NULL, 0);
+			break;
+		case 'v':
+			vram = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind >= argc)
+		usage();
+
+	fbFd = open(fbPath, O_RDWR);
+	if (fbFd < 0)
+		die(fbPath);
+	if (ioctl(fbFd, FBIOGET_VSCREENINFO, &var) < 0 ||
+	    ioctl(fbFd, FBIOGET_FSCREENINFO, &fix) < 0)
+		die("FBIOGET_SCREENINFO");
+	if (var.bits_per_pixel != 16 && var.bits_per_pixel != 32) {
+		fprintf(stderr, "warpjpeg: %u bpp screen not supported\n", var.bits_per_pixel);
+		return 1;
+	}
+	if (vram)
+		return show_vram(fbFd, &var, &fix, argv + optind, argc - optind, delay);
+
+	fbMem = mmap(NULL, fix.smem_len, PROT_READ | PROT_WRITE, MAP_SHARED, fbFd, 0);
+	if (fbMem == MAP_FAILED)
+		die("mmap fb");
+
+	for (next = optind; next < argc; next++)
+		if (stat(argv[next], &st) == 0 && st.st_size > maxSize)
+			maxSize = st.st_size;
+
+	fd = open_decoder();
+
+	memset(&fmt, 0, sizeof(fmt));
+	fmt.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+	fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_JPEG;
+	fmt.fmt.pix.sizeimage = maxSize;
+	if (ioctl(fd, VIDIOC_S_FMT, &fmt) < 0)
+		die("VIDIOC_S_FMT output");
+
+	memset(&fmt, 0, sizeof(fmt));
+	fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	fmt.fmt.pix.pixelformat = var.bits_per_pixel == 16 ?
+				  V4L2_PIX_FMT_RGB565X : V4L2_PIX_FMT_XRGB32;
+	fmt.fmt.pix.width = var.xres;
+	fmt.fmt.pix.height = var.yres;
+	if (ioctl(fd, VIDIOC_S_FMT, &fmt) < 0)
+		die("VIDIOC_S_FMT capture");
+
+	setup_queue(fd, V4L2_BUF_TYPE_VIDEO_OUTPUT, outBufs);
+	setup_queue(fd, V4L2_BUF_TYPE_VIDEO_CAPTURE, capBufs);
+	for (y = 0; y < NBUFS; y++)
+		if (queue_buf(fd, V4L2_BUF_TYPE_VIDEO_CAPTURE, y, 0) < 0)
+			die("VIDIOC_QBUF capture");
+
+	type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+	if (ioctl(fd, VIDIOC_STREAMON, &type) < 0)
+		die("VIDIOC_STREAMON");
+	type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	if (ioctl(fd, VIDIOC_STREAMON, &type) < 0)
+		die("VIDIOC_STREAMON");
+
+	lineLen = fmt.fmt.pix.bytesperline < fix.line_length ?
+		  fmt.fmt.pix.bytesperline : fix.line_length;
+	next = optind;
+	for (;;) {
+		// keep the decoder busy
+		while (inFlight < NBUFS && next < argc) {
+			// jobs complete in order, so do the OUTPUT buffers
+			size_t len = load_jpeg(argv[next++], &outBufs[outSlot]);
+
+			if (!len)
+				continue;
+			if (queue_buf(fd, V4L2_BUF_TYPE_VIDEO_OUTPUT, outSlot, len) < 0)
+				die("VIDIOC_QBUF output");
+			outSlot = (outSlot + 1) % NBUFS;
+			inFlight++;
+		}
+		if (!inFlight)
+			break;
+
+		if (dequeue_buf(fd, V4L2_BUF_TYPE_VIDEO_OUTPUT, &b) < 0)
+			die("VIDIOC_DQBUF output");
+		if (dequeue_buf(fd, V4L2_BUF_TYPE_VIDEO_CAPTURE, &b) < 0)
+			die("VIDIOC_DQBUF capture");
+		inFlight--;
+
+		if (b.flags & V4L2_BUF_FLAG_ERROR) {
+			fprintf(stderr, "warpjpeg: decode failed\n");
+		} else {
+			if (shown++ && delay)
+				sleep(delay);
+			for (y = 0; y < fmt.fmt.pix.height && y < var.yres; y++)
+				memcpy(fbMem + (var.yoffset + y) * fix.line_length,
+				       (uint8_t *)capBufs[b.index].mem + y * fmt.fmt.pix.bytesperline,
+				       lineLen);
+		}
+		if (queue_buf(fd, V4L2_BUF_TYPE_VIDEO_CAPTURE, b.index, 0) < 0)
+			die("VIDIOC_QBUF capture");
+	}
+
+	if (shown && delay)
+		sleep(delay);
+	return shown ? 0 : 1;
+}